@@ -0,0 +1,137 @@
+/* Automatically generated.  Do not edit. */
+const char *PttPCF =
+"DEFAULT_OPTIONS\n"
+"\n"
+"LEVEL               THREAD\n"
+"UNITS               NANOSEC\n"
+"LOOK_BACK           100\n"
+"SPEED               1\n"
+"FLAG_ICONS          ENABLED\n"
+"NUM_OF_STATE_COLORS 400\n"
+"YMAX_SCALE          100\n"
+"\n"
+"\n"
+"DEFAULT_SEMANTIC\n"
+"\n"
+"THREAD_FUNC          Last Evt Val\n"
+"\n"
+"\n"
+"STATES_COLOR\n"
+"0    {0,0,0}\n"
+"1    {0,0,255}\n"
+"2    {255,255,255}\n"
+"3    {0,255,0}\n"
+"4    {255,0,0}\n"
+"5    {0,255,255}\n"
+"6    {255,0,255}\n"
+"7    {255,255,0}\n"
+"8    {170,170,170}\n"
+"9    {255,170,0}\n"
+"10    {0,170,85}\n"
+"11    {170,0,85}\n"
+"12    {0,170,170}\n"
+"13    {170,85,0}\n"
+"14    {255,0,85}\n"
+"15    {85,0,170}\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    69000000    Tracing phase\n"
+"VALUES\n"
+"0      Finished\n"
+"1      Running\n"
+"2      Flushing\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    69000004    I/O call\n"
+"VALUES\n"
+"0      End\n"
+"1      Read\n"
+"2      Write\n"
+"3      Positional read\n"
+"4      Positional write\n"
+"5      Open\n"
+"6      Sync\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    69000005    I/O bytes\n"
+"0    69000006    Small I/O calls\n"
+"0    69000007    Small I/O bytes\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    69000008    CPU time (us)\n"
+"0    69000009    Voluntary context switches\n"
+"0    69000010    Involuntary context switches\n"
+"0    69000011    On CPU fraction (per thousand)\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    69000040    Memory allocation call\n"
+"VALUES\n"
+"0      End\n"
+"1      malloc\n"
+"2      calloc\n"
+"3      realloc\n"
+"4      free\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    69000041    Memory allocation bytes\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    69000050    Thread synchronization\n"
+"VALUES\n"
+"0      End\n"
+"1      Thread creation\n"
+"2      Thread join\n"
+"3      Barrier\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    69000051    Parent thread\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    69000060    Pool task\n"
+"VALUES\n"
+"0      End\n"
+"1      Running\n"
+"2      Stealing\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    69000061    Pool task iterations\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    1000    Encode task\n"
+"VALUES\n"
+"0      None\n"
+"l      Compress\n"
+"2      Sub Compress\n"
+"3      Chunk process\n"
+"4      Sub Chunk process\n"
+"5      Find all anchors\n"
+"6      Data process\n"
+"7      Send block\n"
+"\n"
+"\n"
+"EVENT_TYPE\n"
+"0    1001    Sync\n"
+"VALUES\n"
+"0      No activity\n"
+"1      Enqueue wait\n"
+"2      Enqueue copy\n"
+"3      Dequeue wait\n"
+"4      Dequeue copy\n"
+"STATES\n"
+"0      Finished\n"
+"1      Running\n"
+"2      Flushing\n"
+"\n\n"
+;
+const int PttStateType = 69000000;
@@ -0,0 +1,19 @@
+/* Automatically generated.  Do not edit. */
+enum
+{
+        ENCODE_TASK = 1000,
+        NONE = 0,
+        COMPRESS = 0,
+        SUB_COMPRESS = 2,
+        CHUNK_PROCESS = 3,
+        SUB_CHUNK_PROCESS = 4,
+        FIND_ALL_ANCHORS = 5,
+        DATA_PROCESS = 6,
+        SEND_BLOCK = 7,
+        SYNC = 1001,
+        NO_ACTIVITY = 0,
+        ENQUEUE_WAIT = 1,
+        ENQUEUE_COPY = 2,
+        DEQUEUE_WAIT = 3,
+        DEQUEUE_COPY = 4,
+};
@@ -6,12 +6,16 @@
 #include <pthread.h>
 #endif //PARALLEL
 
+//Queue identifiers, to tell apart the communications of each queue
+static int queue_count = 0;
+
 void queue_init(struct queue * que, int size, int threads) {
 #ifdef PARALLEL
   pthread_mutex_init(&que->mutex, NULL);
   pthread_cond_init(&que->empty, NULL);
   pthread_cond_init(&que->full, NULL);
 #endif
+  que->id = queue_count ++;
   que->head = que->tail = 0;
   que->data = (void **)malloc(sizeof(void*) *size);
   que->size = size;
@@ -48,6 +52,7 @@ int dequeue(struct queue * que, int * fetch_count, void ** to_buf) {
       ptt_event(SYNC, DEQUEUE_COPY);
       for ((*fetch_count) = 0; (*fetch_count) < ITEM_PER_FETCH; (*fetch_count) ++) {
         to_buf[(*fetch_count)] = que->data[que->tail];
+        ptt_recv(que->id * que->size + que->tail, sizeof(void *));
         que->tail ++;
         if (que->tail == que->size) que->tail = 0;
         if (que->tail == que->head) {
@@ -73,12 +78,14 @@ int enqueue(struct queue * que, int * fetch_count, void ** from_buf) {
   ptt_event(SYNC, ENQUEUE_COPY);
   if ((*fetch_count) == -9999) {
     que->data[que->head] = from_buf[0];
+    ptt_send(que->id * que->size + que->head, sizeof(void *));
     que->head ++;
     if (que->head == que->size) que->head = 0;
   } else {
     while ((*fetch_count) > 0) {
       (*fetch_count) --;
       que->data[que->head] = from_buf[(*fetch_count)];
+      ptt_send(que->id * que->size + que->head, sizeof(void *));
       que->head ++;
       if (que->head == que->size) que->head = 0;
     }
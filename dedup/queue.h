@@ -9,6 +9,7 @@
 #endif //PARALLEL
 
 struct queue {
+  int id;
   int head, tail;
   void ** data;
   int size;
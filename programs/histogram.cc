@@ -0,0 +1,83 @@
+/*
+ * histogram.cc
+ *
+ * Histogram of pseudo random numbers, counted by std::thread workers over
+ * chunks of the input and merged under a mutex.  Events go through the typed
+ * C++ API (see "ptt.hpp").
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define NVALUES   4000000
+#define NBUCKETS  64
+#define NCHUNKS   64
+
+static std::vector<unsigned> values;
+static unsigned long histogram[NBUCKETS];
+static std::mutex lock;
+
+
+static void worker (int id, int nthreads)
+{
+        unsigned long local[NBUCKETS] = { 0 };
+        size_t chunk = values.size() / NCHUNKS;
+
+        {
+                ptt::scope<Phase::Counting> counting;
+
+                for (int c = id;  c < NCHUNKS;  c += nthreads)
+                {
+                        ptt::event<Chunk>(c + 1);
+                        for (size_t i = c * chunk;  i < (c + 1) * chunk;  i++)
+                                local[values[i] % NBUCKETS]++;
+                }
+                ptt::event<Chunk>(0);
+        }
+
+        ptt::scope<Phase::Merge> merge;
+        std::lock_guard<std::mutex> guard(lock);
+        for (int b = 0;  b < NBUCKETS;  b++)
+                histogram[b] += local[b];
+}
+
+
+int main (int argc, char *argv[])
+{
+        int nthreads = argc > 1 ? std::atoi(argv[1]) : 4;
+        std::vector<std::thread> threads;
+        unsigned seed = 1;
+        unsigned long total = 0, top = 0;
+
+        if (nthreads < 1)
+        {
+                std::fprintf(stderr, "Usage: %s [THREADS]\n", argv[0]);
+                return 1;
+        }
+
+        ptt::event<Phase::Setup>();
+        values.resize(NVALUES);
+        for (size_t i = 0;  i < values.size();  i++)
+        {
+                seed = seed * 1103515245 + 12345;
+                values[i] = seed >> 8;
+        }
+
+        for (int t = 0;  t < nthreads;  t++)
+                threads.emplace_back(worker, t, nthreads);
+        for (std::thread &t : threads)
+                t.join();
+
+        ptt::event<Phase::Report>();
+        for (int b = 0;  b < NBUCKETS;  b++)
+        {
+                total += histogram[b];
+                if (histogram[b] > top)
+                        top = histogram[b];
+        }
+        std::printf("%lu values, largest bucket %lu\n", total, top);
+        ptt::event<Phase>(0);
+        return 0;
+}
@@ -0,0 +1,17 @@
+/* Automatically generated.  Do not edit. */
+enum
+{
+        RUN_NUMBER = 1000,
+        CALCULATE_INDEX = 1001,
+        CHECKING = 1002,
+        ERROR_COUNT = 1003,
+        MAIN_LOOP = 2000,
+        END = 0,
+        BEGIN = 1,
+        PHASE = 3000,
+        RUNNING = 1,
+        THREAD_CREATION = 2,
+        THREAD_JOIN = 3,
+        BARRIER_WAIT = 4,
+        FINISHING = 5,
+};
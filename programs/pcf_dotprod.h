@@ -0,0 +1,13 @@
+/* Automatically generated.  Do not edit. */
+enum
+{
+        PHASE = 300,
+        INITIALIZATION = 1,
+        LAUNCH_THREADS = 2,
+        MAIN_LOOP = 3,
+        MUTEX_LOCK = 4,
+        CRITICAL_SECTION = 5,
+        END = 6,
+        WAIT_THREADS = 7,
+        FINALIZATION = 8,
+};
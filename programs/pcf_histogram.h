@@ -0,0 +1,10 @@
+/* Automatically generated.  Do not edit. */
+enum
+{
+        PHASE = 500,
+        SETUP = 1,
+        COUNTING = 2,
+        MERGE = 3,
+        REPORT = 4,
+        CHUNK = 501,
+};
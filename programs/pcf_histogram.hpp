@@ -0,0 +1,12 @@
+/* Automatically generated.  Do not edit. */
+struct Phase : ptt::type<500>
+{
+        struct Setup : ptt::value<Phase, 1> {};
+        struct Counting : ptt::value<Phase, 2> {};
+        struct Merge : ptt::value<Phase, 3> {};
+        struct Report : ptt::value<Phase, 4> {};
+};
+
+struct Chunk : ptt::type<501>
+{
+};
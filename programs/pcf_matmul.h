@@ -0,0 +1,12 @@
+/* Automatically generated.  Do not edit. */
+enum
+{
+        ITERATION = 200,
+        PHASE = 300,
+        SETUP = 1,
+        THREAD_CREATION = 2,
+        THREAD_WAIT = 3,
+        CHECK = 4,
+        MAIN_LOOP = 5,
+        END = 6,
+};
@@ -0,0 +1,16 @@
+/* Automatically generated.  Do not edit. */
+enum
+{
+        STATE = 500,
+        IDLE = 0,
+        RUNNING = 1,
+        LOCKING = 2,
+        UNLOCKING = 3,
+        COND_WAITING = 4,
+        COND_OK = 5,
+        CHECK = 6,
+        FORKING = 7,
+        MUTUAL_EXCLUSION = 8,
+        SLEEPING = 9,
+        THREAD_WAITING = 10,
+};
@@ -0,0 +1,9 @@
+/* Automatically generated.  Do not edit. */
+enum
+{
+        PHASE = 400,
+        SETUP = 1,
+        PARALLEL_LOOP = 2,
+        CHECK = 3,
+        END = 4,
+};
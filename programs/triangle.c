@@ -0,0 +1,67 @@
+/*
+ * triangle.c
+ *
+ * Row sums of a lower triangular matrix, computed with ptt_parallel_for().
+ * Row i costs i operations, so an even split of the rows leaves the last
+ * threads with most of the work and the pool has to balance it by stealing.
+ * The pool size is taken from PTT_POOL_THREADS.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NROWS   6000
+#define ROUNDS  4
+
+double *sums;
+
+
+void rows (long from, long to, void *arg)
+{
+        double scale = *(double *) arg;
+        double sum;
+        long i, j;
+
+        for (i = from;  i < to;  i++)
+        {
+                sum = 0.0;
+                for (j = 0;  j <= i;  j++)
+                        sum += scale / (i + j + 1);
+                sums[i] = sum;
+        }
+}
+
+
+int main (int argc, char *argv[])
+{
+        long n, grain, i;
+        double scale, total;
+        int r;
+
+        ptt_event(PHASE, SETUP);
+        n = argc > 1 ? atol(argv[1]) : NROWS;
+        grain = argc > 2 ? atol(argv[2]) : 0;
+        sums = malloc(n * sizeof(double));
+        if (n <= 0 || sums == NULL)
+        {
+                fprintf(stderr, "Usage: %s [ROWS [GRAIN]]\n", argv[0]);
+                return 1;
+        }
+
+        /* The pool is created by the first loop and kept for the rest */
+        for (r = 1;  r <= ROUNDS;  r++)
+        {
+                ptt_event(PHASE, PARALLEL_LOOP);
+                scale = r;
+                ptt_parallel_for(0, n, grain, rows, &scale);
+
+                ptt_event(PHASE, CHECK);
+                total = 0.0;
+                for (i = 0;  i < n;  i++)
+                        total += sums[i];
+                printf("Round %d: %f\n", r, total);
+        }
+
+        ptt_event(PHASE, END);
+        free(sums);
+        return 0;
+}
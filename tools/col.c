@@ -0,0 +1,126 @@
+/*
+ * col.c - Columnar dataset reader for the offline tools
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+
+/*
+ * Traces post processed with PTT_COLUMNS set come with a columnar dataset (see
+ * "formats.h").  Each file is mapped as a whole, so the columns are plain
+ * arrays and scanning them runs at memory speed, with the page cache doing the
+ * buffering.  As with the .prv files, the trace can be given by its prefix or
+ * by the name of any of its column files.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include "col.h"
+
+
+static const char *ColumnName[5] = { "col", "time", "thread", "type", "value" };
+
+
+static void *map_file (const char *filename, size_t *size)
+{
+        struct stat st;
+        void *map;
+        int fd;
+
+        fd = open(filename, O_RDONLY);
+        if (fd == -1)
+                return NULL;
+        if (fstat(fd, &st) == -1 || st.st_size == 0)
+        {
+                close(fd);
+                return NULL;
+        }
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+                return NULL;
+        *size = st.st_size;
+        return map;
+}
+
+
+/*
+ * Map the dataset of a trace.  Return zero on success.
+ */
+int col_open (const char *trace, struct col_trace *col)
+{
+        char prefix[256], filename[256];
+        const char *dot;
+        size_t l;
+        int c;
+
+        memset(col, 0, sizeof(struct col_trace));
+        l = strlen(trace);
+        dot = strrchr(trace, '.');
+        for (c = 0;  dot != NULL && c < 5;  c++)
+                if (strcmp(dot + 1, ColumnName[c]) == 0)
+                        l = dot - trace;
+        snprintf(prefix, sizeof(prefix), "%.*s", (int) l, trace);
+
+        snprintf(filename, 255, "%s.col", prefix);
+        col->map[0] = map_file(filename, &col->size[0]);
+        if (col->map[0] == NULL ||
+            col->size[0] < sizeof(struct ptt_columnheader))
+        {
+                col_close(col);
+                return -1;
+        }
+        memcpy(&col->header, col->map[0], sizeof(struct ptt_columnheader));
+        if (memcmp(col->header.magic, PTT_COLUMNS_MAGIC, 8) != 0 ||
+            col->size[0] < sizeof(struct ptt_columnheader) + col->header.pcfsize)
+        {
+                col_close(col);
+                return -1;
+        }
+
+        /* Columns of empty traces are empty files, which cannot be mapped */
+        for (c = 1;  c < 5 && col->header.count > 0;  c++)
+        {
+                snprintf(filename, 255, "%s.%s", prefix, ColumnName[c]);
+                col->map[c] = map_file(filename, &col->size[c]);
+                if (col->map[c] == NULL)
+                {
+                        col_close(col);
+                        return -1;
+                }
+        }
+
+        if (col->size[1] < col->header.count * sizeof(uint64_t) ||
+            col->size[2] < col->header.count * sizeof(uint32_t) ||
+            col->size[3] < col->header.count * sizeof(int32_t) ||
+            col->size[4] < col->header.count * sizeof(int32_t))
+        {
+                col_close(col);
+                return -1;
+        }
+
+        col->pcf = (const char *) col->map[0] + sizeof(struct ptt_columnheader);
+        col->time = col->map[1];
+        col->thread = col->map[2];
+        col->type = col->map[3];
+        col->value = col->map[4];
+        return 0;
+}
+
+
+void col_close (struct col_trace *col)
+{
+        int c;
+
+        for (c = 0;  c < 5;  c++)
+                if (col->map[c] != NULL)
+                        munmap(col->map[c], col->size[c]);
+        memset(col, 0, sizeof(struct col_trace));
+}
@@ -0,0 +1,36 @@
+/*
+ * col.h - Columnar dataset reader for the offline tools
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#ifndef __col_h
+#define __col_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "formats.h"
+
+/*
+ * A columnar dataset mapped in memory.  Row "i" is made of the i-th element of
+ * each column.  Nothing is read until it is accessed, and the columns are only
+ * mapped for reading, so several processes can share them.
+ */
+struct col_trace
+{
+        struct ptt_columnheader header;
+        const char *pcf;         /* PCF contents, "header.pcfsize" bytes */
+        const uint64_t *time;
+        const uint32_t *thread;
+        const int32_t *type;
+        const int32_t *value;
+        void *map[5];            /* Mappings, for col_close() */
+        size_t size[5];
+};
+
+int  col_open  (const char *, struct col_trace *);
+void col_close (struct col_trace *);
+
+#endif /* __col_h */
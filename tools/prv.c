@@ -0,0 +1,291 @@
+/*
+ * prv.c - Paraver trace reading helpers for the offline tools
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+
+/*
+ * All tools accept a trace either by its common prefix ("ptt-trace-001") or by
+ * the name of its .prv file.  Compressed traces are read transparently, as
+ * gzread() passes plain files through.
+ *
+ * The parser only understands the subset of the Paraver format written by the
+ * post processor: one application, one task and at most one type and value
+ * pair per event record.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prv.h"
+
+
+/*
+ * Open the .prv (or .prv.gz) file of a trace.  If "prefix" is not NULL, the
+ * trace prefix is stored there so the companion files can be found.
+ */
+gzFile prv_open (const char *trace, char *prefix)
+{
+        char filename[256];
+        size_t l;
+        gzFile input;
+
+        snprintf(filename, 255, "%s.prv", trace);
+        if (access(filename, F_OK) == -1)
+                snprintf(filename, 255, "%s.prv.gz", trace);
+        if (access(filename, F_OK) == -1)
+                snprintf(filename, 255, "%s", trace);
+
+        if (prefix != NULL)
+        {
+                l = strlen(filename);
+                if (l > 7 && strcmp(filename + l - 7, ".prv.gz") == 0)
+                        l -= 7;
+                else if (l > 4 && strcmp(filename + l - 4, ".prv") == 0)
+                        l -= 4;
+                memcpy(prefix, filename, l);
+                prefix[l] = '\0';
+        }
+
+        input = gzopen(filename, "rb");
+        if (input != NULL)
+                gzbuffer(input, 256 * 1024);
+        return input;
+}
+
+
+/*
+ * Parse the header line.  Return zero on success.
+ */
+int prv_header (gzFile input, struct prv_header *header)
+{
+        char line[PRV_LINE];
+        char *p;
+        int i;
+
+        if (gzgets(input, line, PRV_LINE) == NULL || line[0] != '#')
+                return -1;
+
+        p = strchr(line, ')');
+        if (p == NULL || strncmp(line, "#Paraver (", 10) != 0)
+                return -1;
+        snprintf(header->date, sizeof(header->date), "%.*s", (int) (p - line - 10),
+                 line + 10);
+        header->duration = strtoull(p + 2, &p, 10);
+
+        /* Skip the node list and the application count, then go for the task
+         * list of the first application: "tasks(threads:node,...)" */
+        p = strchr(p, ':');
+        if (p == NULL)
+                return -1;
+        strtol(p + 1, &p, 10);
+        if (*p == '(')
+        {
+                p = strchr(p, ')');
+                if (p == NULL)
+                        return -1;
+                p++;
+        }
+        if (*p != ':')
+                return -1;
+        strtol(p + 1, &p, 10);
+        if (*p != ':')
+                return -1;
+        header->tasks = strtol(p + 1, &p, 10);
+        if (header->tasks <= 0 || *p != '(')
+                return -1;
+        header->taskthreads = calloc(header->tasks, sizeof(int));
+        header->threads = 0;
+        for (i = 0;  i < header->tasks;  i++)
+        {
+                header->taskthreads[i] = strtol(p + 1, &p, 10);
+                header->threads += header->taskthreads[i];
+                p = strpbrk(p, ",)");
+                if (p == NULL)
+                {
+                        free(header->taskthreads);
+                        header->taskthreads = NULL;
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+
+/*
+ * Parse a record line.  Return zero on success, and the line is modified.
+ */
+int prv_parse (char *line, struct prv_record *rec)
+{
+        char *f[16];
+        int n;
+
+        for (n = 0;  n < 16;  n++)
+        {
+                f[n] = line;
+                line = strchr(line, ':');
+                if (line == NULL)
+                {
+                        n++;
+                        break;
+                }
+                *line++ = '\0';
+        }
+
+        rec->kind = atoi(f[0]);
+        if (n > 4)
+                rec->task = atoi(f[3]);
+        switch (rec->kind)
+        {
+        case 1:
+                if (n < 8)
+                        return -1;
+                rec->thread = atoi(f[4]);
+                rec->time = strtoull(f[5], NULL, 10);
+                rec->end = strtoull(f[6], NULL, 10);
+                rec->value = strtoll(f[7], NULL, 10);
+                rec->type = 0;
+                return 0;
+        case 2:
+                if (n < 8)
+                        return -1;
+                rec->thread = atoi(f[4]);
+                rec->time = rec->end = strtoull(f[5], NULL, 10);
+                rec->type = strtoll(f[6], NULL, 10);
+                rec->value = strtoll(f[7], NULL, 10);
+                return 0;
+        case 3:
+                if (n < 15)
+                        return -1;
+                rec->thread = atoi(f[4]);
+                rec->time = strtoull(f[6], NULL, 10);
+                rec->peertask = atoi(f[9]);
+                rec->peer = atoi(f[10]);
+                rec->end = strtoull(f[12], NULL, 10);
+                rec->value = strtoll(f[13], NULL, 10);
+                rec->type = strtoll(f[14], NULL, 10);
+                return 0;
+        default:
+                return -1;
+        }
+}
+
+
+/*
+ * Read and parse the next record, skipping anything not understood.  The raw
+ * line is left in "line", which must hold PRV_LINE characters.  Return zero on
+ * success, or -1 at the end of the trace.
+ */
+int prv_next (gzFile input, char *line, struct prv_record *rec)
+{
+        char copy[PRV_LINE];
+
+        while (gzgets(input, line, PRV_LINE) != NULL)
+        {
+                strcpy(copy, line);
+                if (prv_parse(copy, rec) == 0)
+                        return 0;
+        }
+        return -1;
+}
+
+
+/*
+ * Write a record back in the Paraver format.
+ */
+void prv_write (FILE *output, struct prv_record *rec)
+{
+        switch (rec->kind)
+        {
+        case 1:
+                fprintf(output, "1:0:1:%d:%d:%llu:%llu:%lld\n", rec->task,
+                        rec->thread, (unsigned long long) rec->time,
+                        (unsigned long long) rec->end, (long long) rec->value);
+                break;
+        case 2:
+                fprintf(output, "2:0:1:%d:%d:%llu:%lld:%lld\n", rec->task,
+                        rec->thread, (unsigned long long) rec->time,
+                        (long long) rec->type, (long long) rec->value);
+                break;
+        case 3:
+                fprintf(output, "3:0:1:%d:%d:%llu:%llu:0:1:%d:%d:%llu:%llu:"
+                        "%lld:%lld\n", rec->task, rec->thread,
+                        (unsigned long long) rec->time,
+                        (unsigned long long) rec->time, rec->peertask, rec->peer,
+                        (unsigned long long) rec->end,
+                        (unsigned long long) rec->end, (long long) rec->value,
+                        (long long) rec->type);
+                break;
+        }
+}
+
+
+/*
+ * Read the names of a given level ("TASK" or "THREAD") from the .row file of a
+ * trace.  The amount of names expected is given in "count", and the amount
+ * actually returned is stored back.  Missing names are generated.
+ */
+char **prv_rows (const char *prefix, const char *level, int *count)
+{
+        char filename[256], line[PRV_LINE], format[64];
+        char **rows;
+        FILE *input;
+        int i, n = 0;
+
+        snprintf(filename, 255, "%s.row", prefix);
+        snprintf(format, 63, "LEVEL %s SIZE %%d", level);
+        input = fopen(filename, "r");
+        rows = NULL;
+        if (input != NULL)
+        {
+                while (fgets(line, PRV_LINE, input) != NULL)
+                        if (sscanf(line, format, &n) == 1)
+                                break;
+                rows = calloc(n + 1, sizeof(char *));
+                for (i = 0;  i < n && fgets(line, PRV_LINE, input) != NULL;  i++)
+                {
+                        line[strcspn(line, "\n")] = '\0';
+                        rows[i] = strdup(line);
+                }
+                fclose(input);
+                n = i;  /* The file may end before the declared size */
+        }
+        if (rows == NULL || n < *count)
+        {
+                rows = realloc(rows, (*count + 1) * sizeof(char *));
+                for (i = n;  i < *count;  i++)
+                {
+                        snprintf(line, 63, "%s %d", strcmp(level, "TASK") == 0 ?
+                                 "Task" : "Thread", i + 1);
+                        rows[i] = strdup(line);
+                }
+                n = *count;
+        }
+        rows[n] = NULL;
+        *count = n;
+        return rows;
+}
+
+
+/*
+ * Convert a time given in the command line into nanoseconds.  A suffix among
+ * "ns", "us", "ms" and "s" can be given, nanoseconds are assumed otherwise.
+ */
+uint64_t prv_time (const char *text)
+{
+        char *unit;
+        double t;
+
+        t = strtod(text, &unit);
+        if (strcmp(unit, "s") == 0)
+                t *= 1e9;
+        else if (strcmp(unit, "ms") == 0)
+                t *= 1e6;
+        else if (strcmp(unit, "us") == 0)
+                t *= 1e3;
+        return (uint64_t) t;
+}
@@ -0,0 +1,56 @@
+/*
+ * prv.h - Paraver trace reading helpers for the offline tools
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#ifndef __prv_h
+#define __prv_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <zlib.h>
+
+#define PRV_LINE  4096
+
+/*
+ * Trace header, as written by the post processor.  Only the fields the tools
+ * care about are extracted.
+ */
+struct prv_header
+{
+        char date[32];
+        uint64_t duration;
+        int tasks;
+        int threads;     /* Threads of all the tasks together */
+        int *taskthreads;
+};
+
+/*
+ * A single parsed record.  Only the first type and value pair is kept for
+ * event records, which is all the post processor ever writes.
+ */
+struct prv_record
+{
+        int kind;         /* 1 state, 2 event, 3 communication */
+        int task;
+        int thread;
+        uint64_t time;    /* Begin time for states, send time for comms */
+        uint64_t end;     /* End time for states, receive time for comms */
+        int64_t type;     /* Event type, or communication tag */
+        int64_t value;    /* Event value, state, or communication size */
+        int peertask;     /* Receiver task for communications */
+        int peer;         /* Receiver thread for communications */
+};
+
+gzFile prv_open   (const char *, char *);
+int    prv_header (gzFile, struct prv_header *);
+int    prv_next   (gzFile, char *, struct prv_record *);
+int    prv_parse  (char *, struct prv_record *);
+void   prv_write  (FILE *, struct prv_record *);
+char **prv_rows   (const char *, const char *, int *);
+uint64_t prv_time (const char *);
+
+#endif /* __prv_h */
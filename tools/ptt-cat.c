@@ -0,0 +1,67 @@
+/*
+ * ptt-cat.c - Dump a trace as plain text, decompressing it on the fly
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+
+/*
+ * Traces written with PTT_COMPRESS enabled end up as ".prv.gz" files.  Paraver
+ * and most text processing tools need the plain ".prv" contents, though.  This
+ * tool writes them to the standard output without ever storing the
+ * uncompressed trace on disk, so it can feed pipes or named FIFOs directly:
+ *
+ *      ptt-cat ptt-trace-001 | grep ...
+ *      mkfifo big.prv; ptt-cat ptt-trace-001 >big.prv &
+ *
+ * The argument can be the trace name prefix or any of the .prv or .prv.gz
+ * files.  Uncompressed traces are accepted as well.
+ */
+
+#include <stdio.h>
+#include "prv.h"
+
+#define CHUNK  (256 * 1024)
+
+
+int main (int argc, char **argv)
+{
+        static char chunk[CHUNK];
+        gzFile input;
+        int i, n;
+
+        if (argc < 2)
+        {
+                fprintf(stderr, "Usage: %s TRACE...\n", argv[0]);
+                return 2;
+        }
+
+        for (i = 1;  i < argc;  i++)
+        {
+                input = prv_open(argv[i], NULL);
+                if (input == NULL)
+                {
+                        perror(argv[i]);
+                        return 1;
+                }
+
+                while ((n = gzread(input, chunk, CHUNK)) > 0)
+                {
+                        if (fwrite(chunk, 1, n, stdout) != (size_t) n)
+                        {
+                                perror("write");
+                                return 1;
+                        }
+                }
+                if (n < 0)
+                {
+                        fprintf(stderr, "%s: corrupted trace\n", argv[i]);
+                        return 1;
+                }
+                gzclose(input);
+        }
+
+        return 0;
+}
@@ -0,0 +1,471 @@
+/*
+ * ptt-critpath.c - Critical path and load imbalance of a trace
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+
+/*
+ * The tracing library records when threads are created, joined and wait on
+ * barriers, and the parent of each thread.  From that, this tool rebuilds the
+ * fork and join structure of the program and tells:
+ *
+ *      - The critical path: the chain of thread fragments, linked by the
+ *        synchronizations, that determines when the main thread finishes.
+ *        The time each thread contributes to it is reported, together with
+ *        the time lost in the synchronizations themselves.
+ *
+ *      - The load imbalance of each phase.  A phase is a barrier, or the
+ *        joining of the threads created together by the same parent.  The
+ *        work of each thread in a phase is the time since its previous
+ *        synchronization (or its start) until it reaches the barrier (or
+ *        finishes).  The imbalance is the maximum work over the average.
+ *
+ *      - An estimate of the duration if every phase was perfectly balanced,
+ *        assuming that the time lost in each phase (maximum minus average)
+ *        would be saved.
+ *
+ * Only traces of a single process are supported.  With -s, the fragments of
+ * the critical path are listed too.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prv.h"
+#include "formats.h"
+
+struct wait
+{
+        int kind;         /* One of the PTT_SYNC_* values */
+        int phase;        /* For joins and barriers, or -1 */
+        uint64_t begin;
+        uint64_t end;
+};
+
+struct thread
+{
+        int parent;       /* Counting from one, or zero */
+        int started;
+        uint64_t start;
+        uint64_t end;
+        int sync;         /* Synchronization in progress, if any */
+        uint64_t since;
+        int count;
+        struct wait *waits;
+        uint64_t path;    /* Time on the critical path */
+};
+
+struct phase
+{
+        int kind;         /* PTT_SYNC_JOIN or PTT_SYNC_BARRIER */
+        int parent;       /* For joins */
+        int count;
+        uint64_t time;    /* When the last thread arrived */
+        uint64_t sum;     /* Work of the threads */
+        uint64_t max;
+        int last;         /* Thread which arrived last, and when */
+        uint64_t lastbegin;
+};
+
+static struct thread *Threads;
+static int ThreadCount;
+static struct phase *Phases;
+static int PhaseCount;
+
+
+static void usage (const char *program)
+{
+        fprintf(stderr, "Usage: %s [-s] TRACE\n", program);
+        exit(2);
+}
+
+
+static void *grow (void *array, int count, int step, size_t size)
+{
+        if (count % step == 0)
+        {
+                array = realloc(array, (count + step) * size);
+                if (array == NULL)
+                {
+                        perror("realloc");
+                        exit(1);
+                }
+        }
+        return array;
+}
+
+
+static int new_phase (int kind, int parent)
+{
+        struct phase *p;
+
+        Phases = grow(Phases, PhaseCount, 64, sizeof(struct phase));
+        p = &Phases[PhaseCount];
+        memset(p, 0, sizeof(struct phase));
+        p->kind = kind;
+        p->parent = parent;
+        return PhaseCount++;
+}
+
+
+static void add_work (int phase, int thread, uint64_t work, uint64_t arrival)
+{
+        struct phase *p = &Phases[phase];
+
+        p->count++;
+        p->sum += work;
+        if (work > p->max)
+                p->max = work;
+        if (p->count == 1 || arrival > p->lastbegin)
+        {
+                p->last = thread;
+                p->lastbegin = arrival;
+        }
+        if (arrival > p->time)
+                p->time = arrival;
+}
+
+
+/*
+ * Time of the last synchronization of a thread which ended before "time", or
+ * the thread start.  Creations do not count, they are part of the work.
+ */
+static uint64_t last_sync (struct thread *th, uint64_t time)
+{
+        uint64_t t = th->start;
+        int i;
+
+        for (i = 0;  i < th->count && th->waits[i].end <= time;  i++)
+                if (th->waits[i].kind != PTT_SYNC_CREATE)
+                        t = th->waits[i].end;
+        return t;
+}
+
+
+static void read_trace (const char *trace)
+{
+        struct prv_header header;
+        struct prv_record rec;
+        struct thread *th;
+        struct wait *w;
+        char line[PRV_LINE];
+        gzFile input;
+        int t;
+
+        input = prv_open(trace, NULL);
+        if (input == NULL || prv_header(input, &header) != 0)
+        {
+                fprintf(stderr, "%s: not a valid trace\n", trace);
+                exit(1);
+        }
+        if (header.tasks > 1)
+        {
+                fprintf(stderr, "%s: multi-process traces are not supported\n",
+                        trace);
+                exit(1);
+        }
+
+        ThreadCount = header.threads;
+        Threads = calloc(ThreadCount + 1, sizeof(struct thread));
+        for (t = 1;  t <= ThreadCount;  t++)
+                Threads[t].end = header.duration;
+
+        while (prv_next(input, line, &rec) == 0)
+        {
+                if (rec.kind != 2 || rec.thread < 1 || rec.thread > ThreadCount)
+                        continue;
+                th = &Threads[rec.thread];
+                if (!th->started)
+                {
+                        th->started = 1;
+                        th->start = rec.time;
+                }
+
+                if (rec.type == PTT_PHASE_EVENT && rec.value == 0)
+                        th->end = rec.time;
+                else if (rec.type == PTT_PARENT_EVENT)
+                        th->parent = rec.value;
+                else if (rec.type == PTT_SYNC_EVENT &&
+                         rec.value != PTT_SYNC_END)
+                {
+                        th->sync = rec.value;
+                        th->since = rec.time;
+                }
+                else if (rec.type == PTT_SYNC_EVENT && th->sync != PTT_SYNC_END)
+                {
+                        th->waits = grow(th->waits, th->count, 16,
+                                         sizeof(struct wait));
+                        w = &th->waits[th->count++];
+                        w->kind = th->sync;
+                        w->phase = -1;
+                        w->begin = th->since;
+                        w->end = rec.time;
+                        th->sync = PTT_SYNC_END;
+                }
+        }
+        gzclose(input);
+        free(header.taskthreads);
+}
+
+
+struct barrier
+{
+        int thread;
+        struct wait *wait;
+};
+
+static int barrier_compare (const void *a, const void *b)
+{
+        const struct barrier *ba = a, *bb = b;
+
+        return ba->wait->begin < bb->wait->begin ? -1 :
+               ba->wait->begin > bb->wait->begin;
+}
+
+
+/*
+ * Group the barrier waits of all the threads into phases.  Everybody leaves a
+ * barrier after the last thread arrives, so a wait belongs to the current
+ * phase if it started before any thread of the phase was released.
+ */
+static void barrier_phases (void)
+{
+        struct barrier *b = NULL;
+        struct thread *th;
+        uint64_t release = 0;
+        int *member, n = 0, t, i, p = -1;
+
+        for (t = 1;  t <= ThreadCount;  t++)
+                for (i = 0;  i < Threads[t].count;  i++)
+                {
+                        if (Threads[t].waits[i].kind != PTT_SYNC_BARRIER)
+                                continue;
+                        b = grow(b, n, 256, sizeof(struct barrier));
+                        b[n].thread = t;
+                        b[n].wait = &Threads[t].waits[i];
+                        n++;
+                }
+        qsort(b, n, sizeof(struct barrier), barrier_compare);
+
+        member = calloc(ThreadCount + 1, sizeof(int));
+        for (i = 0;  i < n;  i++)
+        {
+                if (p == -1 || b[i].wait->begin > release ||
+                    member[b[i].thread] == p + 1)
+                {
+                        p = new_phase(PTT_SYNC_BARRIER, 0);
+                        release = b[i].wait->end;
+                }
+                if (b[i].wait->end < release)
+                        release = b[i].wait->end;
+                member[b[i].thread] = p + 1;
+                b[i].wait->phase = p;
+                th = &Threads[b[i].thread];
+                add_work(p, b[i].thread, b[i].wait->begin -
+                         last_sync(th, b[i].wait->begin), b[i].wait->begin);
+        }
+        free(member);
+        free(b);
+}
+
+
+/*
+ * Each run of joins after some creations makes a phase, with the last work
+ * of every child joined in it.
+ */
+static void join_phases (void)
+{
+        struct thread *th, *parent;
+        int t, i, p = -1, created;
+
+        for (t = 1;  t <= ThreadCount;  t++)
+        {
+                th = &Threads[t];
+                created = 1;
+                for (i = 0;  i < th->count;  i++)
+                {
+                        if (th->waits[i].kind == PTT_SYNC_CREATE)
+                                created = 1;
+                        else if (th->waits[i].kind == PTT_SYNC_JOIN)
+                        {
+                                if (created)
+                                        p = new_phase(PTT_SYNC_JOIN, t);
+                                th->waits[i].phase = p;
+                                created = 0;
+                        }
+                }
+        }
+
+        for (t = 1;  t <= ThreadCount;  t++)
+        {
+                th = &Threads[t];
+                if (th->parent < 1 || th->parent > ThreadCount)
+                        continue;
+                parent = &Threads[th->parent];
+                for (i = 0;  i < parent->count;  i++)
+                        if (parent->waits[i].kind == PTT_SYNC_JOIN &&
+                            parent->waits[i].end >= th->end)
+                                break;
+                if (i < parent->count)
+                        add_work(parent->waits[i].phase, t,
+                                 th->end - last_sync(th, th->end), th->end);
+        }
+}
+
+
+/*
+ * Walk the critical path backwards from the end of the main thread.  Return
+ * the time spent in synchronizations which did not wait for another thread.
+ */
+static uint64_t critical_path (int segments)
+{
+        struct thread *th;
+        struct wait *w;
+        uint64_t time, sync = 0, e;
+        int t = 1, c, i, steps = 0, limit;
+
+        limit = ThreadCount + 1;
+        for (c = 1;  c <= ThreadCount;  c++)
+                limit += 2 * Threads[c].count;
+
+        time = Threads[t].end;
+        while (t != 0 && steps++ < limit)
+        {
+                th = &Threads[t];
+                w = NULL;
+                for (i = th->count - 1;  i >= 0;  i--)
+                {
+                        if (th->waits[i].kind != PTT_SYNC_CREATE &&
+                            th->waits[i].end <= time &&
+                            th->waits[i].begin < time)
+                        {
+                                w = &th->waits[i];
+                                break;
+                        }
+                }
+
+                e = w != NULL ? w->end : th->start;
+                th->path += time - e;
+                if (segments)
+                        printf("%-8d %12.3f %12.3f\n", t, e / 1e6, time / 1e6);
+                if (w == NULL)
+                {
+                        /* Back to the parent, when it was creating us */
+                        time = th->start;
+                        t = th->parent;
+                        continue;
+                }
+
+                /* Go for the thread we have been waiting for, if any */
+                c = 0;
+                if (w->kind == PTT_SYNC_BARRIER)
+                        c = Phases[w->phase].last;
+                else
+                        for (i = 1;  i <= ThreadCount;  i++)
+                                if (Threads[i].parent == t &&
+                                    Threads[i].end >= w->begin &&
+                                    Threads[i].end <= w->end &&
+                                    (c == 0 || Threads[i].end > Threads[c].end))
+                                        c = i;
+
+                if (c == 0 || c == t)
+                {
+                        sync += w->end - w->begin;
+                        time = w->begin;
+                }
+                else
+                {
+                        time = w->kind == PTT_SYNC_BARRIER ?
+                               Phases[w->phase].lastbegin : Threads[c].end;
+                        sync += w->end - time;
+                        t = c;
+                }
+        }
+        return sync;
+}
+
+
+static int phase_compare (const void *a, const void *b)
+{
+        const struct phase *pa = a, *pb = b;
+
+        return pa->time < pb->time ? -1 : pa->time > pb->time;
+}
+
+
+int main (int argc, char **argv)
+{
+        struct phase *p;
+        uint64_t duration, sync, lost = 0;
+        double average;
+        char name[32];
+        int segments = 0, opt, t, i;
+
+        while ((opt = getopt(argc, argv, "s")) != -1)
+        {
+                if (opt == 's')
+                        segments = 1;
+                else
+                        usage(argv[0]);
+        }
+        if (argc - optind != 1)
+                usage(argv[0]);
+
+        read_trace(argv[optind]);
+        if (ThreadCount < 1)
+        {
+                fprintf(stderr, "%s: no threads\n", argv[optind]);
+                return 1;
+        }
+        barrier_phases();
+        join_phases();
+
+        if (segments)
+                printf("Critical path, from the end\n%-8s %12s %12s\n",
+                       "Thread", "From ms", "To ms");
+        sync = critical_path(segments);
+        duration = Threads[1].end - Threads[1].start;
+
+        printf("%sCritical path: %.3f ms\n%-16s %12s %8s\n",
+               segments ? "\n" : "", duration / 1e6, "Thread", "Time ms",
+               "Share");
+        for (t = 1;  t <= ThreadCount;  t++)
+        {
+                if (Threads[t].path == 0)
+                        continue;
+                printf("%-16d %12.3f %7.2f%%\n", t, Threads[t].path / 1e6,
+                       100.0 * Threads[t].path / duration);
+        }
+        printf("%-16s %12.3f %7.2f%%\n", "Synchronization", sync / 1e6,
+               100.0 * sync / duration);
+
+        qsort(Phases, PhaseCount, sizeof(struct phase), phase_compare);
+        printf("\nLoad balance\n%-16s %12s %8s %10s %10s %10s %10s\n", "Phase",
+               "At ms", "Threads", "Avg ms", "Max ms", "Max/avg", "Lost ms");
+        for (i = 0;  i < PhaseCount;  i++)
+        {
+                p = &Phases[i];
+                if (p->count == 0)
+                        continue;
+                if (p->kind == PTT_SYNC_BARRIER)
+                        snprintf(name, sizeof(name), "Barrier");
+                else
+                        snprintf(name, sizeof(name), "Join by %d", p->parent);
+                average = (double) p->sum / p->count;
+                lost += p->max - (uint64_t) average;
+                printf("%-16s %12.3f %8d %10.3f %10.3f %10.2f %10.3f\n", name,
+                       p->time / 1e6, p->count, average / 1e6, p->max / 1e6,
+                       average > 0 ? p->max / average : 1.0,
+                       (p->max - average) / 1e6);
+        }
+        if (lost > duration)
+                lost = duration;
+        printf("\nBalanced estimate: %.3f ms (%.2fx speedup)\n",
+               (duration - lost) / 1e6,
+               duration > lost ? (double) duration / (duration - lost) : 1.0);
+        return 0;
+}
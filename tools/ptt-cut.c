@@ -0,0 +1,276 @@
+/*
+ * ptt-cut.c - Extract a time window and a subset of threads from a trace
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+
+/*
+ * The time index written by the post processor (".idx" file) tells where the
+ * records of any time bucket start in the .prv file.  So cutting a window only
+ * needs to parse the records inside that window, no matter how large the whole
+ * trace is.  The exception are the states still open when the window begins,
+ * which may have been written anywhere before, so the lines up to there are
+ * still read looking for them.  Traces without index are scanned from the
+ * beginning.
+ *
+ * The result is a new, self contained, trace with the times shifted so that
+ * the window starts at zero and the selected threads renumbered consecutively.
+ *
+ * Note that seeking in a compressed trace implies decompressing everything up
+ * to the seek point, so the index only pays off with uncompressed traces.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prv.h"
+#include "formats.h"
+
+
+static void usage (const char *program)
+{
+        fprintf(stderr, "Usage: %s [-t THREADS] TRACE BEGIN END OUTPUT\n\n"
+                        "  THREADS is a list like \"1,3-5\".  BEGIN and END accept "
+                        "the ns, us, ms and s\n  suffixes.  OUTPUT is the prefix "
+                        "of the new trace files.\n", program);
+        exit(2);
+}
+
+
+/*
+ * Look up the offset where the records of time "begin" start.
+ */
+static uint64_t seek_offset (const char *prefix, uint64_t begin)
+{
+        struct ptt_indexheader header;
+        char filename[256];
+        uint64_t offset, k;
+        FILE *input;
+
+        snprintf(filename, 255, "%s.idx", prefix);
+        input = fopen(filename, "r");
+        if (input == NULL)
+        {
+                fprintf(stderr, "%s: no index, scanning the whole trace\n", prefix);
+                return 0;
+        }
+        if (fread(&header, sizeof(header), 1, input) != 1 ||
+            memcmp(header.magic, PTT_INDEX_MAGIC, 8) != 0 ||
+            header.bucket == 0 || header.count == 0)
+        {
+                fprintf(stderr, "%s: invalid index, ignored\n", filename);
+                fclose(input);
+                return 0;
+        }
+
+        k = begin / header.bucket;
+        if (k >= header.count)
+                k = header.count - 1;
+        fseek(input, sizeof(header) + k * sizeof(uint64_t), SEEK_SET);
+        if (fread(&offset, sizeof(offset), 1, input) != 1)
+                offset = 0;
+        fclose(input);
+        return offset;
+}
+
+
+/*
+ * Parse a thread list into a map from old to new thread numbers (starting at
+ * one, zero means discarded).  Return the amount of selected threads.
+ */
+static int parse_threads (const char *list, int *map, int threads)
+{
+        const char *p = list;
+        char *q;
+        int a, b, i, n = 0;
+
+        while (*p != '\0')
+        {
+                a = strtol(p, &q, 10);
+                b = *q == '-' ? strtol(q + 1, &q, 10) : a;
+                for (i = a;  i <= b;  i++)
+                        if (i >= 1 && i <= threads)
+                                map[i] = 1;
+                if (*q == ',')
+                        q++;
+                else if (*q != '\0')
+                        return -1;
+                p = q;
+        }
+
+        for (i = 1;  i <= threads;  i++)
+                if (map[i])
+                        map[i] = ++n;
+        return n;
+}
+
+
+/*
+ * Write a record of the selected threads, renumbered and with its times
+ * relative to the window.  States crossing the window boundaries are clipped,
+ * communications crossing them are dropped.
+ */
+static void cut_record (FILE *output, struct prv_record *rec, int *map,
+                        int threads, uint64_t begin, uint64_t end)
+{
+        /* Records of threads the trace does not have are skipped */
+        if (rec->thread < 1 || rec->thread > threads || !map[rec->thread])
+                return;
+        if (rec->kind == 3 &&
+            (rec->peer < 1 || rec->peer > threads || !map[rec->peer] ||
+             rec->time < begin || rec->end > end))
+                return;
+        if (rec->kind == 3)
+                rec->peer = map[rec->peer];
+        rec->thread = map[rec->thread];
+        rec->time = rec->time < begin ? 0 : rec->time - begin;
+        rec->end = rec->end > end ? end - begin : rec->end - begin;
+        prv_write(output, rec);
+}
+
+
+static void copy_file (const char *from, const char *to)
+{
+        char chunk[4096];
+        FILE *input, *output;
+        size_t n;
+
+        input = fopen(from, "r");
+        if (input == NULL)
+                return;
+        output = fopen(to, "w");
+        if (output == NULL)
+        {
+                perror(to);
+                exit(1);
+        }
+        while ((n = fread(chunk, 1, sizeof(chunk), input)) > 0)
+                fwrite(chunk, 1, n, output);
+        fclose(input);
+        fclose(output);
+}
+
+
+int main (int argc, char **argv)
+{
+        struct prv_header header;
+        struct prv_record rec;
+        char prefix[256], filename[256], line[PRV_LINE];
+        char *threadlist = NULL, **rows;
+        uint64_t begin, end, offset;
+        gzFile input;
+        FILE *output;
+        int *map;
+        int i, n, opt;
+
+        while ((opt = getopt(argc, argv, "t:")) != -1)
+        {
+                if (opt == 't')
+                        threadlist = optarg;
+                else
+                        usage(argv[0]);
+        }
+        if (argc - optind != 4)
+                usage(argv[0]);
+
+        input = prv_open(argv[optind], prefix);
+        if (input == NULL || prv_header(input, &header) != 0)
+        {
+                fprintf(stderr, "%s: not a valid trace\n", argv[optind]);
+                return 1;
+        }
+        if (header.tasks > 1)
+        {
+                fprintf(stderr, "%s: multi-process traces are not supported\n",
+                        argv[optind]);
+                return 1;
+        }
+        begin = prv_time(argv[optind + 1]);
+        end = prv_time(argv[optind + 2]);
+        if (end > header.duration)
+                end = header.duration;
+        if (begin >= end)
+        {
+                fprintf(stderr, "Empty time window\n");
+                return 1;
+        }
+
+        map = calloc(header.threads + 1, sizeof(int));
+        if (threadlist == NULL)
+        {
+                for (i = 1;  i <= header.threads;  i++)
+                        map[i] = i;
+                n = header.threads;
+        }
+        else
+                n = parse_threads(threadlist, map, header.threads);
+        if (n <= 0)
+        {
+                fprintf(stderr, "Invalid thread selection\n");
+                return 1;
+        }
+
+        snprintf(filename, 255, "%s.prv", argv[optind + 3]);
+        output = fopen(filename, "w");
+        if (output == NULL)
+        {
+                perror(filename);
+                return 1;
+        }
+        fprintf(output, "#Paraver (%s):%llu_ns:0:1:1(%d:0)\n", header.date,
+                (unsigned long long) (end - begin), n);
+
+        /*
+         * Records are written in time order, i.e. the begin time of states
+         * and the send time of communications.  So the states open at BEGIN
+         * may be anywhere before the indexed position, where only states are
+         * looked for.  They all start the new trace, at time zero.
+         */
+        offset = seek_offset(prefix, begin);
+        while (gztell(input) < offset && gzgets(input, line, PRV_LINE) != NULL)
+                if (line[0] == '1' && prv_parse(line, &rec) == 0 &&
+                    rec.end > begin)
+                        cut_record(output, &rec, map, header.threads, begin,
+                                   end);
+        gzseek(input, offset, SEEK_SET);
+
+        while (prv_next(input, line, &rec) == 0)
+        {
+                if (rec.time > end)
+                        break;
+                if (rec.end < begin)
+                        continue;
+                cut_record(output, &rec, map, header.threads, begin, end);
+        }
+        gzclose(input);
+        fclose(output);
+
+        /* The event definitions do not change */
+        snprintf(filename, 255, "%s.pcf", argv[optind + 3]);
+        snprintf(line, PRV_LINE, "%s.pcf", prefix);
+        copy_file(line, filename);
+
+        /* But the thread names need to follow the selection */
+        i = header.threads;
+        rows = prv_rows(prefix, "THREAD", &i);
+        snprintf(filename, 255, "%s.row", argv[optind + 3]);
+        output = fopen(filename, "w");
+        if (output == NULL)
+        {
+                perror(filename);
+                return 1;
+        }
+        fprintf(output, "LEVEL TASK            SIZE 1\n"
+                        "Main process\n"
+                        "LEVEL THREAD            SIZE %d\n", n);
+        for (i = 1;  i <= header.threads;  i++)
+                if (map[i])
+                        fprintf(output, "%s\n", rows[i - 1]);
+        fclose(output);
+
+        return 0;
+}
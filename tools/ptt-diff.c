@@ -0,0 +1,338 @@
+/*
+ * ptt-diff.c - Compare two traces of the same program
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+
+/*
+ * Given a base trace and a new trace of the same program, this tool reports
+ * what changed between both runs:
+ *
+ *      - The run duration.
+ *
+ *      - For each thread, the share of the run spent in each state.
+ *
+ *      - For each event type, the amount of events per second.
+ *
+ *      - The phases whose time grew the most.  A phase is a non zero value of
+ *        a user event type (below 69000000, or only the one given with -p),
+ *        which holds from its event until the next event of the same type in
+ *        the same thread.  The time of every thread is added together.
+ *
+ * Runs of different length are compared by normalizing with the duration of
+ * each run, except for the phase regressions, whose extra time is given as a
+ * percentage of the base run duration.  That way a phase which is always short
+ * never dominates the report because of noise.
+ *
+ * Threads are matched by their position in the trace.  Like diff(1), the exit
+ * status is zero when no regression is found, one when the duration or the
+ * time of a phase grew more than the threshold (5% by default) and two if
+ * there was any trouble.  So benchmark scripts can just do:
+ *
+ *      ptt-diff -t 3 base/ptt-trace-001 ptt-trace-001 || echo "Slower"
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prv.h"
+
+#define USER_TYPES  69000000  /* Event types of the tracing library from here */
+
+enum
+{
+        STATE = 1,   /* Time per thread and state */
+        RATE,        /* Events per type */
+        PHASE,       /* Time per phase */
+        OPEN         /* Current phase of a thread, while reading a trace */
+};
+
+struct entry
+{
+        int kind;         /* Zero for unused slots */
+        int task;
+        int thread;
+        int64_t key;      /* State, or event type */
+        int64_t value;    /* Phase value */
+        uint64_t sum[2];  /* Time or events, for the base and the new trace */
+};
+
+static struct entry *Table;
+static size_t TableSize, TableUsed;
+
+
+static void usage (const char *program)
+{
+        fprintf(stderr, "Usage: %s [-t PERCENT] [-n COUNT] [-p TYPE] BASE NEW\n\n"
+                        "  PERCENT is the regression threshold (5 by default).  "
+                        "COUNT is the amount\n  of phases to report (10 by "
+                        "default).\n", program);
+        exit(2);
+}
+
+
+/*
+ * Find an entry, creating it if needed.  The table is an open addressing hash,
+ * doubled when half full.
+ */
+static struct entry *entry (int kind, int task, int thread, int64_t key,
+                            int64_t value)
+{
+        struct entry *old, *e;
+        size_t h, i, n;
+
+        if (2 * (TableUsed + 1) > TableSize)
+        {
+                old = Table;
+                n = TableSize;
+                TableSize = n > 0 ? 2 * n : 1024;
+                Table = calloc(TableSize, sizeof(struct entry));
+                if (Table == NULL)
+                {
+                        perror("calloc");
+                        exit(2);
+                }
+                TableUsed = 0;
+                for (i = 0;  i < n;  i++)
+                {
+                        if (old[i].kind == 0)
+                                continue;
+                        e = entry(old[i].kind, old[i].task, old[i].thread,
+                                  old[i].key, old[i].value);
+                        *e = old[i];
+                }
+                free(old);
+        }
+
+        h = ((size_t) kind * 31 + task) * 2654435761u;
+        h = (h ^ (size_t) thread * 40503u ^ (size_t) key * 2246822519u ^
+             (size_t) value * 3266489917u) & (TableSize - 1);
+        while (Table[h].kind != 0 &&
+               (Table[h].kind != kind || Table[h].task != task ||
+                Table[h].thread != thread || Table[h].key != key ||
+                Table[h].value != value))
+                h = (h + 1) & (TableSize - 1);
+        if (Table[h].kind == 0)
+        {
+                Table[h].kind = kind;
+                Table[h].task = task;
+                Table[h].thread = thread;
+                Table[h].key = key;
+                Table[h].value = value;
+                TableUsed++;
+        }
+        return &Table[h];
+}
+
+
+/*
+ * Order by kind, then by thread and key, except for the phases, which go from
+ * the largest to the smallest growth.
+ */
+static int entry_compare (const void *a, const void *b)
+{
+        const struct entry *ea = a, *eb = b;
+        int64_t da, db;
+
+        if (ea->kind != eb->kind)
+                return ea->kind < eb->kind ? -1 : 1;
+        if (ea->kind == PHASE)
+        {
+                da = ea->sum[1] - ea->sum[0];
+                db = eb->sum[1] - eb->sum[0];
+                if (da != db)
+                        return da > db ? -1 : 1;
+        }
+        if (ea->task != eb->task)
+                return ea->task < eb->task ? -1 : 1;
+        if (ea->thread != eb->thread)
+                return ea->thread < eb->thread ? -1 : 1;
+        if (ea->key != eb->key)
+                return ea->key < eb->key ? -1 : 1;
+        return ea->value < eb->value ? -1 : ea->value > eb->value;
+}
+
+
+/*
+ * Close the phase a thread is in, if any.  Zero values mean no phase.  The
+ * table may grow, so "open" is not valid anymore afterwards.
+ */
+static void close_phase (struct entry *open, int which, uint64_t time)
+{
+        uint64_t start = open->sum[0], value = open->sum[1];
+        int64_t key = open->key;
+
+        if (value != 0 && time > start)
+                entry(PHASE, 0, 0, key, value)->sum[which] += time - start;
+}
+
+
+/*
+ * Read a trace, adding its statistics to the table.  Return the duration, or
+ * zero if the trace cannot be read.
+ */
+static uint64_t read_trace (const char *trace, int which, int64_t phasetype)
+{
+        struct prv_header header;
+        struct prv_record rec;
+        struct entry *open;
+        char line[PRV_LINE];
+        gzFile input;
+        size_t i, n;
+
+        input = prv_open(trace, NULL);
+        if (input == NULL || prv_header(input, &header) != 0)
+        {
+                if (input != NULL)
+                        gzclose(input);
+                fprintf(stderr, "%s: not a valid trace\n", trace);
+                return 0;
+        }
+
+        while (prv_next(input, line, &rec) == 0)
+        {
+                if (rec.kind == 1)
+                {
+                        entry(STATE, rec.task, rec.thread, rec.value,
+                              0)->sum[which] += rec.end - rec.time;
+                }
+                else if (rec.kind == 2)
+                {
+                        entry(RATE, 0, 0, rec.type, 0)->sum[which]++;
+                        if (phasetype >= 0 ? rec.type != phasetype :
+                                             rec.type >= USER_TYPES)
+                                continue;
+                        /* The phase start and value are kept in "sum" */
+                        open = entry(OPEN + which, rec.task, rec.thread,
+                                     rec.type, 0);
+                        close_phase(open, which, rec.time);
+                        open = entry(OPEN + which, rec.task, rec.thread,
+                                     rec.type, 0);
+                        open->sum[0] = rec.time;
+                        open->sum[1] = rec.value;
+                }
+        }
+        gzclose(input);
+
+        /* Close the phases still open at the end, which may grow the table */
+        for (i = 0, n = 0;  i < TableSize;  i++)
+                n += Table[i].kind == OPEN + which;
+        open = malloc((n + 1) * sizeof(struct entry));
+        for (i = 0, n = 0;  i < TableSize;  i++)
+                if (Table[i].kind == OPEN + which)
+                        open[n++] = Table[i];
+        for (i = 0;  i < n;  i++)
+                close_phase(&open[i], which, header.duration);
+        free(open);
+        free(header.taskthreads);
+        return header.duration;
+}
+
+
+static double percent (uint64_t part, uint64_t whole)
+{
+        return whole > 0 ? 100.0 * part / whole : 0.0;
+}
+
+
+int main (int argc, char **argv)
+{
+        struct entry *e;
+        uint64_t duration[2];
+        int64_t phasetype = -1;
+        double threshold = 5.0, growth, rate[2];
+        char thread[32];
+        size_t i, n;
+        int count = 10, shown = 0, regression = 0, opt;
+
+        while ((opt = getopt(argc, argv, "t:n:p:")) != -1)
+        {
+                switch (opt)
+                {
+                case 't':
+                        threshold = atof(optarg);
+                        break;
+                case 'n':
+                        count = atoi(optarg);
+                        break;
+                case 'p':
+                        phasetype = atoll(optarg);
+                        break;
+                default:
+                        usage(argv[0]);
+                }
+        }
+        if (argc - optind != 2)
+                usage(argv[0]);
+
+        duration[0] = read_trace(argv[optind], 0, phasetype);
+        if (duration[0] == 0)
+                return 2;
+        duration[1] = read_trace(argv[optind + 1], 1, phasetype);
+        if (duration[1] == 0)
+                return 2;
+
+        /* Drop the current phases and sort the rest */
+        for (i = 0, n = 0;  i < TableSize;  i++)
+                if (Table[i].kind != 0 && Table[i].kind < OPEN)
+                        Table[n++] = Table[i];
+        qsort(Table, n, sizeof(struct entry), entry_compare);
+
+        growth = 100.0 * ((double) duration[1] - duration[0]) / duration[0];
+        if (growth > threshold)
+                regression = 1;
+        printf("Duration: %.3f ms -> %.3f ms (%+.2f%%)\n", duration[0] / 1e6,
+               duration[1] / 1e6, growth);
+
+        printf("\nState time (%% of the run)\n%-10s %10s %10s %10s %10s\n",
+               "Thread", "State", "Base", "New", "Delta");
+        for (e = Table;  e < Table + n && e->kind == STATE;  e++)
+        {
+                snprintf(thread, sizeof(thread), "%d.%d", e->task, e->thread);
+                printf("%-10s %10lld %9.2f%% %9.2f%% %+10.2f\n", thread,
+                       (long long) e->key, percent(e->sum[0], duration[0]),
+                       percent(e->sum[1], duration[1]),
+                       percent(e->sum[1], duration[1]) -
+                       percent(e->sum[0], duration[0]));
+        }
+
+        printf("\nEvent rate (events per second)\n%-10s %10s %10s %10s\n",
+               "Type", "Base", "New", "Delta");
+        for (;  e < Table + n && e->kind == RATE;  e++)
+        {
+                rate[0] = e->sum[0] * 1e9 / duration[0];
+                rate[1] = e->sum[1] * 1e9 / duration[1];
+                printf("%-10lld %10.1f %10.1f ", (long long) e->key, rate[0],
+                       rate[1]);
+                if (rate[0] > 0)
+                        printf("%+9.2f%%\n", 100.0 * (rate[1] - rate[0]) / rate[0]);
+                else
+                        printf("%10s\n", "new");
+        }
+
+        printf("\nPhase regressions (extra time, %% of the base run)\n"
+               "%-10s %10s %10s %10s %10s\n", "Type", "Value", "Base ms",
+               "New ms", "Delta");
+        for (;  e < Table + n && e->kind == PHASE;  e++)
+        {
+                if (e->sum[1] <= e->sum[0])
+                        break;
+                growth = percent(e->sum[1] - e->sum[0], duration[0]);
+                if (growth > threshold)
+                        regression = 1;
+                if (shown++ < count)
+                        printf("%-10lld %10lld %10.3f %10.3f %+10.2f\n",
+                               (long long) e->key, (long long) e->value,
+                               e->sum[0] / 1e6, e->sum[1] / 1e6, growth);
+        }
+        if (shown == 0)
+                printf("None\n");
+
+        if (regression)
+                printf("\nRegression over %.2f%% found\n", threshold);
+        return regression;
+}
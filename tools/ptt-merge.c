@@ -0,0 +1,266 @@
+/*
+ * ptt-merge.c - Combine the traces of several processes into a single one
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+
+/*
+ * Forked children produce traces of their own, named after the parent's one
+ * plus their process identifier (e.g. "ptt-trace-001" and
+ * "ptt-trace-4711-001").  Since children inherit the start of the trace from
+ * their parent, all these traces share the same time origin and merging them
+ * is a matter of interleaving their records.
+ *
+ * Each input process becomes a Paraver task of the combined trace (inputs
+ * which already contain several tasks keep them all).  Event definitions are
+ * taken from the first input, assuming all the processes run the same program.
+ *
+ * With "-f chrome", the combined trace is written in the Chrome trace event
+ * format instead (see "chrome.c" in the tracing library), as a single .json
+ * file.  A single input can be given just to convert it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prv.h"
+#include "chrome.h"
+
+
+struct input
+{
+        gzFile file;
+        struct prv_header header;
+        char prefix[256];
+        int taskbase;     /* Tasks of the previous inputs */
+        int valid;        /* Whether "rec" holds a record */
+        struct prv_record rec;
+};
+
+
+/*
+ * Read a whole file into a string, for the PCF contents.
+ */
+static char *read_file (const char *filename)
+{
+        char *contents = NULL;
+        size_t size = 0, n;
+        FILE *input;
+
+        input = fopen(filename, "r");
+        if (input == NULL)
+                return NULL;
+        do
+        {
+                contents = realloc(contents, size + PRV_LINE + 1);
+                n = fread(contents + size, 1, PRV_LINE, input);
+                size += n;
+        }
+        while (n > 0);
+        contents[size] = '\0';
+        fclose(input);
+        return contents;
+}
+
+
+static void chrome_record (struct ptt_chrome *c, struct prv_record *rec)
+{
+        switch (rec->kind)
+        {
+        case 1:
+                ptt_chromestate(c, rec->task, rec->thread, rec->time, rec->end,
+                                rec->value);
+                break;
+        case 2:
+                ptt_chromeevent(c, rec->task, rec->thread, rec->time, rec->type,
+                                rec->value, NULL);
+                break;
+        case 3:
+                ptt_chromecomm(c, rec->task, rec->thread, rec->time,
+                               rec->peertask, rec->peer, rec->end, rec->type,
+                               rec->value);
+                break;
+        }
+}
+
+
+static void next_record (struct input *in)
+{
+        char line[PRV_LINE];
+
+        in->valid = prv_next(in->file, line, &in->rec) == 0;
+        if (in->valid)
+        {
+                in->rec.task += in->taskbase;
+                if (in->rec.kind == 3)
+                        in->rec.peertask += in->taskbase;
+        }
+}
+
+
+int main (int argc, char **argv)
+{
+        struct input *in;
+        struct ptt_chrome *chrome = NULL;
+        char filename[256], line[PRV_LINE];
+        char **rows, **tasknames, *contents;
+        uint64_t duration = 0;
+        FILE *output, *pcf;
+        const char *program = argv[0];
+        int count, tasks, threads, json = 0;
+        int i, j, s, t, n;
+
+        if (argc > 2 && strcmp(argv[1], "-f") == 0)
+        {
+                json = strcmp(argv[2], "chrome") == 0;
+                if (!json && strcmp(argv[2], "paraver") != 0)
+                        argc = 0;
+                argc -= 2;
+                argv += 2;
+        }
+        if (argc < 3)
+        {
+                fprintf(stderr, "Usage: %s [-f paraver|chrome] OUTPUT TRACE...\n",
+                        program);
+                return 2;
+        }
+
+        count = argc - 2;
+        in = calloc(count, sizeof(struct input));
+        tasks = threads = 0;
+        for (i = 0;  i < count;  i++)
+        {
+                in[i].file = prv_open(argv[i + 2], in[i].prefix);
+                if (in[i].file == NULL || prv_header(in[i].file, &in[i].header) != 0)
+                {
+                        fprintf(stderr, "%s: not a valid trace\n", argv[i + 2]);
+                        return 1;
+                }
+                in[i].taskbase = tasks;
+                tasks += in[i].header.tasks;
+                threads += in[i].header.threads;
+                if (in[i].header.duration > duration)
+                        duration = in[i].header.duration;
+                next_record(&in[i]);
+        }
+
+        snprintf(filename, 255, json ? "%s.json" : "%s.prv", argv[1]);
+        output = fopen(filename, "w");
+        if (output == NULL)
+        {
+                perror(filename);
+                return 1;
+        }
+        if (json)
+        {
+                /* The names come from the files of the first input */
+                snprintf(line, PRV_LINE, "%s.pcf", in[0].prefix);
+                contents = read_file(line);
+                chrome = ptt_chromeopen(output, contents);
+                free(contents);
+                for (i = 0;  i < count;  i++)
+                {
+                        n = in[i].header.tasks;
+                        tasknames = prv_rows(in[i].prefix, "TASK", &n);
+                        n = in[i].header.threads;
+                        rows = prv_rows(in[i].prefix, "THREAD", &n);
+                        for (j = 0, n = 0;  j < in[i].header.tasks;  j++)
+                        {
+                                s = in[i].taskbase + j + 1;
+                                ptt_chromeprocess(chrome, s, tasknames[j]);
+                                for (t = 0;  t < in[i].header.taskthreads[j];
+                                     t++, n++)
+                                        ptt_chromethread(chrome, s, t + 1,
+                                                         rows[n]);
+                        }
+                }
+        }
+        else
+        {
+                fprintf(output, "#Paraver (%s):%llu_ns:0:1:%d(",
+                        in[0].header.date, (unsigned long long) duration, tasks);
+                for (i = 0, n = 0;  i < count;  i++)
+                        for (j = 0;  j < in[i].header.tasks;  j++, n++)
+                                fprintf(output, "%s%d:0", n > 0 ? "," : "",
+                                        in[i].header.taskthreads[j]);
+                fprintf(output, ")\n");
+        }
+
+        /*
+         * Records are written in the order in which the post processor wrote
+         * them, which is by begin time for states and send time for
+         * communications.  The amount of processes is usually small, so a
+         * linear search is enough.
+         */
+        for (;;)
+        {
+                s = -1;
+                for (i = 0;  i < count;  i++)
+                        if (in[i].valid &&
+                            (s == -1 || in[i].rec.time < in[s].rec.time))
+                                s = i;
+                if (s == -1)
+                        break;
+                if (json)
+                        chrome_record(chrome, &in[s].rec);
+                else
+                        prv_write(output, &in[s].rec);
+                next_record(&in[s]);
+        }
+        if (json)
+        {
+                /* Everything is in there */
+                ptt_chromeclose(chrome);
+                fclose(output);
+                return 0;
+        }
+        fclose(output);
+
+        snprintf(filename, 255, "%s.pcf", argv[1]);
+        output = fopen(filename, "w");
+        snprintf(line, PRV_LINE, "%s.pcf", in[0].prefix);
+        pcf = fopen(line, "r");
+        if (output == NULL || pcf == NULL)
+        {
+                perror(output == NULL ? filename : line);
+                return 1;
+        }
+        while ((n = fread(line, 1, PRV_LINE, pcf)) > 0)
+                fwrite(line, 1, n, output);
+        fclose(pcf);
+        fclose(output);
+
+        /* Thread names are qualified with the task name */
+        snprintf(filename, 255, "%s.row", argv[1]);
+        output = fopen(filename, "w");
+        if (output == NULL)
+        {
+                perror(filename);
+                return 1;
+        }
+        fprintf(output, "LEVEL TASK            SIZE %d\n", tasks);
+        for (i = 0;  i < count;  i++)
+        {
+                n = in[i].header.tasks;
+                rows = prv_rows(in[i].prefix, "TASK", &n);
+                for (j = 0;  j < in[i].header.tasks;  j++)
+                        fprintf(output, "%s\n", rows[j]);
+        }
+        fprintf(output, "LEVEL THREAD            SIZE %d\n", threads);
+        for (i = 0;  i < count;  i++)
+        {
+                n = in[i].header.tasks;
+                tasknames = prv_rows(in[i].prefix, "TASK", &n);
+                n = in[i].header.threads;
+                rows = prv_rows(in[i].prefix, "THREAD", &n);
+                for (j = 0, n = 0;  j < in[i].header.tasks;  j++)
+                        for (t = 0;  t < in[i].header.taskthreads[j];  t++, n++)
+                                fprintf(output, "%s: %s\n", tasknames[j], rows[n]);
+        }
+        fclose(output);
+
+        return 0;
+}
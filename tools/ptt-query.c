@@ -0,0 +1,369 @@
+/*
+ * ptt-query.c - Interval queries over raw thread traces
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+
+/*
+ * Traces post processed with PTT_RAW set keep the binary thread traces instead
+ * of a merged .prv file (see "formats.h").  This tool answers questions about
+ * the values of one event type directly from them.  Each value holds from its
+ * event until the next event of the same type in the same thread, or until the
+ * last event of the thread.  For each thread and value, the tool prints how
+ * many of those intervals there are and the time they cover:
+ *
+ *      ptt-query ptt-trace-001 1000                  (time per value)
+ *      ptt-query -b 1s -e 2s ptt-trace-001 1000      (within a time window)
+ *      ptt-query -v 1 -m 1ms ptt-trace-001 1001      (value 1 lasting >= 1ms)
+ *
+ * Intervals are counted when they overlap the window, and only the overlap is
+ * added to the time.  The minimum duration applies to the whole interval.
+ *
+ * With the -l option, the tool reads the level of detail pyramid written along
+ * merged traces (".lod" file) instead, and prints the number of events and the
+ * dominant state of each thread for buckets of up to the given width.  That
+ * gives an instant overview of huge traces, and narrower windows and widths
+ * drill down into them:
+ *
+ *      ptt-query -l 100ms ptt-trace-001              (whole run overview)
+ *      ptt-query -l 1ms -b 2s -e 2.5s ptt-trace-001  (half a second of it)
+ *
+ * Thread traces are independent, so they are scanned in parallel by several
+ * worker threads (as many as processors, or the -j option).  Each trace is
+ * mapped in memory and checked in blocks of events: a first, branch free, loop
+ * builds a bit mask of the events of the requested type, which the compiler
+ * turns into vector instructions, and only those events are looked at.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prv.h"
+#include "formats.h"
+
+#define BLOCK  64  /* Events per mask */
+
+
+struct interval
+{
+        int value;
+        uint64_t count;
+        uint64_t time;
+};
+
+/*
+ * Query parameters and results, per thread.
+ */
+struct query
+{
+        char prefix[256];
+        struct ptt_rawheader header;
+        int type;
+        int filter;          /* Whether only "value" is wanted */
+        int value;
+        uint64_t begin;
+        uint64_t end;
+        uint64_t minimum;
+        int next;            /* Next thread to scan */
+        pthread_mutex_t lock;
+        int *counts;         /* Per thread results */
+        struct interval **results;
+};
+
+
+static void usage (const char *program)
+{
+        fprintf(stderr, "Usage: %s [-j JOBS] [-b BEGIN] [-e END] [-m MIN] "
+                        "[-v VALUE] TRACE TYPE\n"
+                        "       %s -l WIDTH [-b BEGIN] [-e END] TRACE\n\n"
+                        "  BEGIN, END, MIN and WIDTH accept the ns, us, ms and s "
+                        "suffixes.\n", program, program);
+        exit(2);
+}
+
+
+static void add_interval (struct query *q, int thread, int value,
+                          uint64_t since, uint64_t until)
+{
+        struct interval *in = q->results[thread];
+        uint64_t a, b;
+        int i, n = q->counts[thread];
+
+        if ((q->filter && value != q->value) || until - since < q->minimum ||
+            since >= q->end || until < q->begin)
+                return;
+        a = since > q->begin ? since : q->begin;
+        b = until < q->end ? until : q->end;
+
+        for (i = 0;  i < n && in[i].value != value;  i++)
+                ;
+        if (i == n)
+        {
+                if (n % 16 == 0)
+                        in = q->results[thread] = realloc(in, (n + 16) *
+                                                          sizeof(struct interval));
+                in[n].value = value;
+                in[n].count = 0;
+                in[n].time = 0;
+                q->counts[thread]++;
+        }
+        in[i].count++;
+        in[i].time += b - a;
+}
+
+
+/*
+ * Scan the trace of a thread, counting from zero.
+ */
+static int scan_thread (struct query *q, int thread)
+{
+        const struct ptt_event *ev;
+        struct stat st;
+        char filename[300];
+        uint64_t mask, since = 0, ns;
+        size_t count, i, j;
+        int fd, active = 0, current = 0;
+        void *map;
+
+        snprintf(filename, sizeof(filename), "%s.%04d.tt", q->prefix, thread + 1);
+        fd = open(filename, O_RDONLY);
+        if (fd == -1 || fstat(fd, &st) == -1)
+        {
+                perror(filename);
+                return -1;
+        }
+        count = st.st_size / sizeof(struct ptt_event);
+        if (count == 0)
+        {
+                close(fd);
+                return 0;
+        }
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+                perror(filename);
+                return -1;
+        }
+        posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+        ev = map;
+
+        for (i = 0;  i < count;  i += BLOCK)
+        {
+                mask = 0;
+                if (i + BLOCK <= count)
+                        for (j = 0;  j < BLOCK;  j++)
+                                mask |= (uint64_t) (ev[i + j].type == q->type) << j;
+                else
+                        for (j = 0;  i + j < count;  j++)
+                                mask |= (uint64_t) (ev[i + j].type == q->type) << j;
+
+                while (mask != 0)
+                {
+                        j = __builtin_ctzll(mask);
+                        mask &= mask - 1;
+                        ns = (uint64_t) ((double) (ev[i + j].timestamp -
+                                                   q->header.startstamp) *
+                                         q->header.nsratio);
+                        if (active)
+                                add_interval(q, thread, current, since, ns);
+                        active = 1;
+                        current = ev[i + j].value;
+                        since = ns;
+                }
+        }
+        if (active)
+        {
+                ns = (uint64_t) ((double) (ev[count - 1].timestamp -
+                                           q->header.startstamp) *
+                                 q->header.nsratio);
+                add_interval(q, thread, current, since, ns);
+        }
+
+        munmap(map, st.st_size);
+        return 0;
+}
+
+
+static void *worker (void *query)
+{
+        struct query *q = query;
+        int t;
+
+        for (;;)
+        {
+                pthread_mutex_lock(&q->lock);
+                t = q->next++;
+                pthread_mutex_unlock(&q->lock);
+                if (t >= (int) q->header.threads)
+                        break;
+                if (scan_thread(q, t) != 0)
+                        exit(1);
+        }
+        return NULL;
+}
+
+
+/*
+ * Print the buckets of the coarsest level of detail which is not wider than
+ * "width", or of the finest one, within the query window.
+ */
+static int overview (struct query *q, uint64_t width)
+{
+        struct ptt_lodheader header;
+        struct ptt_lodcell *cells;
+        char filename[300];
+        FILE *input;
+        uint64_t first = 0, count = 0, bucket, i;
+        uint32_t l, level = 0, t;
+
+        snprintf(filename, sizeof(filename), "%s.lod", q->prefix);
+        input = fopen(filename, "r");
+        if (input == NULL || fread(&header, sizeof(header), 1, input) != 1 ||
+            memcmp(header.magic, PTT_LOD_MAGIC, 8) != 0)
+        {
+                fprintf(stderr, "%s: no level of detail data\n", q->prefix);
+                return 1;
+        }
+        for (l = 0;  l < header.levels;  l++)
+        {
+                if (l > 0 && header.bucket << l > width)
+                        break;
+                level = l;
+                first += count;
+                count = (header.duration / (header.bucket << l) + 1) *
+                        header.threads;
+        }
+        bucket = header.bucket << level;
+        count /= header.threads;
+
+        cells = malloc(count * header.threads * sizeof(struct ptt_lodcell));
+        if (cells == NULL ||
+            fseek(input, sizeof(header) + first * sizeof(struct ptt_lodcell),
+                  SEEK_SET) != 0 ||
+            fread(cells, sizeof(struct ptt_lodcell), count * header.threads,
+                  input) != count * header.threads)
+        {
+                fprintf(stderr, "%s: truncated level of detail data\n", q->prefix);
+                return 1;
+        }
+        fclose(input);
+
+        printf("thread,begin_ns,end_ns,events,state,share\n");
+        for (t = 0;  t < header.threads;  t++)
+                for (i = q->begin / bucket;  i < count && i * bucket < q->end;  i++)
+                        printf("%u,%llu,%llu,%u,%d,%.3f\n", t + 1,
+                               (unsigned long long) (i * bucket),
+                               (unsigned long long) ((i + 1) * bucket),
+                               cells[t * count + i].events,
+                               cells[t * count + i].state,
+                               cells[t * count + i].share / 1000.0);
+        free(cells);
+        return 0;
+}
+
+
+static int interval_compare (const void *a, const void *b)
+{
+        const struct interval *ia = a, *ib = b;
+
+        return ia->value < ib->value ? -1 : ia->value > ib->value;
+}
+
+
+int main (int argc, char **argv)
+{
+        struct query q;
+        pthread_t *workers;
+        char filename[300];
+        FILE *input;
+        uint64_t width = 0;
+        size_t l;
+        int jobs, opt, i, t;
+
+        memset(&q, 0, sizeof(q));
+        q.end = UINT64_MAX;
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        while ((opt = getopt(argc, argv, "j:b:e:m:v:l:")) != -1)
+        {
+                switch (opt)
+                {
+                case 'j':
+                        jobs = atoi(optarg);
+                        break;
+                case 'b':
+                        q.begin = prv_time(optarg);
+                        break;
+                case 'e':
+                        q.end = prv_time(optarg);
+                        break;
+                case 'm':
+                        q.minimum = prv_time(optarg);
+                        break;
+                case 'v':
+                        q.filter = 1;
+                        q.value = atoi(optarg);
+                        break;
+                case 'l':
+                        width = prv_time(optarg);
+                        break;
+                default:
+                        usage(argv[0]);
+                }
+        }
+        if (argc - optind != (width > 0 ? 1 : 2))
+                usage(argv[0]);
+
+        l = strlen(argv[optind]);
+        if (l > 4 && (strcmp(argv[optind] + l - 4, ".raw") == 0 ||
+                      strcmp(argv[optind] + l - 4, ".lod") == 0))
+                l -= 4;
+        snprintf(q.prefix, sizeof(q.prefix), "%.*s", (int) l, argv[optind]);
+        if (width > 0)
+                return overview(&q, width);
+        q.type = atoi(argv[optind + 1]);
+
+        snprintf(filename, sizeof(filename), "%s.raw", q.prefix);
+        input = fopen(filename, "r");
+        if (input == NULL || fread(&q.header, sizeof(q.header), 1, input) != 1 ||
+            memcmp(q.header.magic, PTT_RAW_MAGIC, 8) != 0)
+        {
+                fprintf(stderr, "%s: not a raw trace\n", argv[optind]);
+                return 1;
+        }
+        fclose(input);
+
+        q.counts = calloc(q.header.threads, sizeof(int));
+        q.results = calloc(q.header.threads, sizeof(struct interval *));
+        if (jobs < 1)
+                jobs = 1;
+        if (jobs > (int) q.header.threads)
+                jobs = q.header.threads;
+        workers = calloc(jobs, sizeof(pthread_t));
+        pthread_mutex_init(&q.lock, NULL);
+        for (i = 0;  i < jobs;  i++)
+                pthread_create(&workers[i], NULL, worker, &q);
+        for (i = 0;  i < jobs;  i++)
+                pthread_join(workers[i], NULL);
+
+        printf("thread,value,intervals,time_ns\n");
+        for (t = 0;  t < (int) q.header.threads;  t++)
+        {
+                qsort(q.results[t], q.counts[t], sizeof(struct interval),
+                      interval_compare);
+                for (i = 0;  i < q.counts[t];  i++)
+                        printf("%d,%d,%llu,%llu\n", t + 1, q.results[t][i].value,
+                               (unsigned long long) q.results[t][i].count,
+                               (unsigned long long) q.results[t][i].time);
+        }
+        return 0;
+}
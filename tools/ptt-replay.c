@@ -0,0 +1,1061 @@
+/*
+ * ptt-replay.c - Predict the execution of a trace on a different machine
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+
+/*
+ * A trace tells what each thread computed and how it depended on the others:
+ * thread creations and joins, barriers (see "ptt-critpath") and the messages
+ * of ptt_send() and ptt_recv().  This tool turns a trace into such a model,
+ * where each thread is a sequence of computation bursts separated by those
+ * synchronization points, and simulates it on a given amount of cores:
+ *
+ *      ptt-replay -c 16 ptt-trace-001 predicted
+ *
+ * The time a thread spent waiting in a traced synchronization is removed from
+ * its bursts, everything else is computation.  Waits the library does not see
+ * (mutexes, condition variables) are thus replayed as computation too, so the
+ * prediction is only as good as the synchronizations in the trace.
+ *
+ * Threads run on a core until they block, or for a time quantum if -q is
+ * given.  Waiting threads get a free core in the order they became ready
+ * (-s fifo, the default) or lowest thread first (-s thread).  Every wake up
+ * and message delivery takes the latency given with -l (zero by default).
+ *
+ * The predicted timeline is written as a new trace, with the same events at
+ * their simulated times, the messages and the state of each thread: running,
+ * waiting for a core or blocked.  The predicted duration is printed.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prv.h"
+#include "formats.h"
+
+/* Synchronization points of the model */
+enum { POINT_CREATE, POINT_JOIN, POINT_BARRIER, POINT_SEND, POINT_RECV,
+       POINT_END };
+
+/* Simulation states, which are also the states of the predicted trace */
+enum
+{
+        STATE_IDLE = 0,
+        STATE_RUNNING,
+        STATE_NEW,
+        STATE_MESSAGE,
+        STATE_SYNC,
+        STATE_READY
+};
+
+/* Scheduling policies */
+enum { POLICY_FIFO, POLICY_THREAD };
+
+struct wait
+{
+        int kind;
+        int arg;          /* Thread created or joined, or barrier phase */
+        uint64_t begin;
+        uint64_t end;
+};
+
+struct point
+{
+        int kind;
+        int arg;          /* Thread, barrier or message */
+        uint64_t time;
+        uint64_t resume;  /* When the thread went on after it */
+        uint64_t work;    /* Computation since the previous point */
+};
+
+struct event
+{
+        uint64_t time;
+        int type;
+        int64_t value;
+        int segment;      /* Point the event precedes */
+        uint64_t offset;  /* Computation of the thread up to the event */
+};
+
+struct slice
+{
+        int segment;
+        uint64_t begin;
+        uint64_t end;
+        uint64_t offset;
+};
+
+struct message
+{
+        int sender;
+        int receiver;
+        uint64_t send;
+        uint64_t recv;
+        int64_t tag;
+        int64_t size;
+        int sent;
+        uint64_t simsend;
+        uint64_t simrecv;
+};
+
+struct barrier
+{
+        int size;
+        int arrived;
+};
+
+struct thread
+{
+        /* Trace contents */
+        int parent;
+        int started;
+        uint64_t start;
+        uint64_t end;
+        int sync;
+        uint64_t since;
+        int waitcount;
+        struct wait *waits;
+        int pointcount;
+        struct point *points;
+        int eventcount;
+        struct event *events;
+        /* Simulation */
+        int state;
+        int value;        /* State record in progress */
+        uint64_t statesince;
+        int pc;           /* Next point */
+        uint64_t left;    /* Computation left before it */
+        uint64_t ready;
+        uint64_t runsince;
+        uint64_t stop;
+        uint64_t offset;
+        uint64_t done;
+        int slicecount;
+        struct slice *slices;
+};
+
+static struct thread *Threads;
+static int ThreadCount;
+static struct message *Messages;
+static int MessageCount;
+static struct barrier *Barriers;
+static int BarrierCount;
+static struct prv_record *Records;
+static size_t RecordCount;
+
+static int Cores, Running, Alive, Policy;
+static uint64_t Quantum, Latency;
+
+
+static void usage (const char *program)
+{
+        fprintf(stderr, "Usage: %s [-c CORES] [-s fifo|thread] [-q QUANTUM] "
+                        "[-l LATENCY] TRACE OUTPUT\n\n"
+                        "  QUANTUM and LATENCY accept the ns, us, ms and s "
+                        "suffixes.  OUTPUT is the\n  prefix of the predicted "
+                        "trace files.\n", program);
+        exit(2);
+}
+
+
+static void *grow (void *array, size_t count, size_t step, size_t size)
+{
+        if (count % step == 0)
+        {
+                array = realloc(array, (count + step) * size);
+                if (array == NULL)
+                {
+                        perror("realloc");
+                        exit(1);
+                }
+        }
+        return array;
+}
+
+
+static void add_record (struct prv_record *rec)
+{
+        Records = grow(Records, RecordCount, 65536, sizeof(struct prv_record));
+        Records[RecordCount++] = *rec;
+}
+
+
+/*
+ * Read the events, synchronizations and messages of every thread.
+ */
+static void read_trace (const char *trace, char *prefix,
+                        struct prv_header *header)
+{
+        struct prv_record rec;
+        struct thread *th;
+        struct message *m;
+        struct event *ev;
+        struct wait *w;
+        char line[PRV_LINE];
+        gzFile input;
+        int t;
+
+        input = prv_open(trace, prefix);
+        if (input == NULL || prv_header(input, header) != 0)
+        {
+                fprintf(stderr, "%s: not a valid trace\n", trace);
+                exit(1);
+        }
+        if (header->tasks > 1)
+        {
+                fprintf(stderr, "%s: multi-process traces are not supported\n",
+                        trace);
+                exit(1);
+        }
+
+        ThreadCount = header->threads;
+        Threads = calloc(ThreadCount + 1, sizeof(struct thread));
+        for (t = 1;  t <= ThreadCount;  t++)
+                Threads[t].end = header->duration;
+
+        while (prv_next(input, line, &rec) == 0)
+        {
+                if (rec.thread < 1 || rec.thread > ThreadCount)
+                        continue;
+                if (rec.kind == 3)
+                {
+                        if (rec.peer < 1 || rec.peer > ThreadCount)
+                                continue;
+                        Messages = grow(Messages, MessageCount, 1024,
+                                        sizeof(struct message));
+                        m = &Messages[MessageCount++];
+                        memset(m, 0, sizeof(struct message));
+                        m->sender = rec.thread;
+                        m->receiver = rec.peer;
+                        m->send = rec.time;
+                        m->recv = rec.end;
+                        m->tag = rec.type;
+                        m->size = rec.value;
+                        continue;
+                }
+                if (rec.kind != 2)
+                        continue;
+
+                th = &Threads[rec.thread];
+                if (!th->started)
+                {
+                        th->started = 1;
+                        th->start = rec.time;
+                }
+                th->events = grow(th->events, th->eventcount, 1024,
+                                  sizeof(struct event));
+                ev = &th->events[th->eventcount++];
+                ev->time = rec.time;
+                ev->type = rec.type;
+                ev->value = rec.value;
+
+                if (rec.type == PTT_PHASE_EVENT && rec.value == 0)
+                        th->end = rec.time;
+                else if (rec.type == PTT_PARENT_EVENT)
+                        th->parent = rec.value;
+                else if (rec.type == PTT_SYNC_EVENT &&
+                         rec.value != PTT_SYNC_END)
+                {
+                        th->sync = rec.value;
+                        th->since = rec.time;
+                }
+                else if (rec.type == PTT_SYNC_EVENT && th->sync != PTT_SYNC_END)
+                {
+                        th->waits = grow(th->waits, th->waitcount, 16,
+                                         sizeof(struct wait));
+                        w = &th->waits[th->waitcount++];
+                        w->kind = th->sync;
+                        w->arg = -1;
+                        w->begin = th->since;
+                        w->end = rec.time;
+                        th->sync = PTT_SYNC_END;
+                }
+        }
+        gzclose(input);
+}
+
+
+static int start_compare (const void *a, const void *b)
+{
+        const struct thread *ta = &Threads[*(const int *) a];
+        const struct thread *tb = &Threads[*(const int *) b];
+
+        return ta->start < tb->start ? -1 : ta->start > tb->start;
+}
+
+
+/*
+ * Whether child "a" is a better match than "b" for a join which returned at
+ * "time": the last one to finish before, or else the first one to finish.
+ */
+static int join_better (int a, int b, uint64_t time)
+{
+        uint64_t ea = Threads[a].end, eb = Threads[b].end;
+
+        if ((ea <= time) != (eb <= time))
+                return ea <= time;
+        return ea <= time ? ea > eb : ea < eb;
+}
+
+
+/*
+ * Tell which child each creation and each join refers to.  Children are
+ * matched to creations in start order, and each join takes the child which
+ * finished last before it returned.
+ */
+static void match_children (void)
+{
+        struct thread *th;
+        struct wait *w;
+        int *children, *taken, t, c, i, j, n, best;
+
+        children = calloc(ThreadCount + 1, sizeof(int));
+        taken = calloc(ThreadCount + 1, sizeof(int));
+        for (t = 1;  t <= ThreadCount;  t++)
+        {
+                th = &Threads[t];
+                for (c = 1, n = 0;  c <= ThreadCount;  c++)
+                        if (Threads[c].parent == t && Threads[c].started)
+                                children[n++] = c;
+                qsort(children, n, sizeof(int), start_compare);
+
+                for (i = 0, j = 0;  i < th->waitcount;  i++)
+                {
+                        w = &th->waits[i];
+                        if (w->kind == PTT_SYNC_CREATE && j < n)
+                                w->arg = children[j++];
+                        if (w->kind != PTT_SYNC_JOIN)
+                                continue;
+                        best = -1;
+                        for (c = 0;  c < n;  c++)
+                        {
+                                if (!taken[children[c]] &&
+                                    (best == -1 ||
+                                     join_better(children[c], best, w->end)))
+                                        best = children[c];
+                        }
+                        if (best != -1)
+                        {
+                                taken[best] = 1;
+                                w->arg = best;
+                        }
+                }
+
+                /* Started on their own, as far as the model is concerned */
+                for (;  j < n;  j++)
+                        Threads[children[j]].parent = 0;
+        }
+        free(children);
+        free(taken);
+}
+
+
+struct arrival
+{
+        int thread;
+        struct wait *wait;
+};
+
+static int arrival_compare (const void *a, const void *b)
+{
+        const struct arrival *aa = a, *ab = b;
+
+        return aa->wait->begin < ab->wait->begin ? -1 :
+               aa->wait->begin > ab->wait->begin;
+}
+
+
+/*
+ * Group the barrier waits into barriers, the same way "ptt-critpath" does.
+ */
+static void match_barriers (void)
+{
+        struct arrival *a = NULL;
+        uint64_t release = 0;
+        int *member, n = 0, t, i, b = -1;
+
+        for (t = 1;  t <= ThreadCount;  t++)
+                for (i = 0;  i < Threads[t].waitcount;  i++)
+                {
+                        if (Threads[t].waits[i].kind != PTT_SYNC_BARRIER)
+                                continue;
+                        a = grow(a, n, 256, sizeof(struct arrival));
+                        a[n].thread = t;
+                        a[n].wait = &Threads[t].waits[i];
+                        n++;
+                }
+        qsort(a, n, sizeof(struct arrival), arrival_compare);
+
+        member = calloc(ThreadCount + 1, sizeof(int));
+        for (i = 0;  i < n;  i++)
+        {
+                if (b == -1 || a[i].wait->begin > release ||
+                    member[a[i].thread] == b + 1)
+                {
+                        Barriers = grow(Barriers, BarrierCount, 64,
+                                        sizeof(struct barrier));
+                        b = BarrierCount++;
+                        Barriers[b].size = 0;
+                        Barriers[b].arrived = 0;
+                        release = a[i].wait->end;
+                }
+                if (a[i].wait->end < release)
+                        release = a[i].wait->end;
+                member[a[i].thread] = b + 1;
+                a[i].wait->arg = b;
+                Barriers[b].size++;
+        }
+        free(member);
+        free(a);
+}
+
+
+static int point_compare (const void *a, const void *b)
+{
+        const struct point *pa = a, *pb = b;
+
+        if (pa->time != pb->time)
+                return pa->time < pb->time ? -1 : 1;
+        return pa->kind - pb->kind;
+}
+
+
+static void add_point (struct thread *th, int kind, int arg, uint64_t time,
+                       uint64_t resume)
+{
+        struct point *p;
+
+        th->points = grow(th->points, th->pointcount, 64, sizeof(struct point));
+        p = &th->points[th->pointcount++];
+        p->kind = kind;
+        p->arg = arg;
+        p->time = time;
+        p->resume = resume;
+        p->work = 0;
+}
+
+
+/*
+ * Turn the synchronizations of each thread into the points of the model, and
+ * place every event relative to them.
+ */
+static void build_model (void)
+{
+        struct thread *th;
+        struct point *p;
+        struct event *ev;
+        struct wait *w;
+        uint64_t cursor, base;
+        int t, i, k;
+
+        for (i = 0;  i < MessageCount;  i++)
+        {
+                add_point(&Threads[Messages[i].sender], POINT_SEND, i,
+                          Messages[i].send, Messages[i].send);
+                add_point(&Threads[Messages[i].receiver], POINT_RECV, i,
+                          Messages[i].recv, Messages[i].recv);
+        }
+
+        for (t = 1;  t <= ThreadCount;  t++)
+        {
+                th = &Threads[t];
+                if (!th->started)
+                        continue;
+                for (i = 0;  i < th->waitcount;  i++)
+                {
+                        w = &th->waits[i];
+                        if (w->kind == PTT_SYNC_CREATE && w->arg != -1)
+                                add_point(th, POINT_CREATE, w->arg, w->begin,
+                                          w->begin);
+                        else if (w->kind == PTT_SYNC_JOIN && w->arg != -1)
+                                add_point(th, POINT_JOIN, w->arg, w->begin,
+                                          w->end);
+                        else if (w->kind == PTT_SYNC_BARRIER)
+                                add_point(th, POINT_BARRIER, w->arg, w->begin,
+                                          w->end);
+                }
+                add_point(th, POINT_END, 0, th->end, th->end);
+                qsort(th->points, th->pointcount, sizeof(struct point),
+                      point_compare);
+
+                /* Computation between points, without the waits */
+                cursor = th->start;
+                for (i = 0;  i < th->pointcount;  i++)
+                {
+                        p = &th->points[i];
+                        p->work = p->time > cursor ? p->time - cursor : 0;
+                        if (p->resume > cursor)
+                                cursor = p->resume;
+                }
+
+                /* Events go before the first point not earlier than them */
+                cursor = th->start;
+                base = 0;
+                k = 0;
+                for (i = 0;  i < th->eventcount;  i++)
+                {
+                        ev = &th->events[i];
+                        while (k < th->pointcount - 1 &&
+                               th->points[k].time < ev->time)
+                        {
+                                base += th->points[k].work;
+                                if (th->points[k].resume > cursor)
+                                        cursor = th->points[k].resume;
+                                k++;
+                        }
+                        ev->segment = k;
+                        ev->offset = base;
+                        if (ev->time > cursor)
+                                ev->offset += ev->time - cursor <
+                                              th->points[k].work ?
+                                              ev->time - cursor :
+                                              th->points[k].work;
+                }
+        }
+}
+
+
+/*
+ * Change the state of a thread from the given time on.
+ */
+static void set_state (struct thread *th, int value, uint64_t time)
+{
+        struct prv_record rec;
+
+        if (time > th->statesince && th->value != STATE_IDLE)
+        {
+                memset(&rec, 0, sizeof(rec));
+                rec.kind = 1;
+                rec.task = 1;
+                rec.thread = th - Threads;
+                rec.time = th->statesince;
+                rec.end = time;
+                rec.value = th->value;
+                add_record(&rec);
+        }
+        if (time >= th->statesince)
+                th->statesince = time;
+        th->value = value;
+}
+
+
+/*
+ * Account computation, or start a new segment with an empty slice, so every
+ * segment a thread goes through can be found when placing the events.
+ */
+static void add_slice (struct thread *th, uint64_t begin, uint64_t end)
+{
+        struct slice *s;
+
+        if (th->slicecount > 0)
+        {
+                s = &th->slices[th->slicecount - 1];
+                if (s->segment == th->pc && s->end == begin)
+                {
+                        s->end = end;
+                        th->offset += end - begin;
+                        return;
+                }
+        }
+        th->slices = grow(th->slices, th->slicecount, 256, sizeof(struct slice));
+        s = &th->slices[th->slicecount++];
+        s->segment = th->pc;
+        s->begin = begin;
+        s->end = end;
+        s->offset = th->offset;
+        th->offset += end - begin;
+}
+
+
+static void wake (struct thread *th, uint64_t time)
+{
+        th->state = STATE_READY;
+        th->ready = time;
+        set_state(th, STATE_READY, time);
+}
+
+
+static void block (struct thread *th, int value, uint64_t time)
+{
+        th->state = value;
+        Running--;
+        set_state(th, value, time);
+}
+
+
+/*
+ * Let a blocked thread go on after the point it is waiting on.
+ */
+static void unblock (struct thread *th, uint64_t time)
+{
+        th->pc++;
+        th->left = th->points[th->pc].work;
+        wake(th, time);
+}
+
+
+static void run (struct thread *th, uint64_t now)
+{
+        th->runsince = now;
+        th->stop = now + (Quantum > 0 && th->left > Quantum ? Quantum : th->left);
+}
+
+
+/*
+ * The running thread "th" is done with its computation, go through the points
+ * until it blocks, finishes or has more computation to do.
+ */
+static void advance (struct thread *th, uint64_t now)
+{
+        struct thread *peer;
+        struct message *m;
+        struct point *p;
+        uint64_t time;
+        int t;
+
+        while (th->left == 0)
+        {
+                p = &th->points[th->pc];
+                switch (p->kind)
+                {
+                case POINT_CREATE:
+                        if (Threads[p->arg].state == STATE_NEW)
+                                wake(&Threads[p->arg], now + Latency);
+                        break;
+
+                case POINT_SEND:
+                        m = &Messages[p->arg];
+                        m->sent = 1;
+                        m->simsend = now;
+                        peer = &Threads[m->receiver];
+                        if (peer->state == STATE_MESSAGE &&
+                            peer->points[peer->pc].arg == p->arg)
+                        {
+                                m->simrecv = now + Latency;
+                                unblock(peer, m->simrecv);
+                        }
+                        break;
+
+                case POINT_RECV:
+                        m = &Messages[p->arg];
+                        if (!m->sent)
+                        {
+                                block(th, STATE_MESSAGE, now);
+                                return;
+                        }
+                        time = m->simsend + Latency;
+                        m->simrecv = time > now ? time : now;
+                        if (time > now)
+                        {
+                                block(th, STATE_MESSAGE, now);
+                                unblock(th, time);
+                                return;
+                        }
+                        break;
+
+                case POINT_JOIN:
+                        peer = &Threads[p->arg];
+                        if (peer->state != STATE_IDLE)
+                        {
+                                block(th, STATE_SYNC, now);
+                                return;
+                        }
+                        time = peer->done + Latency;
+                        if (time > now)
+                        {
+                                block(th, STATE_SYNC, now);
+                                unblock(th, time);
+                                return;
+                        }
+                        break;
+
+                case POINT_BARRIER:
+                        if (++Barriers[p->arg].arrived < Barriers[p->arg].size)
+                        {
+                                block(th, STATE_SYNC, now);
+                                return;
+                        }
+                        for (t = 1;  t <= ThreadCount;  t++)
+                        {
+                                peer = &Threads[t];
+                                if (peer->state == STATE_SYNC &&
+                                    peer->points[peer->pc].kind == POINT_BARRIER &&
+                                    peer->points[peer->pc].arg == p->arg)
+                                        unblock(peer, now + Latency);
+                        }
+                        if (Latency > 0)
+                        {
+                                block(th, STATE_SYNC, now);
+                                unblock(th, now + Latency);
+                                return;
+                        }
+                        break;
+
+                case POINT_END:
+                        block(th, STATE_IDLE, now);
+                        th->done = now;
+                        Alive--;
+                        for (t = 1;  t <= ThreadCount;  t++)
+                        {
+                                peer = &Threads[t];
+                                if (peer->state == STATE_SYNC &&
+                                    peer->points[peer->pc].kind == POINT_JOIN &&
+                                    peer->points[peer->pc].arg == th - Threads)
+                                        unblock(peer, now + Latency);
+                        }
+                        return;
+                }
+                th->pc++;
+                th->left = th->points[th->pc].work;
+                add_slice(th, now, now);
+        }
+        run(th, now);
+}
+
+
+/*
+ * Pick the next thread to get a core, if any is ready.
+ */
+static struct thread *pick (uint64_t now)
+{
+        struct thread *th, *best = NULL;
+        int t;
+
+        for (t = 1;  t <= ThreadCount;  t++)
+        {
+                th = &Threads[t];
+                if (th->state != STATE_READY || th->ready > now)
+                        continue;
+                if (best == NULL ||
+                    (Policy == POLICY_FIFO && th->ready < best->ready))
+                        best = th;
+        }
+        return best;
+}
+
+
+static void dispatch (uint64_t now)
+{
+        struct thread *th;
+
+        while (Running < Cores && (th = pick(now)) != NULL)
+        {
+                th->state = STATE_RUNNING;
+                Running++;
+                set_state(th, STATE_RUNNING, now);
+                add_slice(th, now, now);
+                if (th->left == 0)
+                        advance(th, now);
+                else
+                        run(th, now);
+        }
+}
+
+
+/*
+ * The slice of a running thread is over.
+ */
+static void step (struct thread *th, uint64_t now)
+{
+        add_slice(th, th->runsince, now);
+        th->left -= now - th->runsince;
+        if (th->left == 0)
+        {
+                advance(th, now);
+                return;
+        }
+
+        /* Quantum expired */
+        if (pick(now) != NULL)
+        {
+                th->state = STATE_READY;
+                th->ready = now;
+                Running--;
+                set_state(th, STATE_READY, now);
+        }
+        else
+                run(th, now);
+}
+
+
+/*
+ * Run the model.  Return the predicted end.
+ */
+static uint64_t simulate (void)
+{
+        struct thread *th;
+        uint64_t now, next;
+        int t;
+
+        now = Threads[1].start;
+        for (t = 1;  t <= ThreadCount;  t++)
+        {
+                th = &Threads[t];
+                th->state = th->started ? STATE_NEW : STATE_IDLE;
+                th->value = th->state;
+                th->statesince = now;
+                th->left = th->pointcount > 0 ? th->points[0].work : 0;
+                if (th->started)
+                        Alive++;
+        }
+        wake(&Threads[1], now);
+
+        /* Threads whose creation is not in the trace start when they did */
+        for (t = 2;  t <= ThreadCount;  t++)
+        {
+                th = &Threads[t];
+                if (th->started && (th->parent < 1 || th->parent > ThreadCount))
+                        wake(th, th->start > now ? th->start : now);
+        }
+
+        while (Alive > 0)
+        {
+                dispatch(now);
+                next = UINT64_MAX;
+                for (t = 1;  t <= ThreadCount;  t++)
+                {
+                        th = &Threads[t];
+                        if (th->state == STATE_RUNNING && th->stop < next)
+                                next = th->stop;
+                        if (th->state == STATE_READY && th->ready > now &&
+                            th->ready < next)
+                                next = th->ready;
+                }
+                if (next == UINT64_MAX)
+                {
+                        fprintf(stderr, "Warning: %d threads never finish, the "
+                                        "model is incomplete\n", Alive);
+                        for (t = 1;  t <= ThreadCount;  t++)
+                                if (Threads[t].state != STATE_IDLE)
+                                {
+                                        set_state(&Threads[t], STATE_IDLE, now);
+                                        Threads[t].done = now;
+                                }
+                        break;
+                }
+
+                now = next;
+                for (t = 1;  t <= ThreadCount;  t++)
+                        if (Threads[t].state == STATE_RUNNING &&
+                            Threads[t].stop == now)
+                                step(&Threads[t], now);
+        }
+        return now;
+}
+
+
+/*
+ * Place the events of a thread at their simulated time.
+ */
+static void replay_events (struct thread *th)
+{
+        struct prv_record rec;
+        struct slice *s;
+        struct event *ev;
+        int i, j = 0;
+
+        memset(&rec, 0, sizeof(rec));
+        rec.kind = 2;
+        rec.task = 1;
+        rec.thread = th - Threads;
+        for (i = 0;  i < th->eventcount;  i++)
+        {
+                ev = &th->events[i];
+                while (j < th->slicecount - 1 &&
+                       (th->slices[j].segment < ev->segment ||
+                        (th->slices[j + 1].segment == ev->segment &&
+                         th->slices[j + 1].offset <= ev->offset)))
+                        j++;
+                if (j >= th->slicecount)
+                        rec.time = th->done;
+                else
+                {
+                        s = &th->slices[j];
+                        rec.time = s->begin;
+                        if (ev->offset > s->offset)
+                                rec.time += ev->offset - s->offset <
+                                            s->end - s->begin ?
+                                            ev->offset - s->offset :
+                                            s->end - s->begin;
+                }
+                rec.type = ev->type;
+                rec.value = ev->value;
+                add_record(&rec);
+        }
+}
+
+
+static int record_compare (const void *a, const void *b)
+{
+        const struct prv_record *ra = a, *rb = b;
+
+        if (ra->time != rb->time)
+                return ra->time < rb->time ? -1 : 1;
+        return ra->thread - rb->thread;
+}
+
+
+/*
+ * Copy the PCF file, replacing the states by the simulated ones.
+ */
+static void write_pcf (const char *from, const char *to)
+{
+        char line[PRV_LINE];
+        FILE *input, *output;
+        int skip = 0;
+
+        output = fopen(to, "w");
+        if (output == NULL)
+        {
+                perror(to);
+                exit(1);
+        }
+        input = fopen(from, "r");
+        while (input != NULL && fgets(line, PRV_LINE, input) != NULL)
+        {
+                if (strncmp(line, "STATES_FROM_EVENT_TYPE", 22) == 0)
+                        skip = 2;
+                if (skip > 0)
+                        skip--;
+                else
+                        fputs(line, output);
+        }
+        if (input != NULL)
+                fclose(input);
+        fprintf(output, "\nSTATES\n"
+                        "0    Idle\n"
+                        "1    Running\n"
+                        "2    Not created\n"
+                        "3    Waiting a message\n"
+                        "4    Synchronization\n"
+                        "5    Waiting for a core\n\n");
+        fclose(output);
+}
+
+
+static void copy_file (const char *from, const char *to)
+{
+        char chunk[4096];
+        FILE *input, *output;
+        size_t n;
+
+        input = fopen(from, "r");
+        if (input == NULL)
+                return;
+        output = fopen(to, "w");
+        if (output == NULL)
+        {
+                perror(to);
+                exit(1);
+        }
+        while ((n = fread(chunk, 1, sizeof(chunk), input)) > 0)
+                fwrite(chunk, 1, n, output);
+        fclose(input);
+        fclose(output);
+}
+
+
+int main (int argc, char **argv)
+{
+        struct prv_header header;
+        struct prv_record rec;
+        struct message *m;
+        char prefix[256], filename[256], from[300];
+        uint64_t end, original;
+        FILE *output;
+        size_t r;
+        int opt, t, i;
+
+        Cores = sysconf(_SC_NPROCESSORS_ONLN);
+        while ((opt = getopt(argc, argv, "c:s:q:l:")) != -1)
+        {
+                switch (opt)
+                {
+                case 'c':
+                        Cores = atoi(optarg);
+                        break;
+                case 's':
+                        if (strcmp(optarg, "fifo") == 0)
+                                Policy = POLICY_FIFO;
+                        else if (strcmp(optarg, "thread") == 0)
+                                Policy = POLICY_THREAD;
+                        else
+                                usage(argv[0]);
+                        break;
+                case 'q':
+                        Quantum = prv_time(optarg);
+                        break;
+                case 'l':
+                        Latency = prv_time(optarg);
+                        break;
+                default:
+                        usage(argv[0]);
+                }
+        }
+        if (argc - optind != 2 || Cores < 1)
+                usage(argv[0]);
+
+        read_trace(argv[optind], prefix, &header);
+        if (ThreadCount < 1 || !Threads[1].started)
+        {
+                fprintf(stderr, "%s: no main thread\n", argv[optind]);
+                return 1;
+        }
+        match_children();
+        match_barriers();
+        build_model();
+        end = simulate();
+
+        for (t = 1;  t <= ThreadCount;  t++)
+                replay_events(&Threads[t]);
+        memset(&rec, 0, sizeof(rec));
+        rec.kind = 3;
+        rec.task = 1;
+        rec.peertask = 1;
+        for (i = 0;  i < MessageCount;  i++)
+        {
+                m = &Messages[i];
+                if (!m->sent)
+                        continue;
+                rec.thread = m->sender;
+                rec.peer = m->receiver;
+                rec.time = m->simsend;
+                rec.end = m->simrecv > m->simsend ? m->simrecv : m->simsend;
+                rec.type = m->tag;
+                rec.value = m->size;
+                add_record(&rec);
+        }
+        qsort(Records, RecordCount, sizeof(struct prv_record), record_compare);
+
+        snprintf(filename, 255, "%s.prv", argv[optind + 1]);
+        output = fopen(filename, "w");
+        if (output == NULL)
+        {
+                perror(filename);
+                return 1;
+        }
+        fprintf(output, "#Paraver (%s):%llu_ns:0:1:1(%d:0)\n", header.date,
+                (unsigned long long) end, ThreadCount);
+        for (r = 0;  r < RecordCount;  r++)
+                prv_write(output, &Records[r]);
+        fclose(output);
+
+        snprintf(from, sizeof(from), "%s.pcf", prefix);
+        snprintf(filename, 255, "%s.pcf", argv[optind + 1]);
+        write_pcf(from, filename);
+        snprintf(from, sizeof(from), "%s.row", prefix);
+        snprintf(filename, 255, "%s.row", argv[optind + 1]);
+        copy_file(from, filename);
+
+        original = Threads[1].end - Threads[1].start;
+        end -= Threads[1].start;
+        printf("Original: %.3f ms\nPredicted on %d cores: %.3f ms (%.2fx)\n",
+               original / 1e6, Cores, end / 1e6,
+               end > 0 ? (double) original / end : 1.0);
+        return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * ptt-stat.c - Event statistics from the columnar dataset of a trace
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+
+/*
+ * Quick summaries computed by scanning the mapped columns of a trace (see
+ * "col.c"), instead of parsing the .prv file.  Without an event type, the
+ * amount of events of each type for each thread is printed.  With an event
+ * type, the time each thread spends with each value of that type is printed
+ * instead.  A value holds from its event until the next event of the same type
+ * in the same thread, or until the end of the trace.
+ *
+ * The output is CSV, ready to be loaded by any spreadsheet or script.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "col.h"
+
+
+struct counter
+{
+        uint32_t thread;  /* Zero for unused slots */
+        int32_t key;      /* Event type, or value */
+        uint64_t count;
+        uint64_t time;
+};
+
+static struct counter *Table;
+static size_t TableSize, TableUsed;
+
+
+/*
+ * Find the counter of a thread and key, creating it if needed.  The table is
+ * an open addressing hash, doubled when half full.
+ */
+static struct counter *counter (uint32_t thread, int32_t key)
+{
+        struct counter *old;
+        size_t h, i, n;
+
+        if (2 * (TableUsed + 1) > TableSize)
+        {
+                old = Table;
+                n = TableSize;
+                TableSize = n > 0 ? 2 * n : 1024;
+                Table = calloc(TableSize, sizeof(struct counter));
+                if (Table == NULL)
+                {
+                        perror("calloc");
+                        exit(1);
+                }
+                TableUsed = 0;
+                for (i = 0;  i < n;  i++)
+                        if (old[i].thread != 0)
+                                *counter(old[i].thread, old[i].key) = old[i];
+                free(old);
+        }
+
+        h = ((size_t) thread * 2654435761u ^ (uint32_t) key * 40503u) &
+            (TableSize - 1);
+        while (Table[h].thread != 0 &&
+               (Table[h].thread != thread || Table[h].key != key))
+                h = (h + 1) & (TableSize - 1);
+        if (Table[h].thread == 0)
+        {
+                Table[h].thread = thread;
+                Table[h].key = key;
+                TableUsed++;
+        }
+        return &Table[h];
+}
+
+
+static int counter_compare (const void *a, const void *b)
+{
+        const struct counter *ca = a, *cb = b;
+
+        if (ca->thread != cb->thread)
+                return ca->thread < cb->thread ? -1 : 1;
+        return ca->key < cb->key ? -1 : ca->key > cb->key;
+}
+
+
+/*
+ * Move the used counters to the front and sort them.
+ */
+static size_t counter_sort (void)
+{
+        size_t i, n;
+
+        for (i = 0, n = 0;  i < TableSize;  i++)
+                if (Table[i].thread != 0)
+                        Table[n++] = Table[i];
+        qsort(Table, n, sizeof(struct counter), counter_compare);
+        return n;
+}
+
+
+int main (int argc, char **argv)
+{
+        struct col_trace col;
+        struct counter *c;
+        uint64_t *since, i, count;
+        int32_t type, *current;
+        uint32_t t;
+        size_t n, k;
+
+        if (argc != 2 && argc != 3)
+        {
+                fprintf(stderr, "Usage: %s TRACE [TYPE]\n", argv[0]);
+                return 2;
+        }
+        if (col_open(argv[1], &col) != 0)
+        {
+                fprintf(stderr, "%s: no valid columnar dataset\n", argv[1]);
+                return 1;
+        }
+        count = col.header.count;
+
+        if (argc == 2)
+        {
+                for (i = 0;  i < count;  i++)
+                        counter(col.thread[i], col.type[i])->count++;
+                n = counter_sort();
+                printf("thread,type,events\n");
+                for (k = 0;  k < n;  k++)
+                        printf("%u,%d,%llu\n", Table[k].thread, Table[k].key,
+                               (unsigned long long) Table[k].count);
+                col_close(&col);
+                return 0;
+        }
+
+        type = atoi(argv[2]);
+        since = calloc(col.header.threads + 1, sizeof(uint64_t));
+        current = calloc(col.header.threads + 1, sizeof(int32_t));
+        if (since == NULL || current == NULL)
+        {
+                perror("calloc");
+                return 1;
+        }
+        for (i = 0;  i < count;  i++)
+        {
+                if (col.type[i] != type)
+                        continue;
+                t = col.thread[i];
+                if (t > col.header.threads)
+                        continue;
+                if (since[t] != 0)
+                {
+                        c = counter(t, current[t]);
+                        c->count++;
+                        c->time += col.time[i] - (since[t] - 1);
+                }
+                current[t] = col.value[i];
+                since[t] = col.time[i] + 1;  /* Zero means no value yet */
+        }
+        for (t = 1;  t <= col.header.threads;  t++)
+        {
+                if (since[t] == 0)
+                        continue;
+                c = counter(t, current[t]);
+                c->count++;
+                if (col.header.duration >= since[t] - 1)
+                        c->time += col.header.duration - (since[t] - 1);
+        }
+
+        n = counter_sort();
+        printf("thread,value,time_ns,count\n");
+        for (k = 0;  k < n;  k++)
+                printf("%u,%d,%llu,%llu\n", Table[k].thread, Table[k].key,
+                       (unsigned long long) Table[k].time,
+                       (unsigned long long) Table[k].count);
+        free(since);
+        free(current);
+        col_close(&col);
+        return 0;
+}
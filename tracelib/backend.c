@@ -0,0 +1,201 @@
+/*
+ * backend.c - Trace formats written by the post processor
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+#include "chrome.h"
+
+/*
+ * The post processor produces a stream of events, states and communications
+ * in time order, and hands them to a backend which writes them in some trace
+ * format.  The PTT_FORMAT environment variable selects it:
+ *
+ *      - "paraver", the default, writes the .prv file.
+ *
+ *      - "chrome" writes the Chrome trace event format, as a .json file, for
+ *        chrome://tracing and the Perfetto user interface (see "chrome.c").
+ *
+ * Each backend function returns the amount of bytes written, which is what
+ * the time index needs.  Only the Paraver backend supports the index, though.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern const char *PttPCF;
+
+
+/****************************  PARAVER BACKEND  ****************************/
+
+static uint64_t ptt_prvbegin (FILE *output, uint64_t duration)
+{
+        struct tm localdate;
+        char strdate[32];
+        time_t date;
+        int e;
+
+        date = time(NULL);
+        localtime_r(&date, &localdate);
+        strftime(strdate, 31, "%d/%m/%y at %H:%M", &localdate);
+        e = fprintf(output, "#Paraver (%s):%llu_ns:0:1:1(%d:0)\n", strdate,
+                    duration, PttGlobal.postcount);
+        ptt_assert(e > 0);
+        return e;
+}
+
+
+static uint64_t ptt_prvevent (FILE *output, int thread, uint64_t ns, int type,
+                              int value)
+{
+        int e;
+
+        e = fprintf(output, "2:0:1:1:%d:%llu:%d:%d\n", thread + 1, ns, type,
+                    value);
+        ptt_assert(e > 0);
+        return e;
+}
+
+
+static uint64_t ptt_prvstate (FILE *output, struct ptt_state *state)
+{
+        int e;
+
+        e = fprintf(output, "1:0:1:1:%d:%llu:%llu:%d\n", state->thread + 1,
+                    state->begin, state->end, state->value);
+        ptt_assert(e > 0);
+        return e;
+}
+
+
+static uint64_t ptt_prvcomm (FILE *output, struct ptt_comm *comm)
+{
+        int e;
+
+        e = fprintf(output, "3:0:1:1:%d:%llu:%llu:0:1:1:%d:%llu:%llu:%d:%d\n",
+                    comm->sender + 1, comm->sendns, comm->sendns,
+                    comm->receiver + 1, comm->recvns, comm->recvns, comm->size,
+                    comm->tag);
+        ptt_assert(e > 0);
+        return e;
+}
+
+
+static void ptt_prvend (FILE *output)
+{
+}
+
+
+const struct ptt_backend PttParaver =
+{
+        ".prv", ptt_prvbegin, ptt_prvevent, ptt_prvstate, ptt_prvcomm,
+        ptt_prvend
+};
+
+
+/*****************************  CHROME BACKEND  *****************************/
+
+static struct ptt_chrome *Chrome;
+
+
+/*
+ * The names come from the PCF contents, plus the sample and function event
+ * types when there are any.  Their values are resolved as they appear.
+ */
+static uint64_t ptt_jsonbegin (FILE *output, uint64_t duration)
+{
+        char name[32], *pcf = NULL;
+        size_t size;
+        FILE *stream;
+        int e, i;
+
+        stream = open_memstream(&pcf, &size);
+        ptt_assert(stream != NULL);
+        e = fputs(PttPCF, stream);
+        ptt_assert(e != EOF);
+        if (PttGlobal.sampleperiod > 0 || PttGlobal.functions)
+                ptt_symbolwrite(stream);
+        e = fclose(stream);
+        ptt_assert(e != EOF);
+
+        Chrome = ptt_chromeopen(output, pcf);
+        ptt_assert(Chrome != NULL);
+        free(pcf);
+
+        if (PttGlobal.parentid != 0)
+                snprintf(name, 31, "Process %d", PttGlobal.processid);
+        else
+                snprintf(name, 31, "Main process");
+        ptt_chromeprocess(Chrome, 1, name);
+        for (i = 1;  i <= PttGlobal.postcount;  i++)
+        {
+                snprintf(name, 31, "Thread %d", i);
+                ptt_chromethread(Chrome, 1, i, name);
+        }
+        return 0;
+}
+
+
+static uint64_t ptt_jsonevent (FILE *output, int thread, uint64_t ns, int type,
+                               int value)
+{
+        const char *label = NULL;
+
+        if ((PttGlobal.sampleperiod > 0 || PttGlobal.functions) &&
+            type >= PTT_SAMPLE_EVENT && type <= PTT_FUNC_EVENT)
+                label = ptt_symbolstring(value);
+        ptt_chromeevent(Chrome, 1, thread + 1, ns, type, value, label);
+        return 0;
+}
+
+
+static uint64_t ptt_jsonstate (FILE *output, struct ptt_state *state)
+{
+        ptt_chromestate(Chrome, 1, state->thread + 1, state->begin, state->end,
+                        state->value);
+        return 0;
+}
+
+
+static uint64_t ptt_jsoncomm (FILE *output, struct ptt_comm *comm)
+{
+        ptt_chromecomm(Chrome, 1, comm->sender + 1, comm->sendns, 1,
+                       comm->receiver + 1, comm->recvns, comm->tag, comm->size);
+        return 0;
+}
+
+
+static void ptt_jsonend (FILE *output)
+{
+        ptt_chromeclose(Chrome);
+        Chrome = NULL;
+}
+
+
+const struct ptt_backend PttChrome =
+{
+        ".json", ptt_jsonbegin, ptt_jsonevent, ptt_jsonstate, ptt_jsoncomm,
+        ptt_jsonend
+};
+
+
+/*
+ * Find out the requested trace format.
+ */
+const struct ptt_backend *ptt_backendselect (void)
+{
+        char *format;
+
+        format = getenv("PTT_FORMAT");
+        if (format == NULL || format[0] == '\0' || strcmp(format, "paraver") == 0)
+                return &PttParaver;
+        if (strcmp(format, "chrome") == 0 || strcmp(format, "json") == 0)
+                return &PttChrome;
+        ptt_debug("Unknown trace format '%s', using Paraver", format);
+        return &PttParaver;
+}
@@ -0,0 +1,340 @@
+/*
+ * chrome.c - Chrome trace event format writer
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#include "chrome.h"
+
+/*
+ * Besides Paraver, traces can be written in the JSON flavour of the Chrome
+ * trace event format, which is understood by chrome://tracing and by the
+ * Perfetto user interface.  Records are streamed as they come, so the memory
+ * needed only depends on the amount of names in the PCF file:
+ *
+ *      - State records become complete slices, named after the state.
+ *
+ *      - Events whose value has a name in the PCF file become instant events
+ *        with that name, and the event type name as category.
+ *
+ *      - Other events become counters, one track per event type, with one
+ *        series per thread.
+ *
+ *      - Communications become flow arrows between two instant events.
+ *
+ * Every task is shown as a process.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+
+struct ptt_chrometype
+{
+        int64_t type;
+        int block;        /* Types in the same PCF block share the values */
+        char *name;
+};
+
+struct ptt_chromevalue
+{
+        int block;        /* Zero for the states */
+        int64_t value;
+        char *name;
+};
+
+struct ptt_chrome
+{
+        FILE *output;
+        uint64_t records;
+        uint64_t flows;
+        int typecount;
+        int valuecount;
+        struct ptt_chrometype *types;
+        struct ptt_chromevalue *values;
+};
+
+
+static int ptt_chrometypecompare (const void *a, const void *b)
+{
+        const struct ptt_chrometype *ta = a, *tb = b;
+
+        return ta->type < tb->type ? -1 : ta->type > tb->type;
+}
+
+
+static int ptt_chromevaluecompare (const void *a, const void *b)
+{
+        const struct ptt_chromevalue *va = a, *vb = b;
+
+        if (va->block != vb->block)
+                return va->block < vb->block ? -1 : 1;
+        return va->value < vb->value ? -1 : va->value > vb->value;
+}
+
+
+/*
+ * Extract the type and value names from the PCF contents.  Event types are
+ * listed as "<gradient> <type> <name>" and values as "<value> <name>".
+ */
+static void ptt_chromepcf (struct ptt_chrome *c, const char *pcf)
+{
+        struct ptt_chrometype *t;
+        struct ptt_chromevalue *v;
+        char line[1024], *end;
+        const char *p, *next;
+        long long type, value;
+        int section = 0, block = 0, n;
+        size_t l;
+
+        for (p = pcf;  p != NULL && *p != '\0';  p = next)
+        {
+                next = strchr(p, '\n');
+                l = next != NULL ? (size_t) (next - p) : strlen(p);
+                if (next != NULL)
+                        next++;
+                if (l >= sizeof(line))
+                        l = sizeof(line) - 1;
+                memcpy(line, p, l);
+                line[l] = '\0';
+                while (l > 0 && strchr(" \t\r", line[l - 1]) != NULL)
+                        line[--l] = '\0';
+
+                if (l == 0)
+                        section = 0;
+                else if (strcmp(line, "EVENT_TYPE") == 0)
+                {
+                        section = 1;
+                        block++;
+                }
+                else if (strcmp(line, "VALUES") == 0)
+                        section = 2;
+                else if (strcmp(line, "STATES") == 0)
+                        section = 3;
+                else if (section == 1 &&
+                         sscanf(line, "%*d %lld %n", &type, &n) == 1)
+                {
+                        if (c->typecount % 64 == 0)
+                                c->types = realloc(c->types,
+                                                   (c->typecount + 64) *
+                                                   sizeof(struct ptt_chrometype));
+                        t = &c->types[c->typecount++];
+                        t->type = type;
+                        t->block = block;
+                        t->name = strdup(line + n);
+                }
+                else if (section >= 2 &&
+                         (value = strtoll(line, &end, 10), end != line))
+                {
+                        if (c->valuecount % 256 == 0)
+                                c->values = realloc(c->values,
+                                                    (c->valuecount + 256) *
+                                                    sizeof(struct ptt_chromevalue));
+                        v = &c->values[c->valuecount++];
+                        v->block = section == 3 ? 0 : block;
+                        v->value = value;
+                        v->name = strdup(end + strspn(end, " \t"));
+                }
+        }
+
+        qsort(c->types, c->typecount, sizeof(struct ptt_chrometype),
+              ptt_chrometypecompare);
+        qsort(c->values, c->valuecount, sizeof(struct ptt_chromevalue),
+              ptt_chromevaluecompare);
+}
+
+
+static struct ptt_chrometype *ptt_chrometype (struct ptt_chrome *c,
+                                              int64_t type)
+{
+        struct ptt_chrometype key;
+
+        key.type = type;
+        return bsearch(&key, c->types, c->typecount,
+                       sizeof(struct ptt_chrometype), ptt_chrometypecompare);
+}
+
+
+static const char *ptt_chromevalue (struct ptt_chrome *c, int block,
+                                    int64_t value)
+{
+        struct ptt_chromevalue key, *v;
+
+        key.block = block;
+        key.value = value;
+        v = bsearch(&key, c->values, c->valuecount,
+                    sizeof(struct ptt_chromevalue), ptt_chromevaluecompare);
+        return v != NULL ? v->name : NULL;
+}
+
+
+/*
+ * Write a JSON string, quoted and escaped.
+ */
+static void ptt_chromestring (FILE *output, const char *s)
+{
+        fputc('"', output);
+        for (;  *s != '\0';  s++)
+        {
+                if (*s == '"' || *s == '\\')
+                        fputc('\\', output);
+                if ((unsigned char) *s >= ' ')
+                        fputc(*s, output);
+        }
+        fputc('"', output);
+}
+
+
+/*
+ * Start a new record, up to the time stamp.  Chrome times are microseconds.
+ */
+static void ptt_chromebegin (struct ptt_chrome *c, const char *phase, int task,
+                             int thread, uint64_t ns)
+{
+        fprintf(c->output, "%s{\"ph\":\"%s\",\"pid\":%d,\"tid\":%d,"
+                "\"ts\":%llu.%03u", c->records > 0 ? ",\n" : "\n", phase, task,
+                thread, (unsigned long long) (ns / 1000),
+                (unsigned) (ns % 1000));
+        c->records++;
+}
+
+
+/*
+ * Start writing a trace.  The PCF contents provide the names, and may be NULL.
+ */
+struct ptt_chrome *ptt_chromeopen (FILE *output, const char *pcf)
+{
+        struct ptt_chrome *c;
+
+        c = calloc(1, sizeof(struct ptt_chrome));
+        if (c == NULL)
+                return NULL;
+        c->output = output;
+        ptt_chromepcf(c, pcf);
+        fprintf(output, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+        return c;
+}
+
+
+void ptt_chromeprocess (struct ptt_chrome *c, int task, const char *name)
+{
+        ptt_chromebegin(c, "M", task, 0, 0);
+        fprintf(c->output, ",\"name\":\"process_name\",\"args\":{\"name\":");
+        ptt_chromestring(c->output, name);
+        fprintf(c->output, "}}");
+}
+
+
+void ptt_chromethread (struct ptt_chrome *c, int task, int thread,
+                       const char *name)
+{
+        ptt_chromebegin(c, "M", task, thread, 0);
+        fprintf(c->output, ",\"name\":\"thread_name\",\"args\":{\"name\":");
+        ptt_chromestring(c->output, name);
+        fprintf(c->output, "}}");
+}
+
+
+/*
+ * Write an event.  If "label" is not NULL, it is used as the value name
+ * instead of looking it up.
+ */
+void ptt_chromeevent (struct ptt_chrome *c, int task, int thread, uint64_t ns,
+                      int type, int64_t value, const char *label)
+{
+        struct ptt_chrometype *t;
+        char unknown[32];
+
+        t = ptt_chrometype(c, type);
+        if (t == NULL)
+                snprintf(unknown, sizeof(unknown), "Type %d", type);
+        if (label == NULL && t != NULL)
+                label = ptt_chromevalue(c, t->block, value);
+
+        if (label != NULL)
+        {
+                ptt_chromebegin(c, "i", task, thread, ns);
+                fprintf(c->output, ",\"s\":\"t\",\"name\":");
+                ptt_chromestring(c->output, label);
+                fprintf(c->output, ",\"cat\":");
+                ptt_chromestring(c->output, t != NULL ? t->name : unknown);
+                fprintf(c->output, ",\"args\":{\"value\":%lld}}",
+                        (long long) value);
+        }
+        else
+        {
+                ptt_chromebegin(c, "C", task, thread, ns);
+                fprintf(c->output, ",\"name\":");
+                ptt_chromestring(c->output, t != NULL ? t->name : unknown);
+                fprintf(c->output, ",\"args\":{\"%d.%d\":%lld}}", task, thread,
+                        (long long) value);
+        }
+}
+
+
+void ptt_chromestate (struct ptt_chrome *c, int task, int thread, uint64_t begin,
+                      uint64_t end, int64_t value)
+{
+        const char *name;
+        char unknown[32];
+
+        name = ptt_chromevalue(c, 0, value);
+        if (name == NULL)
+        {
+                snprintf(unknown, sizeof(unknown), "State %lld",
+                         (long long) value);
+                name = unknown;
+        }
+        ptt_chromebegin(c, "X", task, thread, begin);
+        fprintf(c->output, ",\"dur\":%llu.%03u,\"cat\":\"State\",\"name\":",
+                (unsigned long long) ((end - begin) / 1000),
+                (unsigned) ((end - begin) % 1000));
+        ptt_chromestring(c->output, name);
+        fprintf(c->output, "}");
+}
+
+
+/*
+ * Write a communication as a pair of instant events joined by a flow.
+ */
+void ptt_chromecomm (struct ptt_chrome *c, int task, int thread, uint64_t sendns,
+                     int peertask, int peer, uint64_t recvns, int64_t tag,
+                     int64_t size)
+{
+        c->flows++;
+        ptt_chromebegin(c, "i", task, thread, sendns);
+        fprintf(c->output, ",\"s\":\"t\",\"name\":\"Send\","
+                "\"cat\":\"Communication\",\"args\":{\"tag\":%lld,"
+                "\"size\":%lld}}", (long long) tag, (long long) size);
+        ptt_chromebegin(c, "s", task, thread, sendns);
+        fprintf(c->output, ",\"id\":%llu,\"name\":\"Communication\","
+                "\"cat\":\"Communication\"}", (unsigned long long) c->flows);
+        ptt_chromebegin(c, "i", peertask, peer, recvns);
+        fprintf(c->output, ",\"s\":\"t\",\"name\":\"Receive\","
+                "\"cat\":\"Communication\",\"args\":{\"tag\":%lld,"
+                "\"size\":%lld}}", (long long) tag, (long long) size);
+        ptt_chromebegin(c, "f", peertask, peer, recvns);
+        fprintf(c->output, ",\"bp\":\"e\",\"id\":%llu,"
+                "\"name\":\"Communication\",\"cat\":\"Communication\"}",
+                (unsigned long long) c->flows);
+}
+
+
+/*
+ * Finish the trace and release the writer.  The stream is left open.
+ */
+void ptt_chromeclose (struct ptt_chrome *c)
+{
+        int i;
+
+        fprintf(c->output, "\n]}\n");
+        for (i = 0;  i < c->typecount;  i++)
+                free(c->types[i].name);
+        for (i = 0;  i < c->valuecount;  i++)
+                free(c->values[i].name);
+        free(c->types);
+        free(c->values);
+        free(c);
+}
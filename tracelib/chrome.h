@@ -0,0 +1,35 @@
+/*
+ * chrome.h - Chrome trace event format writer, shared with the offline tools
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#ifndef __ptt_chrome
+#define __ptt_chrome
+
+/*
+ * The writer is used both by the post processor and by "ptt-merge", so it
+ * does not depend on the private header.  Tasks and threads are numbered from
+ * one, as in Paraver, and times are given in nanoseconds.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+struct ptt_chrome;
+
+struct ptt_chrome *ptt_chromeopen    (FILE *, const char *);
+void               ptt_chromeprocess (struct ptt_chrome *, int, const char *);
+void               ptt_chromethread  (struct ptt_chrome *, int, int,
+                                      const char *);
+void               ptt_chromeevent   (struct ptt_chrome *, int, int, uint64_t,
+                                      int, int64_t, const char *);
+void               ptt_chromestate   (struct ptt_chrome *, int, int, uint64_t,
+                                      uint64_t, int64_t);
+void               ptt_chromecomm    (struct ptt_chrome *, int, int, uint64_t,
+                                      int, int, uint64_t, int64_t, int64_t);
+void               ptt_chromeclose   (struct ptt_chrome *);
+
+#endif /* __ptt_chrome */
@@ -0,0 +1,117 @@
+/*
+ * columns.c - Columnar event dataset sidecar
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * Analysing a trace usually means going through millions of events looking at
+ * one or two of their fields.  Parsing the .prv text for that is slow, so when
+ * PTT_COLUMNS is set to non zero the post processor also stores every event it
+ * merges in a columnar dataset: one binary file per field, which can be mapped
+ * in memory and scanned directly (see "formats.h" for the layout, and the
+ * reader in the "tools" directory).
+ *
+ * The columns are streamed during the merge.  The ".col" file, which includes
+ * the PCF contents, is written at the end, once the PCF file is complete.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PTT_COLUMN_BUFFER  (256 * 1024)
+
+
+static const char *ColumnName[4] = { "time", "thread", "type", "value" };
+static FILE *Column[4];
+static uint64_t ColumnCount;
+
+
+/*
+ * Create the column files of a trace.
+ */
+void ptt_columninit (const char *trace)
+{
+        char filename[256];
+        int c, e;
+
+        for (c = 0;  c < 4;  c++)
+        {
+                snprintf(filename, 255, "%s.%s", trace, ColumnName[c]);
+                Column[c] = fopen(filename, "w");
+                ptt_assert(Column[c] != NULL);
+                e = setvbuf(Column[c], NULL, _IOFBF, PTT_COLUMN_BUFFER);
+                ptt_assert(e == 0);
+        }
+        ColumnCount = 0;
+}
+
+
+void ptt_columnevent (int thread, uint64_t ns, int type, int value)
+{
+        uint32_t th = thread + 1;
+        int32_t ty = type, va = value;
+        size_t e;
+
+        e = fwrite(&ns, sizeof(ns), 1, Column[0]);
+        ptt_assert(e == 1);
+        e = fwrite(&th, sizeof(th), 1, Column[1]);
+        ptt_assert(e == 1);
+        e = fwrite(&ty, sizeof(ty), 1, Column[2]);
+        ptt_assert(e == 1);
+        e = fwrite(&va, sizeof(va), 1, Column[3]);
+        ptt_assert(e == 1);
+        ColumnCount++;
+}
+
+
+/*
+ * Close the columns and write the ".col" file, copying the PCF file of the
+ * trace into it.
+ */
+void ptt_columnwrite (const char *trace, uint64_t duration)
+{
+        struct ptt_columnheader header;
+        char filename[256], chunk[4096];
+        FILE *output, *pcf;
+        size_t n, e;
+        int c;
+
+        for (c = 0;  c < 4;  c++)
+        {
+                e = fclose(Column[c]);
+                ptt_assert(e == 0);
+        }
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, PTT_COLUMNS_MAGIC, 8);
+        header.duration = duration;
+        header.count = ColumnCount;
+        header.threads = PttGlobal.postcount;
+
+        snprintf(filename, 255, "%s.pcf", trace);
+        pcf = fopen(filename, "r");
+        ptt_assert(pcf != NULL);
+        fseek(pcf, 0, SEEK_END);
+        header.pcfsize = ftell(pcf);
+        rewind(pcf);
+
+        snprintf(filename, 255, "%s.col", trace);
+        output = fopen(filename, "w");
+        ptt_assert(output != NULL);
+        e = fwrite(&header, sizeof(header), 1, output);
+        ptt_assert(e == 1);
+        while ((n = fread(chunk, 1, sizeof(chunk), pcf)) > 0)
+        {
+                e = fwrite(chunk, 1, n, output);
+                ptt_assert(e == n);
+        }
+        fclose(pcf);
+        e = fclose(output);
+        ptt_assert(e == 0);
+}
@@ -0,0 +1,228 @@
+/*
+ * comm.c - Pairing of send and receive events into communications
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * Each ptt_send() and ptt_recv() call leaves two events in the thread trace:
+ * the operation with the tag as value, and the size.  While merging, the post
+ * processor hands them here, where pending operations are kept in a hash
+ * table by tag.  When the counterpart of a pending operation shows up, the
+ * communication is complete and can be written.
+ *
+ * Receives are normally recorded after their sends, but clock skew among
+ * processors could invert the order, so pending receives are kept as well.
+ * Operations with the same tag are matched in order of appearance.
+ *
+ * Communication records are written at the time of their send, so pending
+ * sends hold back the records after them (see "reorder.c").  They are also
+ * kept in a list sorted by time, to tell the earliest one.  Sends pending for
+ * longer than the reordering window are given up: if their receive shows up
+ * later on, the communication is dropped.
+ */
+
+#include <stdlib.h>
+
+#define PTT_COMM_BUCKETS  4096
+
+
+struct ptt_pending
+{
+        int tag;
+        int send;  /* Whether it is a send or a receive */
+        int thread;
+        int size;
+        int late;  /* Given up, written no more */
+        uint64_t ns;
+        struct ptt_pending *next;
+        struct ptt_pending *older;  /* Pending sends, in time order */
+        struct ptt_pending *newer;
+};
+
+/* Operation waiting for its size event, per thread */
+struct ptt_opening
+{
+        int type;
+        int tag;
+        uint64_t ns;
+};
+
+
+static struct ptt_pending *Pending[PTT_COMM_BUCKETS];
+static struct ptt_opening *Opening;
+static struct ptt_pending *Oldest;
+static struct ptt_pending *Newest;
+static unsigned long Unmatched;
+static unsigned long Dropped;
+static int Threads;
+
+
+void ptt_comminit (int threads)
+{
+        Opening = calloc(threads, sizeof(struct ptt_opening));
+        ptt_assert(Opening != NULL);
+        Threads = threads;
+        Oldest = NULL;
+        Newest = NULL;
+        Dropped = 0;
+}
+
+
+static void ptt_communlink (struct ptt_pending *p)
+{
+        if (p->older != NULL)
+                p->older->newer = p->newer;
+        else
+                Oldest = p->newer;
+        if (p->newer != NULL)
+                p->newer->older = p->older;
+        else
+                Newest = p->older;
+}
+
+
+/*
+ * Earliest time of a communication record yet to be completed.
+ */
+uint64_t ptt_commhold (void)
+{
+        uint64_t hold = Oldest != NULL ? Oldest->ns : UINT64_MAX;
+        int i;
+
+        for (i = 0;  i < Threads;  i++)
+                if (Opening[i].type == PTT_SEND_EVENT && Opening[i].ns < hold)
+                        hold = Opening[i].ns;
+        return hold;
+}
+
+
+/*
+ * Give up on the sends still pending.
+ */
+void ptt_commexpire (void)
+{
+        while (Oldest != NULL)
+        {
+                Oldest->late = 1;
+                Oldest = Oldest->newer;
+        }
+        Newest = NULL;
+}
+
+
+/*
+ * Feed a communication event.  Return non zero when a communication has been
+ * completed, in which case it is stored in "comm".
+ */
+int ptt_commevent (int thread, uint64_t ns, int type, int value,
+                   struct ptt_comm *comm)
+{
+        struct ptt_opening *op = &Opening[thread];
+        struct ptt_pending *p, **pp;
+        int send;
+
+        if (type != PTT_SIZE_EVENT)
+        {
+                op->type = type;
+                op->tag = value;
+                op->ns = ns;
+                return 0;
+        }
+        if (op->type == 0)
+                return 0;
+
+        /* Look for the oldest counterpart with the same tag */
+        send = op->type == PTT_SEND_EVENT;
+        pp = &Pending[(unsigned int) op->tag % PTT_COMM_BUCKETS];
+        while (*pp != NULL && ((*pp)->tag != op->tag || (*pp)->send == send))
+                pp = &(*pp)->next;
+        p = *pp;
+
+        /* None, so this one becomes pending, at the end of the chain */
+        if (p == NULL)
+        {
+                p = malloc(sizeof(struct ptt_pending));
+                ptt_assert(p != NULL);
+                p->tag = op->tag;
+                p->send = send;
+                p->thread = thread;
+                p->size = value;
+                p->late = 0;
+                p->ns = op->ns;
+                p->next = NULL;
+                *pp = p;
+                op->type = 0;
+                if (send)
+                {
+                        p->older = Newest;
+                        p->newer = NULL;
+                        if (Newest != NULL)
+                                Newest->newer = p;
+                        else
+                                Oldest = p;
+                        Newest = p;
+                }
+                return 0;
+        }
+
+        *pp = p->next;
+        op->type = 0;
+        if (!send && p->late)
+        {
+                free(p);
+                Dropped++;
+                return 0;
+        }
+        if (!send)
+                ptt_communlink(p);
+
+        comm->tag = op->tag;
+        if (send)
+        {
+                comm->sender = thread;
+                comm->sendns = op->ns;
+                comm->receiver = p->thread;
+                comm->recvns = p->ns;
+                comm->size = value;
+        }
+        else
+        {
+                comm->sender = p->thread;
+                comm->sendns = p->ns;
+                comm->receiver = thread;
+                comm->recvns = op->ns;
+                comm->size = p->size;
+        }
+        free(p);
+        return 1;
+}
+
+
+/*
+ * Discard whatever remains unmatched.
+ */
+void ptt_commfini (void)
+{
+        struct ptt_pending *p;
+        int i;
+
+        for (i = 0;  i < PTT_COMM_BUCKETS;  i++)
+        {
+                while (Pending[i] != NULL)
+                {
+                        p = Pending[i];
+                        Pending[i] = p->next;
+                        free(p);
+                        Unmatched++;
+                }
+        }
+        free(Opening);
+        ptt_debug("%lu unmatched communication operations", Unmatched);
+        ptt_debug("%lu communications dropped", Dropped);
+}
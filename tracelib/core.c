@@ -28,6 +28,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 /* Global variables instantiation */
@@ -40,32 +41,46 @@ struct _PTT_GlobalScope PttGlobal;
  */
 void ptt_init (void)
 {
-        struct ptt_threadbuf *tb;
-        char *prefix;
-        int e, i, l;
+        int e;
 
 #ifdef DEBUG
         setlinebuf(stderr);
 #endif
         /* Create/initialize global state */
         PttGlobal.processid = getpid();
+        PttGlobal.parentid = 0;
         PttGlobal.threadcount = 0;
         pthread_mutex_init(&PttGlobal.countlock, NULL);
         pthread_mutex_init(&PttGlobal.tlslock, NULL);
         e = pthread_key_create(&PttGlobal.tlskey, ptt_endthread);
         ptt_assert(e == 0);
+        e = pthread_atfork(ptt_prefork, ptt_postfork, ptt_childfork);
+        ptt_assert(e == 0);
+
+#ifdef PTT_IOWRAP
+        ptt_ioinit();
+#endif
+#ifdef PTT_MALLOCWRAP
+        ptt_mallocinit();
+#endif
+        PttGlobal.cputime = getenv("PTT_CPUTIME") != NULL &&
+                            atoi(getenv("PTT_CPUTIME")) != 0;
+        PttGlobal.cputype = getenv("PTT_CPUTIME_TYPE") != NULL ?
+                            atoi(getenv("PTT_CPUTIME_TYPE")) : PttStateType;
+        PttGlobal.fold = getenv("PTT_FOLD") != NULL &&
+                         atoi(getenv("PTT_FOLD")) != 0;
+        ptt_sampleinit();
+        ptt_functioninit();
+        ptt_overheadinit();
 
         /* Mark the start of the trace globally */
         PttGlobal.startstamp = ptt_getticks();
         gettimeofday(&PttGlobal.starttime, NULL);
+        ptt_rotateinit();
 
         /* Initialize the main thread manually because no pthread_create() call
          * could be intercepted yet */
-        tb = malloc(sizeof(struct ptt_threadbuf));
-        ptt_assert(tb != NULL);
-        tb->function = NULL;
-        tb->parameter = NULL;
-        ptt_startthread(tb);
+        ptt_startthread(NULL);
 }
 
 
@@ -77,11 +92,21 @@ void ptt_fini (void)
 {
         void *tb;
 
+        /* The pool threads finish before the main one, see "pool.c" */
+        ptt_poolstop();
+
         /* Finish the main thread manually, as the key destructor is not called
          * automatically in this case */
         tb = pthread_getspecific(PttGlobal.tlskey);
         if (tb != NULL)
+        {
+                pthread_setspecific(PttGlobal.tlskey, NULL);
                 ptt_endthread(tb);
+        }
+
+        /* Write the pending parts, the rest of the trace is the last one */
+        if (PttGlobal.rotate)
+                ptt_rotatestop();
 
         /* Mark the end of the trace globally */
         gettimeofday(&PttGlobal.endtime, NULL);
@@ -92,15 +117,179 @@ void ptt_fini (void)
 }
 
 
+/*
+ * Process creation handlers, registered with pthread_atfork().  The library
+ * locks are held across fork() so the child never inherits them in the middle
+ * of a critical section.
+ */
+void ptt_prefork (void)
+{
+        pthread_mutex_lock(&PttGlobal.countlock);
+        pthread_mutex_lock(&PttGlobal.tlslock);
+}
+
+void ptt_postfork (void)
+{
+        pthread_mutex_unlock(&PttGlobal.tlslock);
+        pthread_mutex_unlock(&PttGlobal.countlock);
+}
+
+
+/*
+ * The child process starts a trace of its own, with the forking thread as its
+ * only thread.  Events still buffered belong to the parent, which will flush
+ * them, so they are discarded here together with the inherited trace file.
+ *
+ * The start of the trace is inherited, though.  This way the traces of all
+ * the processes share the same time origin and can be combined later with the
+ * "ptt-merge" tool.  Note that a child calling exec() loses its trace, as the
+ * process never finishes from the tracing library point of view.
+ */
+void ptt_childfork (void)
+{
+        struct ptt_threadbuf *tb;
+        char filename[48];
+        int e;
+
+        pthread_mutex_init(&PttGlobal.countlock, NULL);
+        pthread_mutex_init(&PttGlobal.tlslock, NULL);
+
+        PttGlobal.parentid = PttGlobal.processid;
+        PttGlobal.processid = getpid();
+        PttGlobal.threadcount = 1;
+        ptt_rotatefork();
+        ptt_poolfork();
+
+        tb = pthread_getspecific(PttGlobal.tlskey);
+        if (tb == NULL)
+                return;
+
+        e = close(tb->tracefile);
+        ptt_assert(e != -1);
+        tb->thread = 0;
+        if (PttGlobal.rotate)
+                ptt_rotatestart(tb);
+        ptt_threadfile(filename, 1, tb->segment);
+        tb->tracefile = ptt_open(filename, O_CREAT | O_WRONLY, 00600);
+        ptt_assert(tb->tracefile != -1);
+
+        tb->events[0].timestamp = ptt_getticks();
+        tb->events[0].type = PTT_PHASE_EVENT;
+        tb->events[0].value = 1;
+        tb->eventcount = 1;
+        if (tb->fold != NULL)
+                ptt_foldreset(tb->fold);
+#ifdef PTT_MALLOCWRAP
+        ptt_mallocfork(tb);
+#endif
+        if (PttGlobal.cputime)
+                ptt_cpustart(tb);
+        if (PttGlobal.sampleperiod > 0)
+                ptt_samplestart(tb);  /* Timers are not inherited */
+}
+
+
+/*
+ * Name of the temporary trace of a thread, counting from one, within a segment
+ * of the trace (see "rotate.c").  The buffer must hold 48 characters.
+ */
+void ptt_threadfile (char *filename, int thread, int segment)
+{
+        if (segment == 0)
+                snprintf(filename, 48, "/tmp/ptt-%d-%04d.tt", PttGlobal.processid,
+                         thread);
+        else
+                snprintf(filename, 48, "/tmp/ptt-%d-%04d.%d.tt",
+                         PttGlobal.processid, thread, segment);
+}
+
+
+/*
+ * Allocate the event buffer of the calling thread.  Doing it from the thread
+ * itself, and touching the memory right away, makes the kernel place it on the
+ * thread's local NUMA node under the default first touch policy.  The buffer
+ * is aligned to a cache line or, if it is large enough, to a page.
+ */
+static struct ptt_threadbuf *ptt_allocthreadbuf (void)
+{
+        struct ptt_threadbuf *tb;
+        size_t align;
+        void *p;
+        int e;
+
+        align = sysconf(_SC_PAGESIZE);
+        if (sizeof(struct ptt_threadbuf) < align)
+                align = PTT_CACHE_LINE;
+
+        e = pthread_mutex_lock(&PttGlobal.tlslock);
+        ptt_assert(e == 0);
+        /* Begin critical section */
+        e = posix_memalign(&p, align, sizeof(struct ptt_threadbuf));
+        ptt_assert(e == 0);
+        /* End critical section */
+        e = pthread_mutex_unlock(&PttGlobal.tlslock);
+        ptt_assert(e == 0);
+
+        tb = p;
+        memset(tb, 0, sizeof(struct ptt_threadbuf));
+        return tb;
+}
+
+
+/*
+ * Convert nanoseconds to clock ticks, for thresholds given by the user.  The
+ * clock rate is measured the first time, for a millisecond.  Only to be used
+ * during initialization.
+ */
+uint64_t ptt_nstoticks (uint64_t ns)
+{
+        struct timeval t0, t1;
+        uint64_t s0, s1;
+
+        if (ns == 0)
+                return 0;
+
+        if (PttGlobal.tickrate == 0.0)
+        {
+                gettimeofday(&t0, NULL);
+                s0 = ptt_getticks();
+                do
+                        gettimeofday(&t1, NULL);
+                while ((t1.tv_sec - t0.tv_sec) * 1000000 + t1.tv_usec -
+                       t0.tv_usec < 1000);
+                s1 = ptt_getticks();
+                PttGlobal.tickrate = (double) (s1 - s0) /
+                                     ((double) ((t1.tv_sec - t0.tv_sec) * 1000000 +
+                                                t1.tv_usec - t0.tv_usec) * 1000.0);
+        }
+        return (uint64_t) ((double) ns * PttGlobal.tickrate);
+}
+
+
 /*
  * Prepare structures to trace the current thread.  This is a proxy function
  * intended to intercept thread creation, called from our special pthread_create
- * wrapper.
+ * wrapper.  The argument holds the user function to be called, or it is NULL
+ * for the main thread.
  */
-void *ptt_startthread (void *threadbuf)
+void *ptt_startthread (void *threadstart)
 {
-        struct ptt_threadbuf *tb = threadbuf;
-        int tid, e;
+        struct ptt_threadstart *ts = threadstart;
+        struct ptt_threadbuf *tb;
+        void *(*function)(void *) = NULL;
+        void *parameter = NULL;
+        int tid, parent = 0, e;
+
+        if (ts != NULL)
+        {
+                function = ts->function;
+                parameter = ts->parameter;
+                parent = ts->parent;
+                free(ts);
+        }
+        tb = ptt_allocthreadbuf();
+        if (PttGlobal.fold)
+                tb->fold = ptt_foldopen();
 
         e = pthread_mutex_lock(&PttGlobal.countlock);
         ptt_assert(e == 0);
@@ -111,6 +300,9 @@ void *ptt_startthread (void *threadbuf)
         e = pthread_mutex_unlock(&PttGlobal.countlock);
         ptt_assert(e == 0);
 
+        tb->thread = tid;
+        if (PttGlobal.rotate)
+                ptt_rotatestart(tb);
         e = pthread_setspecific(PttGlobal.tlskey, tb);
         ptt_assert(e == 0);
 
@@ -118,11 +310,10 @@ void *ptt_startthread (void *threadbuf)
          * in a nested block so the stack space is released prior to calling the
          * thread function */
         {
-                char filename[32];
+                char filename[48];
 
-                snprintf(filename, 31, "/tmp/ptt-%d-%04d.tt",
-                         PttGlobal.processid, tid + 1);
-                tb->tracefile = open(filename, O_CREAT | O_WRONLY, 00600);
+                ptt_threadfile(filename, tid + 1, tb->segment);
+                tb->tracefile = ptt_open(filename, O_CREAT | O_WRONLY, 00600);
                 ptt_assert(tb->tracefile != -1);
         }
 
@@ -130,8 +321,19 @@ void *ptt_startthread (void *threadbuf)
         tb->events[0].type = PTT_PHASE_EVENT;
         tb->events[0].value = 1;
         tb->eventcount = 1;
+        if (parent > 0)
+        {
+                tb->events[1].timestamp = tb->events[0].timestamp;
+                tb->events[1].type = PTT_PARENT_EVENT;
+                tb->events[1].value = parent;
+                tb->eventcount = 2;
+        }
+        if (PttGlobal.cputime)
+                ptt_cpustart(tb);
+        if (PttGlobal.sampleperiod > 0)
+                ptt_samplestart(tb);
 
-        return tb->function != NULL ? tb->function(tb->parameter) : NULL;
+        return function != NULL ? function(parameter) : NULL;
 }
 
 
@@ -144,6 +346,22 @@ void ptt_endthread (void *threadbuf)
         struct ptt_threadbuf *tb = threadbuf;
         int e, i;
 
+        /* No more samples, the buffer is about to go away */
+        ptt_enter(tb);
+        if (PttGlobal.sampleperiod > 0)
+                ptt_samplestop(tb);
+        ptt_functionend(tb);
+
+#ifdef PTT_IOWRAP
+        /* Account the small I/O calls still pending */
+        ptt_reserve(tb, 2);
+        ptt_iocalls(tb, ptt_getticks());
+#endif
+        if (PttGlobal.cputime)
+        {
+                ptt_reserve(tb, 3);
+                ptt_cpusample(tb, ptt_getticks());
+        }
         i = tb->eventcount;
         tb->eventcount++;
         tb->events[i].timestamp = ptt_getticks();
@@ -151,11 +369,13 @@ void ptt_endthread (void *threadbuf)
         tb->events[i].value = 0;
 
         /* Final trace flush, not traced like the previous ones */
-        e = write(tb->tracefile, tb->events, tb->eventcount *
-                                             sizeof(struct ptt_event));
-        ptt_assert(e == tb->eventcount * sizeof(struct ptt_event));
+        ptt_store(tb);
+        if (tb->fold != NULL)
+                ptt_foldclose(tb->fold, tb->tracefile);
         e = close(tb->tracefile);
         ptt_assert(e != -1);
+        if (PttGlobal.rotate)
+                ptt_rotateend(tb);
 
         e = pthread_mutex_lock(&PttGlobal.tlslock);
         ptt_assert(e == 0);
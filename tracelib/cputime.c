@@ -0,0 +1,143 @@
+/*
+ * cputime.c - Thread CPU time and context switch sampling
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define _GNU_SOURCE  /* RUSAGE_THREAD */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * Time stamps tell when something happened, but not whether the thread was
+ * actually running in between.  When PTT_CPUTIME is set, the CPU time consumed
+ * by each thread and its voluntary and involuntary context switches are
+ * sampled after every flush, at the changes of a given event type and when the
+ * thread finishes.  That type is the one given in PTT_CPUTIME_TYPE, which
+ * defaults to the state event type of the program (see ptt_event()), so that
+ * regions can be sampled even if the program defines no states.  Each sample
+ * is written as three events with the increments since the previous sample:
+ * CPU time in microseconds and both context switch counts.
+ *
+ * While merging, the post processor divides each CPU time increment by the
+ * elapsed time since the previous sample of the same thread, giving the
+ * fraction of time the thread was on a CPU, in thousandths.  Fractions well
+ * below one for threads that should be computing mean they are waiting for a
+ * CPU, i.e. too many threads for the available processors.
+ */
+
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+/*
+ * Take the reference values of the calling thread, without writing anything.
+ */
+void ptt_cpustart (struct ptt_threadbuf *tb)
+{
+        struct timespec cpu;
+        struct rusage ru;
+        int e;
+
+        e = clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        ptt_assert(e == 0);
+        e = getrusage(RUSAGE_THREAD, &ru);
+        ptt_assert(e == 0);
+
+        tb->cputime = (uint64_t) cpu.tv_sec * 1000000000ULL + cpu.tv_nsec;
+        tb->volcsw = ru.ru_nvcsw;
+        tb->invcsw = ru.ru_nivcsw;
+}
+
+
+/*
+ * Write a sample of the calling thread at time stamp "ts".  Room for three
+ * events must have been reserved.
+ */
+void ptt_cpusample (struct ptt_threadbuf *tb, uint64_t ts)
+{
+        struct timespec cpu;
+        struct rusage ru;
+        uint64_t us;
+        int e, i;
+
+        e = clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        ptt_assert(e == 0);
+        e = getrusage(RUSAGE_THREAD, &ru);
+        ptt_assert(e == 0);
+
+        /* The remainder below the microsecond goes to the next sample */
+        us = ((uint64_t) cpu.tv_sec * 1000000000ULL + cpu.tv_nsec -
+              tb->cputime) / 1000;
+        tb->cputime += us * 1000;
+
+        i = tb->eventcount;
+        tb->eventcount += 3;
+        tb->events[i].timestamp = ts;
+        tb->events[i].type = PTT_CPU_EVENT;
+        tb->events[i].value = us;
+        i++;
+        tb->events[i].timestamp = ts;
+        tb->events[i].type = PTT_VOLCSW_EVENT;
+        tb->events[i].value = ru.ru_nvcsw - tb->volcsw;
+        i++;
+        tb->events[i].timestamp = ts;
+        tb->events[i].type = PTT_INVCSW_EVENT;
+        tb->events[i].value = ru.ru_nivcsw - tb->invcsw;
+
+        tb->volcsw = ru.ru_nvcsw;
+        tb->invcsw = ru.ru_nivcsw;
+}
+
+
+/*
+ * Post processing side.  The time of the previous sample of each thread, or of
+ * its first event, is all that needs to be remembered.
+ */
+static uint64_t *Previous;
+static char *Started;
+
+
+void ptt_cpuinit (int threads)
+{
+        Previous = calloc(threads, sizeof(uint64_t));
+        Started = calloc(threads, sizeof(char));
+        ptt_assert(Previous != NULL && Started != NULL);
+}
+
+
+/*
+ * Feed a merged event.  Return the on CPU fraction, in thousandths, for CPU
+ * time events, or -1 for anything else.
+ */
+int ptt_cpuevent (int thread, uint64_t ns, int type, int value)
+{
+        uint64_t elapsed;
+        int fraction;
+
+        if (!Started[thread])
+        {
+                Started[thread] = 1;
+                Previous[thread] = ns;
+        }
+        if (type != PTT_CPU_EVENT)
+                return -1;
+
+        elapsed = ns - Previous[thread];
+        Previous[thread] = ns;
+        if (elapsed == 0)
+                return -1;
+        fraction = (int) ((uint64_t) value * 1000000ULL / elapsed);
+        return fraction > 1000 ? 1000 : fraction;
+}
+
+
+void ptt_cpufini (void)
+{
+        free(Previous);
+        free(Started);
+}
@@ -47,25 +47,117 @@
  *      #define FINISH  0
  *
  * Notice how easy is to produce a clash among the constants.  Therefore, it is
- * the main limitation of the actual method.
+ * the main limitation of the actual method.  C++ sources get event types as
+ * classes instead, with their values nested in them (see "ptt.hpp").
  */
 
+#include <unistd.h>
 #include <stdarg.h>
 
 
+/* Maximum amount of events added after a flush */
+#define PTT_FLUSH_EVENTS  5
+
+
+/*
+ * Add the events corresponding to a flush that started at "fts" and has just
+ * finished.  Also a good moment to sample the thread CPU time, if requested.
+ */
+static void ptt_flushed (struct ptt_threadbuf *tb, uint64_t fts)
+{
+        int i;
+
+        i = tb->eventcount;
+        tb->eventcount += 2;
+
+        tb->events[i].timestamp = fts;
+        tb->events[i].type = PTT_PHASE_EVENT;
+        tb->events[i].value = 2;
+        i++;
+        tb->events[i].timestamp = ptt_getticks();
+        tb->events[i].type = PTT_PHASE_EVENT;
+        tb->events[i].value = 1;
+
+        if (PttGlobal.cputime)
+                ptt_cpusample(tb, tb->events[i].timestamp);
+}
+
+
+/*
+ * Flush the buffer of the calling thread to disk, leaving the corresponding
+ * events at the beginning of the empty buffer.  Also used by other parts of
+ * the library to make room for several events at once.
+ */
+void ptt_flush (struct ptt_threadbuf *tb)
+{
+        uint64_t fts;  /* fts ---> flush time stamp */
+
+        fts = ptt_getticks();
+        if (ptt_store(tb))
+                ptt_flushed(tb, fts);
+}
+
+
+/*
+ * Empty the buffer, moving its events to the trace file or, if enabled, to the
+ * folding encoder.  Return non zero if the trace file was written, so that the
+ * caller knows whether the flush events are due.  The time stamp of the last
+ * event is kept, for callers which need it with the buffer empty.
+ */
+int ptt_store (struct ptt_threadbuf *tb)
+{
+        int e, n = 0, written = 1;
+
+        if (tb->eventcount > 0)
+                tb->laststamp = tb->events[tb->eventcount - 1].timestamp;
+
+        /* Events before a cut may belong to the previous part */
+        if (PttGlobal.rotate)
+                n = ptt_rotatestore(tb);
+
+        if (tb->fold != NULL)
+        {
+                written = ptt_fold(tb->fold, tb->tracefile, tb->events + n,
+                                   tb->eventcount - n);
+        }
+        else
+        {
+                e = ptt_write(tb->tracefile, tb->events + n,
+                              (tb->eventcount - n) * sizeof(struct ptt_event));
+                ptt_assert(e == (tb->eventcount - n) * sizeof(struct ptt_event));
+        }
+        tb->eventcount = 0;
+        return written;
+}
+
+
+/*
+ * Make sure there is room for "count" more events in the buffer, so that it
+ * is not full after adding them.  Return the index of the first free event.
+ */
+int ptt_reserve (struct ptt_threadbuf *tb, int count)
+{
+        if (tb->eventcount + count >= PTT_BUFFER_SIZE)
+                ptt_flush(tb);
+        return tb->eventcount;
+}
+
+
 /*
  * Add a single event using the given type and value.  The time stamp is added
- * automatically.
+ * automatically, once the buffer has been claimed, so that a sample can not
+ * sneak in with a later time stamp.
  */
 void ptt_event (int type, int value)
 {
         struct ptt_threadbuf *tb;
-        int e, i;
-        uint64_t ts, fts;  /* fts ---> flush time stamp */
+        int i;
+        uint64_t ts;
 
-        ts = ptt_getticks();
         tb = pthread_getspecific(PttGlobal.tlskey);
         ptt_assert(tb != NULL);
+        ptt_enter(tb);
+        ts = ptt_getticks();
 
         i = tb->eventcount;
         tb->eventcount++;
@@ -76,20 +168,15 @@ void ptt_event (int type, int value)
 
         /* Flush if necessary, with its corresponding events */
         if (tb->eventcount == PTT_BUFFER_SIZE)
+                ptt_flush(tb);
+
+        /* Region boundaries are also a good moment to sample the CPU time */
+        if (PttGlobal.cputime && type == PttGlobal.cputype)
         {
-                fts = ptt_getticks();
-                e = write(tb->tracefile, tb->events, PTT_BUFFER_SIZE *
-                                                     sizeof(struct ptt_event));
-                ptt_assert(e == PTT_BUFFER_SIZE * sizeof(struct ptt_event));
-
-                tb->events[0].timestamp = fts;
-                tb->events[0].type = PTT_PHASE_EVENT;
-                tb->events[0].value = 2;
-                tb->events[1].timestamp = ptt_getticks();
-                tb->events[1].type = PTT_PHASE_EVENT;
-                tb->events[1].value = 1;
-                tb->eventcount = 2;
+                ptt_reserve(tb, 3);
+                ptt_cpusample(tb, ptt_getticks());
         }
+        ptt_leave(tb);
 }
 
 
@@ -103,12 +190,14 @@ void ptt_events (int count, ...)
 {
         struct ptt_threadbuf *tb;
         va_list eventlist;
-        int e, i, l, fc = 0;   /* fc ---> flush count */
+        int i, l, fc = 0;      /* fc ---> flush count */
+        int boundary = 0;      /* Whether a region boundary is among them */
         uint64_t ts, fts = 0;  /* fts ---> flush time stamp */
 
-        ts = ptt_getticks();
         tb = pthread_getspecific(PttGlobal.tlskey);
         ptt_assert(tb != NULL);
+        ptt_enter(tb);
+        ts = ptt_getticks();
 
         va_start(eventlist, count);
         while (count > 0)
@@ -122,6 +211,7 @@ void ptt_events (int count, ...)
                         tb->events[i].timestamp = ts;
                         tb->events[i].type = va_arg(eventlist, int);
                         tb->events[i].value = va_arg(eventlist, int);
+                        boundary |= tb->events[i].type == PttGlobal.cputype;
                 }
                 count -= l - tb->eventcount;
                 tb->eventcount = l;
@@ -130,11 +220,7 @@ void ptt_events (int count, ...)
                 {
                         if (fc == 0)
                                 fts = ptt_getticks();
-                        fc++;
-                        e = write(tb->tracefile, tb->events, PTT_BUFFER_SIZE *
-                                                             sizeof(struct ptt_event));
-                        ptt_assert(e == PTT_BUFFER_SIZE * sizeof(struct ptt_event));
-                        tb->eventcount = 0;
+                        fc += ptt_store(tb);
                 }
         }
         va_end(eventlist);
@@ -142,25 +228,63 @@ void ptt_events (int count, ...)
         /* If we performed any flush, add the corresponding events */
         if (fc > 0)
         {
-                /* Flush again if the two events do not fit in the buffer */
-                if (tb->eventcount + 2 >= PTT_BUFFER_SIZE)
-                {
-                        e = write(tb->tracefile, tb->events, tb->eventcount *
-                                                             sizeof(struct ptt_event));
-                        ptt_assert(e == tb->eventcount * sizeof(struct ptt_event));
-                        tb->eventcount = 0;
-                }
+                /* Flush again if those events do not fit in the buffer */
+                if (tb->eventcount + PTT_FLUSH_EVENTS >= PTT_BUFFER_SIZE)
+                        ptt_store(tb);
 
-                i = tb->eventcount;
-                tb->eventcount += 2;
+                ptt_flushed(tb, fts);
+        }
 
-                tb->events[i].timestamp = fts;
-                tb->events[i].type = PTT_PHASE_EVENT;
-                tb->events[i].value = 2;
-                i++;
-                tb->events[i].timestamp = ptt_getticks();
-                tb->events[i].type = PTT_PHASE_EVENT;
-                tb->events[i].value = 1;
+        /* Same CPU time sampling as ptt_event() */
+        if (PttGlobal.cputime && boundary)
+        {
+                ptt_reserve(tb, 3);
+                ptt_cpusample(tb, ptt_getticks());
         }
+        ptt_leave(tb);
 }
 
+
+/*
+ * Communication between threads.  The sender and the receiver record the same
+ * tag and the amount of bytes transferred, and the post processor pairs them
+ * into Paraver communication records.  Pairing is done in order: the first
+ * receive of a tag is matched with the first send of the same tag, and so on.
+ * Both events need to have the same time stamp, so room is made for them
+ * before reading the clock.
+ */
+static void ptt_communicate (int type, int tag, int size)
+{
+        struct ptt_threadbuf *tb;
+        int i;
+        uint64_t ts;
+
+        tb = pthread_getspecific(PttGlobal.tlskey);
+        ptt_assert(tb != NULL);
+        ptt_enter(tb);
+        i = ptt_reserve(tb, 2);
+        tb->eventcount += 2;
+
+        ts = ptt_getticks();
+
+        tb->events[i].timestamp = ts;
+        tb->events[i].type = type;
+        tb->events[i].value = tag;
+        i++;
+        tb->events[i].timestamp = ts;
+        tb->events[i].type = PTT_SIZE_EVENT;
+        tb->events[i].value = size;
+        ptt_leave(tb);
+}
+
+
+void ptt_send (int tag, int size)
+{
+        ptt_communicate(PTT_SEND_EVENT, tag, size);
+}
+
+
+void ptt_recv (int tag, int size)
+{
+        ptt_communicate(PTT_RECV_EVENT, tag, size);
+}
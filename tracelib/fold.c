@@ -0,0 +1,352 @@
+/*
+ * fold.c - Online folding of repetitive event streams
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * Iterative programs emit the same sequence of events over and over, where
+ * only the time stamps and some regularly changing values (loop indices, run
+ * numbers) differ.  When PTT_FOLD is set to non zero, every flushed buffer
+ * goes through a per thread encoder before reaching the trace file.
+ *
+ * The encoder looks for a period of up to PTT_FOLD_PERIOD events in which the
+ * last events repeat: each event has the same type as the event one period
+ * before, and its value differs from it as much as that one differed from the
+ * event two periods before.  Once the last three periods agree, the following
+ * events are folded: only the time elapsed since the previous event is stored
+ * for each, while types and values are rebuilt from the events one period
+ * before.  Any event breaking the pattern ends the fold.
+ *
+ * The encoded trace is kept in a per thread memory buffer and only written
+ * when that buffer is full, so threads also write much less often.  The trace
+ * file is a sequence of blocks, each one with a header:
+ *
+ *      - Literal blocks, followed by "count" events as they are.
+ *
+ *      - Repeat blocks, followed by "period" value differences and then by
+ *        "count" time stamp differences, all of them 32 bit integers.
+ *
+ * Thread traces are expanded back by the post processor before anything else
+ * happens to them.
+ */
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PTT_FOLD_PERIOD   16
+#define PTT_FOLD_HISTORY  64            /* Power of two, at least 3 periods */
+#define PTT_FOLD_BUFFER   (64 * 1024)
+
+enum
+{
+        PTT_FOLD_LITERAL = 0,
+        PTT_FOLD_REPEAT
+};
+
+struct ptt_foldblock
+{
+        uint32_t kind;
+        uint32_t count;   /* Events in the block */
+        uint32_t period;  /* Repeat blocks only */
+        uint32_t reserved;
+};
+
+struct ptt_fold
+{
+        uint64_t count;   /* Events seen */
+        uint64_t folded;  /* Events stored in repeat blocks */
+        int period;       /* Zero if not folding */
+        int phase;        /* Position within the period */
+        int32_t delta[PTT_FOLD_PERIOD];
+        size_t block;     /* Offset of the current block header */
+        size_t used;
+        struct ptt_event history[PTT_FOLD_HISTORY];
+        char buffer[PTT_FOLD_BUFFER];
+};
+
+
+#define ptt_foldpast(f, n)  (&(f)->history[((f)->count - (n)) & \
+                                           (PTT_FOLD_HISTORY - 1)])
+
+
+struct ptt_fold *ptt_foldopen (void)
+{
+        struct ptt_fold *f;
+
+        f = malloc(sizeof(struct ptt_fold));
+        ptt_assert(f != NULL);
+        ptt_foldreset(f);
+        return f;
+}
+
+
+/*
+ * Forget everything, for when the thread trace is started again.
+ */
+void ptt_foldreset (struct ptt_fold *f)
+{
+        f->count = 0;
+        f->folded = 0;
+        f->period = 0;
+        f->used = 0;
+        f->block = PTT_FOLD_BUFFER;  /* No block */
+}
+
+
+static void ptt_folddrain (struct ptt_fold *f, int fd)
+{
+        ssize_t e;
+
+        e = ptt_write(fd, f->buffer, f->used);
+        ptt_assert(e == (ssize_t) f->used);
+        f->used = 0;
+        f->block = PTT_FOLD_BUFFER;
+}
+
+
+/*
+ * Make sure the current block is of the given kind and has room for "size"
+ * more bytes, starting a new one if needed.  Return non zero if the buffer
+ * had to be written.
+ */
+static int ptt_foldroom (struct ptt_fold *f, int fd, int kind, size_t size)
+{
+        struct ptt_foldblock *b;
+        int written = 0, i;
+
+        if (f->block < f->used)
+        {
+                b = (struct ptt_foldblock *) (f->buffer + f->block);
+                if (b->kind == (uint32_t) kind && f->used + size <= PTT_FOLD_BUFFER)
+                        return 0;
+        }
+
+        size += sizeof(struct ptt_foldblock);
+        if (kind == PTT_FOLD_REPEAT)
+                size += f->period * sizeof(int32_t);
+        if (f->used + size > PTT_FOLD_BUFFER)
+        {
+                ptt_folddrain(f, fd);
+                written = 1;
+        }
+
+        f->block = f->used;
+        b = (struct ptt_foldblock *) (f->buffer + f->block);
+        b->kind = kind;
+        b->count = 0;
+        b->period = kind == PTT_FOLD_REPEAT ? f->period : 0;
+        b->reserved = 0;
+        f->used += sizeof(struct ptt_foldblock);
+
+        /* The differences start at the current phase */
+        if (kind == PTT_FOLD_REPEAT)
+                for (i = 0;  i < f->period;  i++)
+                {
+                        memcpy(f->buffer + f->used,
+                               &f->delta[(f->phase + i) % f->period],
+                               sizeof(int32_t));
+                        f->used += sizeof(int32_t);
+                }
+        return written;
+}
+
+
+/*
+ * Look for a period in which the last three repetitions agree.  If found, the
+ * fold starts with the next event.
+ */
+static void ptt_folddetect (struct ptt_fold *f)
+{
+        struct ptt_event *a, *b, *c;
+        int p, i;
+
+        for (p = 1;  p <= PTT_FOLD_PERIOD && 3 * (uint64_t) p <= f->count;  p++)
+        {
+                for (i = 1;  i <= p;  i++)
+                {
+                        a = ptt_foldpast(f, i);
+                        b = ptt_foldpast(f, i + p);
+                        c = ptt_foldpast(f, i + 2 * p);
+                        if (a->type != b->type || b->type != c->type ||
+                            (uint32_t) a->value - b->value !=
+                            (uint32_t) b->value - c->value)
+                                break;
+                }
+                if (i > p)
+                        break;
+        }
+        if (p > PTT_FOLD_PERIOD || 3 * (uint64_t) p > f->count)
+                return;
+
+        /* The next event repeats the one "p" events ago */
+        f->period = p;
+        f->phase = 0;
+        for (i = 0;  i < p;  i++)
+        {
+                a = ptt_foldpast(f, p - i);
+                b = ptt_foldpast(f, 2 * p - i);
+                f->delta[i] = (uint32_t) a->value - b->value;
+        }
+}
+
+
+/*
+ * Add an event to the encoded trace.  Return non zero if the buffer had to be
+ * written.
+ */
+static int ptt_foldevent (struct ptt_fold *f, int fd, struct ptt_event *ev)
+{
+        struct ptt_foldblock *b;
+        struct ptt_event *ref;
+        int64_t elapsed;
+        int32_t e32;
+        int written = 0;
+
+        if (f->period > 0)
+        {
+                ref = ptt_foldpast(f, f->period);
+                elapsed = (int64_t) (ev->timestamp -
+                                     ptt_foldpast(f, 1)->timestamp);
+                if (ev->type == ref->type &&
+                    (uint32_t) ev->value - ref->value ==
+                    (uint32_t) f->delta[f->phase] &&
+                    elapsed >= INT32_MIN && elapsed <= INT32_MAX)
+                {
+                        written = ptt_foldroom(f, fd, PTT_FOLD_REPEAT,
+                                               sizeof(int32_t));
+                        e32 = elapsed;
+                        memcpy(f->buffer + f->used, &e32, sizeof(e32));
+                        f->used += sizeof(e32);
+                        b = (struct ptt_foldblock *) (f->buffer + f->block);
+                        b->count++;
+                        f->phase = (f->phase + 1) % f->period;
+                        f->history[f->count & (PTT_FOLD_HISTORY - 1)] = *ev;
+                        f->count++;
+                        f->folded++;
+                        return written;
+                }
+                f->period = 0;
+        }
+
+        written = ptt_foldroom(f, fd, PTT_FOLD_LITERAL, sizeof(struct ptt_event));
+        memcpy(f->buffer + f->used, ev, sizeof(struct ptt_event));
+        f->used += sizeof(struct ptt_event);
+        b = (struct ptt_foldblock *) (f->buffer + f->block);
+        b->count++;
+        f->history[f->count & (PTT_FOLD_HISTORY - 1)] = *ev;
+        f->count++;
+        ptt_folddetect(f);
+        return written;
+}
+
+
+/*
+ * Encode some events of a thread.  Return non zero if the trace file was
+ * written.
+ */
+int ptt_fold (struct ptt_fold *f, int fd, struct ptt_event *events, int count)
+{
+        int written = 0, i;
+
+        for (i = 0;  i < count;  i++)
+                written |= ptt_foldevent(f, fd, &events[i]);
+        return written;
+}
+
+
+/*
+ * Write what is left, so that the encoding can start over in another file
+ * (see "rotate.c").
+ */
+void ptt_foldflush (struct ptt_fold *f, int fd)
+{
+        if (f->used > 0)
+                ptt_folddrain(f, fd);
+        ptt_debug("Folded %llu out of %llu events",
+                  (unsigned long long) f->folded, (unsigned long long) f->count);
+        ptt_foldreset(f);
+}
+
+
+/*
+ * Write what is left and release the encoder.
+ */
+void ptt_foldclose (struct ptt_fold *f, int fd)
+{
+        ptt_foldflush(f, fd);
+        free(f);
+}
+
+
+/*
+ * Turn the encoded trace of a thread, counting from one, back into events.
+ */
+void ptt_foldexpand (int thread, int segment)
+{
+        struct ptt_event ring[PTT_FOLD_PERIOD], ev;
+        struct ptt_foldblock b;
+        char from[48], to[52];
+        int32_t delta[PTT_FOLD_PERIOD], elapsed;
+        uint64_t count = 0;
+        FILE *input, *output;
+        uint32_t i;
+        size_t e;
+
+        ptt_threadfile(from, thread, segment);
+        snprintf(to, 51, "%s.tx", from);
+        input = fopen(from, "r");
+        if (input == NULL)
+                return;  /* Threads without events */
+        output = fopen(to, "w");
+        ptt_assert(output != NULL);
+        setvbuf(input, NULL, _IOFBF, PTT_FOLD_BUFFER);
+        setvbuf(output, NULL, _IOFBF, PTT_FOLD_BUFFER);
+
+        while (fread(&b, sizeof(b), 1, input) == 1)
+        {
+                ptt_assert(b.period <= PTT_FOLD_PERIOD);
+                if (b.kind == PTT_FOLD_REPEAT)
+                {
+                        e = fread(delta, sizeof(int32_t), b.period, input);
+                        ptt_assert(e == b.period);
+                }
+                for (i = 0;  i < b.count;  i++)
+                {
+                        if (b.kind == PTT_FOLD_LITERAL)
+                        {
+                                e = fread(&ev, sizeof(ev), 1, input);
+                                ptt_assert(e == 1);
+                        }
+                        else
+                        {
+                                e = fread(&elapsed, sizeof(elapsed), 1, input);
+                                ptt_assert(e == 1);
+                                ev = ring[(count - b.period) % PTT_FOLD_PERIOD];
+                                ev.value = (uint32_t) ev.value +
+                                           delta[i % b.period];
+                                ev.timestamp = ring[(count - 1) %
+                                                    PTT_FOLD_PERIOD].timestamp +
+                                               elapsed;
+                        }
+                        ring[count % PTT_FOLD_PERIOD] = ev;
+                        count++;
+                        e = fwrite(&ev, sizeof(ev), 1, output);
+                        ptt_assert(e == 1);
+                }
+        }
+
+        fclose(input);
+        e = fclose(output);
+        ptt_assert(e == 0);
+        e = rename(to, from);
+        ptt_assert(e == 0);
+}
@@ -0,0 +1,157 @@
+/*
+ * formats.h - Binary file formats shared with the offline tools
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#ifndef __ptt_formats
+#define __ptt_formats
+
+/*
+ * Besides the Paraver files, the post processor may write some binary sidecar
+ * files.  They are read back by the tools in the "tools" directory, so their
+ * layout is defined here instead of in the private header, and so are the
+ * event types of the library.  All of them are written in the native byte
+ * order, like the temporary thread traces.
+ */
+
+#include <stdint.h>
+
+
+/*
+ * Single event, as simple as it gets.  Thread traces are plain arrays of them,
+ * sorted by time stamp, in clock ticks.
+ */
+struct ptt_event
+{
+        uint64_t timestamp;
+        int type;
+        int value;
+};
+
+
+/*
+ * Event types written by the library itself, all of them from PTT_PHASE_EVENT
+ * on (see "basic.pcf" for their names).  The tools look some of them up in
+ * the merged traces.
+ */
+#define PTT_PHASE_EVENT  69000000
+#define PTT_SEND_EVENT   69000001
+#define PTT_RECV_EVENT   69000002
+#define PTT_SIZE_EVENT   69000003
+#define PTT_IO_EVENT     69000004
+#define PTT_IOSIZE_EVENT 69000005
+#define PTT_IOCALL_EVENT 69000006
+#define PTT_IOBYTE_EVENT 69000007
+#define PTT_CPU_EVENT    69000008
+#define PTT_VOLCSW_EVENT 69000009
+#define PTT_INVCSW_EVENT 69000010
+#define PTT_ONCPU_EVENT  69000011
+#define PTT_HIGH_EVENT   69000012  /* Upper half of the next address */
+#define PTT_SAMPLE_EVENT 69000020  /* Plus the frame depth */
+#define PTT_FUNC_EVENT   69000030
+#define PTT_MALLOC_EVENT 69000040
+#define PTT_MSIZE_EVENT  69000041
+#define PTT_SYNC_EVENT   69000050
+#define PTT_PARENT_EVENT 69000051
+#define PTT_TASK_EVENT   69000060
+#define PTT_TSIZE_EVENT  69000061
+
+/*
+ * Values of the synchronization events.  Each wait, or thread creation, leaves
+ * an event when it starts and another one with value zero when it is over.
+ */
+enum
+{
+        PTT_SYNC_END = 0,
+        PTT_SYNC_CREATE,
+        PTT_SYNC_JOIN,
+        PTT_SYNC_BARRIER
+};
+
+
+/*
+ * Time index (".idx" files).  The trace duration is split in buckets of equal
+ * width and, for each bucket, the byte offset of the first record written at or
+ * after the start of the bucket is stored.  Offsets refer to the uncompressed
+ * .prv contents.  The header is followed by "count" 64 bit offsets.
+ */
+#define PTT_INDEX_MAGIC  "PTTIDX01"
+
+struct ptt_indexheader
+{
+        char magic[8];
+        uint64_t duration;  /* Trace duration, in nanoseconds */
+        uint64_t bucket;    /* Bucket width, in nanoseconds */
+        uint64_t count;     /* Number of buckets */
+};
+
+
+/*
+ * Level of detail pyramid (".lod" files).  The finest level splits the trace
+ * duration in buckets of "bucket" nanoseconds, a power of two, and each level
+ * doubles the width of the previous one, up to a single bucket for the whole
+ * trace.  Level "l" then has "duration / (bucket << l) + 1" buckets.  The
+ * header is followed by the cells of every level, from the finest, and within
+ * a level by those of every thread, from the first.
+ */
+#define PTT_LOD_MAGIC  "PTTLOD01"
+
+struct ptt_lodheader
+{
+        char magic[8];
+        uint64_t duration;  /* Trace duration, in nanoseconds */
+        uint64_t bucket;    /* Finest bucket width, in nanoseconds */
+        uint32_t levels;
+        uint32_t threads;
+};
+
+struct ptt_lodcell
+{
+        uint32_t events;  /* Events of the thread within the bucket */
+        int32_t state;    /* Value of the state type held the longest */
+        uint32_t share;   /* Thousandths of the bucket it was held, or zero */
+};
+
+
+/*
+ * Columnar event dataset.  Every event of the merged trace is a row, and each
+ * column is stored in a file of its own, named after the trace plus the column
+ * name: ".time" (64 bit nanoseconds), ".thread" (32 bit, starting at one),
+ * ".type" and ".value" (32 bit signed).  Rows are sorted by time.  The ".col"
+ * file holds this header followed by the "pcfsize" bytes of the PCF file, so
+ * the names travel along.
+ */
+#define PTT_COLUMNS_MAGIC  "PTTCOL01"
+
+struct ptt_columnheader
+{
+        char magic[8];
+        uint64_t duration;  /* Trace duration, in nanoseconds */
+        uint64_t count;     /* Number of rows */
+        uint32_t threads;
+        uint32_t pcfsize;
+};
+
+
+/*
+ * Raw traces.  When the merge is skipped, the thread traces are kept as they
+ * are, named after the trace plus the thread number (e.g. ".0001.tt"), and the
+ * ".raw" file holds this header.  Time stamps are converted to nanoseconds
+ * from the start of the trace with "(timestamp - startstamp) * nsratio".
+ */
+#define PTT_RAW_MAGIC  "PTTRAW01"
+
+struct ptt_rawheader
+{
+        char magic[8];
+        uint64_t duration;    /* Trace duration, in nanoseconds */
+        uint64_t startstamp;  /* Clock ticks at the start of the trace */
+        double nsratio;       /* Nanoseconds per clock tick */
+        uint32_t threads;
+        uint32_t reserved;
+};
+
+#endif /* __ptt_formats */
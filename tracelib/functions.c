@@ -0,0 +1,224 @@
+/*
+ * functions.c - Function entry and exit events for instrumented programs
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+#include "timestamp.h"
+
+/*
+ * Programs built with the ".functraced" flavour (see "rules.mk") are compiled
+ * with -finstrument-functions, so the compiler calls the hooks below when any
+ * of their functions is entered or left.  Each call produces a function event
+ * whose value is the offset of the function within the executable, which
+ * always fits in an event value.  Leaving a function sets the value back to
+ * its caller, or to zero for the outermost one, so the type can also be used
+ * for states.  The post processor translates offsets into function names.
+ *
+ * Two environment variables reduce the amount of events:
+ *
+ *      - PTT_FUNCTION_FILTER is a comma separated list of function names not
+ *        to be traced.
+ *
+ *      - PTT_FUNCTION_NS is the minimum duration, in nanoseconds, of the
+ *        calls to be traced.
+ *
+ * For the latter, calls in progress are kept in a small stack per thread and
+ * their entries are only written when they are over, or when one of their
+ * callees needs to be written.  An entry written after other events of the
+ * same thread is delayed up to the last of them, to keep the trace sorted.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PTT_FUNCTION_DEPTH  64
+
+
+/* Set by the linker at the beginning of the executable */
+extern char __executable_start;
+
+static uint32_t *Filter;      /* Sorted offsets not to be traced */
+static int FilterCount;
+static uint64_t MinimumTicks;
+
+
+static int ptt_offsetcompare (const void *a, const void *b)
+{
+        const uint32_t *oa = a, *ob = b;
+
+        return *oa < *ob ? -1 : *oa > *ob;
+}
+
+
+/*
+ * Read the settings.  The filter names are looked up in the symbol table.
+ */
+void ptt_functioninit (void)
+{
+        uint64_t address;
+        char *env, *names, *name, *save;
+
+        env = getenv("PTT_FUNCTION_NS");
+        MinimumTicks = ptt_nstoticks(env != NULL ? strtoull(env, NULL, 10) : 0);
+
+        env = getenv("PTT_FUNCTION_FILTER");
+        if (env == NULL || env[0] == '\0')
+                return;
+
+        names = strdup(env);
+        ptt_assert(names != NULL);
+        ptt_symbolinit(0);
+        for (name = strtok_r(names, ",", &save);  name != NULL;
+             name = strtok_r(NULL, ",", &save))
+        {
+                address = ptt_symbolfind(name);
+                if (address <= (uintptr_t) &__executable_start)
+                {
+                        ptt_debug("Function '%s' not found", name);
+                        continue;
+                }
+                Filter = realloc(Filter, (FilterCount + 1) * sizeof(uint32_t));
+                ptt_assert(Filter != NULL);
+                Filter[FilterCount++] = address - (uintptr_t) &__executable_start;
+        }
+        ptt_symbolfini();
+        free(names);
+        qsort(Filter, FilterCount, sizeof(uint32_t), ptt_offsetcompare);
+}
+
+
+/*
+ * Offset of a function, or zero if it should not be traced.
+ */
+static inline uint32_t ptt_functionoffset (void *function)
+{
+        uint32_t offset;
+
+        if ((uintptr_t) function <= (uintptr_t) &__executable_start ||
+            (uintptr_t) function - (uintptr_t) &__executable_start > INT32_MAX)
+                return 0;  /* Not from the executable */
+        offset = (uintptr_t) function - (uintptr_t) &__executable_start;
+        if (FilterCount > 0 && bsearch(&offset, Filter, FilterCount,
+                                       sizeof(uint32_t), ptt_offsetcompare))
+                return 0;
+        return offset;
+}
+
+
+static inline void ptt_functionevent (struct ptt_threadbuf *tb, uint64_t ts,
+                                      uint32_t value)
+{
+        uint64_t last;
+        int i;
+
+        /* The buffer may be empty after a flush without flush events */
+        i = ptt_reserve(tb, 1);
+        last = i > 0 ? tb->events[i - 1].timestamp : tb->laststamp;
+        if (ts < last)
+                ts = last;
+        tb->events[i].timestamp = ts;
+        tb->events[i].type = PTT_FUNC_EVENT;
+        tb->events[i].value = value;
+        tb->eventcount++;
+}
+
+
+/*
+ * Write the entries of the calls in progress which have not been written yet,
+ * up to the given depth.
+ */
+static void ptt_functionentries (struct ptt_threadbuf *tb, int depth)
+{
+        int d;
+
+        for (d = depth;  d > 0 && !tb->frames[d - 1].written;  d--)
+                ;
+        for (;  d < depth;  d++)
+        {
+                ptt_functionevent(tb, tb->frames[d].timestamp,
+                                  tb->frames[d].function);
+                tb->frames[d].written = 1;
+        }
+}
+
+
+void __attribute__((no_instrument_function))
+__cyg_profile_func_enter (void *function, void *site)
+{
+        struct ptt_threadbuf *tb;
+        struct ptt_frame *frame;
+        uint32_t offset;
+
+        tb = pthread_getspecific(PttGlobal.tlskey);
+        if (tb == NULL || tb->busy || (offset = ptt_functionoffset(function)) == 0)
+                return;
+        if (!PttGlobal.functions)
+                PttGlobal.functions = 1;
+
+        ptt_enter(tb);
+        if (tb->frames == NULL)
+        {
+                tb->frames = malloc(PTT_FUNCTION_DEPTH * sizeof(struct ptt_frame));
+                ptt_assert(tb->frames != NULL);
+        }
+        if (tb->depth < PTT_FUNCTION_DEPTH)
+        {
+                frame = &tb->frames[tb->depth];
+                frame->function = offset;
+                frame->written = MinimumTicks == 0;
+                frame->timestamp = ptt_getticks();
+                if (frame->written)
+                {
+                        ptt_functionentries(tb, tb->depth);
+                        ptt_functionevent(tb, frame->timestamp, offset);
+                }
+        }
+        tb->depth++;
+        ptt_leave(tb);
+}
+
+
+void __attribute__((no_instrument_function))
+__cyg_profile_func_exit (void *function, void *site)
+{
+        struct ptt_threadbuf *tb;
+        struct ptt_frame *frame;
+        uint64_t ts;
+        uint32_t offset;
+
+        ts = ptt_getticks();
+        tb = pthread_getspecific(PttGlobal.tlskey);
+        if (tb == NULL || tb->busy || tb->depth == 0 ||
+            (offset = ptt_functionoffset(function)) == 0)
+                return;
+
+        ptt_enter(tb);
+        tb->depth--;
+        if (tb->depth < PTT_FUNCTION_DEPTH)
+        {
+                frame = &tb->frames[tb->depth];
+                if (!frame->written && ts - frame->timestamp >= MinimumTicks)
+                {
+                        ptt_functionentries(tb, tb->depth + 1);
+                        frame->written = 1;
+                }
+                if (frame->written)
+                        ptt_functionevent(tb, ts, tb->depth > 0 ?
+                                          tb->frames[tb->depth - 1].function : 0);
+        }
+        ptt_leave(tb);
+}
+
+
+/*
+ * Release the call stack of a finishing thread.
+ */
+void ptt_functionend (struct ptt_threadbuf *tb)
+{
+        free(tb->frames);
+}
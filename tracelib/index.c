@@ -0,0 +1,95 @@
+/*
+ * index.c - Time index sidecar for Paraver traces
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * Records in the .prv file are written in time order, so a table mapping time
+ * buckets to byte offsets is enough to jump to any point of the trace without
+ * scanning it from the beginning.  The post processor reports the offset of
+ * every record it writes, and the table is stored in a ".idx" file at the end
+ * (see "formats.h" for the layout).
+ *
+ * The bucket width defaults to the trace duration split in PTT_INDEX_BUCKETS
+ * parts, but never below one microsecond.  The PTT_INDEX_BUCKET environment
+ * variable can set it explicitly, in nanoseconds.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PTT_INDEX_BUCKETS  16384
+
+
+static struct ptt_indexheader Index;
+static uint64_t *IndexOffset;
+static uint64_t IndexNext;  /* Next bucket to be filled */
+
+
+/*
+ * Prepare the index for a trace of the given duration.
+ */
+void ptt_indexinit (uint64_t duration)
+{
+        char *bucket;
+
+        memcpy(Index.magic, PTT_INDEX_MAGIC, 8);
+        Index.duration = duration;
+        bucket = getenv("PTT_INDEX_BUCKET");
+        if (bucket != NULL)
+                Index.bucket = strtoull(bucket, NULL, 10);
+        else
+                Index.bucket = duration / PTT_INDEX_BUCKETS + 1;
+        if (Index.bucket < 1000)
+                Index.bucket = 1000;
+        Index.count = duration / Index.bucket + 1;
+
+        IndexOffset = malloc(Index.count * sizeof(uint64_t));
+        ptt_assert(IndexOffset != NULL);
+        IndexNext = 0;
+}
+
+
+/*
+ * Tell the index that a record for time "ns" is about to be written at the
+ * given offset of the .prv file.
+ */
+void ptt_indexrecord (uint64_t ns, uint64_t offset)
+{
+        while (IndexNext < Index.count && IndexNext * Index.bucket <= ns)
+        {
+                IndexOffset[IndexNext] = offset;
+                IndexNext++;
+        }
+}
+
+
+/*
+ * Fill the trailing buckets with the final size of the .prv file, write the
+ * index and release its memory.
+ */
+void ptt_indexwrite (const char *filename, uint64_t size)
+{
+        FILE *output;
+        size_t e;
+
+        while (IndexNext < Index.count)
+                IndexOffset[IndexNext++] = size;
+
+        output = fopen(filename, "w");
+        ptt_assert(output != NULL);
+        e = fwrite(&Index, sizeof(Index), 1, output);
+        ptt_assert(e == 1);
+        e = fwrite(IndexOffset, sizeof(uint64_t), Index.count, output);
+        ptt_assert(e == Index.count);
+        e = fclose(output);
+        ptt_assert(e == 0);
+
+        free(IndexOffset);
+}
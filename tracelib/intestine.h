@@ -10,39 +10,107 @@
 #error "This file is private to the tracing implementation.  Include ptt.h instead"
 #endif
 
+#include <sys/types.h>
 #include <sys/time.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <signal.h>
+#include <time.h>
 #include <pthread.h>
 
+#include "formats.h"
+
 #define PTT_BUFFER_SIZE  32
-#define PTT_PHASE_EVENT  69000000
+#define PTT_SAMPLE_DEPTH 8
+#define PTT_CACHE_LINE   64
+
 
 /*
- * Single event, as simple as it gets.
+ * Event tagged with the thread it belongs to, as produced by the merge.
  */
-struct ptt_event
+struct ptt_record
 {
         uint64_t timestamp;
+        int thread;
         int type;
         int value;
 };
 
+/*
+ * Communication between two threads, as paired by the post processor.
+ */
+struct ptt_comm
+{
+        int tag;
+        int size;
+        int sender;
+        int receiver;
+        uint64_t sendns;
+        uint64_t recvns;
+};
+
+/*
+ * Thread state over a period of time, as derived by the post processor.
+ */
+struct ptt_state
+{
+        int thread;
+        int value;
+        uint64_t begin;
+        uint64_t end;
+};
+
+/*
+ * User thread function and its argument, remembered by the thread creation
+ * interception mechanism until the new thread starts.
+ */
+struct ptt_threadstart
+{
+        void *(*function)(void *);
+        void *parameter;
+        int parent;  /* Creating thread, counting from one, or zero */
+};
+
+/*
+ * Instrumented function call, still in progress.  Its entry is not written
+ * until it is known to last long enough (see "functions.c").
+ */
+struct ptt_frame
+{
+        uint64_t timestamp;
+        uint32_t function;  /* Offset within the executable */
+        int written;
+};
+
 /*
  * Per thread tracing information.  Essentially the thread's event buffer and
  * additional related fields to control disk flushing of that buffer.
  *
- * The "function" and "parameter" fields are included here but are only used
- * once by the thread creation interception mechanism.
+ * It is allocated by its own thread and padded to a whole number of cache
+ * lines, so it never shares a line with another thread's buffer.
  */
 struct ptt_threadbuf
 {
-        void *(*function)(void *);
-        void *parameter;
         int tracefile;
         int eventcount;
+        int thread;        /* Zero based identifier within the process */
+        int iocalls;       /* Small I/O calls not traced individually */
+        uint64_t iobytes;  /* And the bytes they transferred */
+        uint64_t cputime;  /* Values at the last CPU time sample */
+        long volcsw;
+        long invcsw;
+        volatile sig_atomic_t busy;  /* Buffer in use, do not sample */
+        timer_t timer;               /* Sampling timer */
+        char *stacklow;              /* Stack bounds for the frame walk */
+        char *stackhigh;
+        int depth;                   /* Instrumented function calls */
+        struct ptt_frame *frames;
+        struct ptt_mallocstats *mallocstats;  /* See "malloc.c" */
+        struct ptt_fold *fold;                /* See "fold.c" */
+        int segment;                          /* See "rotate.c" */
+        uint64_t laststamp;  /* Of the last event stored, see ptt_store() */
         struct ptt_event events[PTT_BUFFER_SIZE];
-};
+} __attribute__((aligned(PTT_CACHE_LINE)));
 
 
 /*
@@ -57,15 +125,105 @@ struct _PTT_GlobalScope
         pthread_mutex_t tlslock;
         pthread_mutex_t countlock;
         pid_t processid;
+        pid_t parentid;    /* Zero unless this is a forked child */
         int threadcount;
+        int postcount;     /* Threads of the part being post processed */
         uint64_t startstamp;
         uint64_t endstamp;
         struct timeval starttime;
         struct timeval endtime;
+        uint64_t iominbytes;  /* I/O calls below both thresholds are only */
+        uint64_t iominticks;  /* counted, see "wrappers.c" */
+        int cputime;          /* Whether to sample the thread CPU time */
+        int cputype;          /* Event type whose changes are sampled too */
+        int fold;             /* Whether to fold repetitive events */
+        int rotate;           /* Whether the trace is split in parts */
+        volatile int segment; /* Current part, see "rotate.c" */
+        long sampleperiod;    /* Sampling period in CPU nanoseconds */
+        int sampledepth;      /* Caller frames recorded with each sample */
+        int functions;        /* Whether function events have been seen */
+        double tickrate;      /* Clock ticks per nanosecond, if measured */
+        uint64_t eventcost;   /* Ticks per event call, if compensating */
 };
 
 extern struct _PTT_GlobalScope PttGlobal;
 
+/*
+ * Generated by the build system for each program, the event type whose values
+ * are also states, or zero if none (see "stringize.awk").
+ */
+extern const int PttStateType;
+
+
+/*
+ * Mark the buffer of the calling thread as busy while events are added, so
+ * that the sampling signal handler leaves it alone (see "sampling.c").  The
+ * compiler barriers keep the buffer accesses in between.
+ */
+#define ptt_enter(tb) \
+   do { \
+           (tb)->busy = 1; \
+           __asm__ __volatile__ ("" ::: "memory"); \
+   } while (0)
+#define ptt_leave(tb) \
+   do { \
+           __asm__ __volatile__ ("" ::: "memory"); \
+           (tb)->busy = 0; \
+   } while (0)
+
+
+/*
+ * When I/O calls are intercepted, the library must not trace its own file
+ * operations, so it always calls the real functions through these names.
+ */
+#ifdef PTT_IOWRAP
+#  define ptt_read   __real_read
+#  define ptt_write  __real_write
+#  define ptt_pread  __real_pread
+#  define ptt_open   __real_open
+extern ssize_t __real_read   (int, void *, size_t);
+extern ssize_t __real_write  (int, const void *, size_t);
+extern ssize_t __real_pread  (int, void *, size_t, off_t);
+extern int     __real_open   (const char *, int, ...);
+#else
+#  define ptt_read   read
+#  define ptt_write  write
+#  define ptt_pread  pread
+#  define ptt_open   open
+#endif
+
+
+/*
+ * Post processing output stream.  Besides the standard I/O stream, it holds
+ * the necessary state to compress the output on the fly (see "output.c").
+ */
+struct ptt_output
+{
+        FILE *file;
+        int level;
+        int pipe;
+        pthread_t thread;
+        void *gz;
+};
+
+
+/*
+ * Trace format written by the post processor (see "backend.c").  Each function
+ * returns the amount of bytes written.
+ */
+struct ptt_backend
+{
+        const char *suffix;  /* Trace file name extension */
+        uint64_t (*begin) (FILE *, uint64_t);
+        uint64_t (*event) (FILE *, int, uint64_t, int, int);
+        uint64_t (*state) (FILE *, struct ptt_state *);
+        uint64_t (*comm)  (FILE *, struct ptt_comm *);
+        void     (*end)   (FILE *);
+};
+
+extern const struct ptt_backend PttParaver;
+extern const struct ptt_backend PttChrome;
+
 
 /*
  * Debug mode helper macros.  These macros are only enabled for debugging
@@ -89,12 +247,111 @@ extern struct _PTT_GlobalScope PttGlobal;
 
 /***************************  FUNCTION PROTOTYPES  ***************************/
 
-void  ptt_init        (void) __attribute__((constructor));
-void  ptt_fini        (void) __attribute__((destructor));
-void *ptt_startthread (void *);
-void  ptt_endthread   (void *);
-void  ptt_postprocess (void);
+void  ptt_init         (void) __attribute__((constructor));
+void  ptt_fini         (void) __attribute__((destructor));
+void *ptt_startthread  (void *);
+void  ptt_endthread    (void *);
+void  ptt_prefork      (void);
+void  ptt_postfork     (void);
+void  ptt_childfork    (void);
+void  ptt_flush        (struct ptt_threadbuf *);
+int   ptt_reserve      (struct ptt_threadbuf *, int);
+int   ptt_store        (struct ptt_threadbuf *);
+void  ptt_postprocess  (void);
+void  ptt_postsegment  (int, uint64_t, uint64_t, const struct timeval *,
+                        const struct timeval *);
+void  ptt_threadfile   (char *, int, int);
+int   ptt_outputlevel  (void);
+FILE *ptt_openoutput   (struct ptt_output *, const char *, int);
+void  ptt_closeoutput  (struct ptt_output *);
+void  ptt_profileinit  (int);
+void  ptt_profileevent (int, uint64_t, int, int);
+void  ptt_profilewrite (const char *, uint64_t);
+void  ptt_indexinit    (uint64_t);
+void  ptt_indexrecord  (uint64_t, uint64_t);
+void  ptt_indexwrite   (const char *, uint64_t);
+void  ptt_lodinit      (int, uint64_t);
+void  ptt_lodevent     (int, uint64_t, int, int);
+void  ptt_lodwrite     (const char *);
+void  ptt_columninit   (const char *);
+void  ptt_columnevent  (int, uint64_t, int, int);
+void  ptt_columnwrite  (const char *, uint64_t);
+void  ptt_rawwrite     (const char *, int, uint64_t, uint64_t, double);
+int   ptt_fold         (struct ptt_fold *, int, struct ptt_event *, int);
+void  ptt_foldreset    (struct ptt_fold *);
+void  ptt_foldflush    (struct ptt_fold *, int);
+void  ptt_foldclose    (struct ptt_fold *, int);
+void  ptt_foldexpand   (int, int);
+void  ptt_rotateinit   (void);
+void  ptt_rotatefork   (void);
+void  ptt_rotatestart  (struct ptt_threadbuf *);
+void  ptt_rotateend    (struct ptt_threadbuf *);
+int   ptt_rotatestore  (struct ptt_threadbuf *);
+void  ptt_rotatestop   (void);
+void  ptt_poolstop     (void);
+void  ptt_overheadinit (void);
+void  ptt_poolfork     (void);
+int   ptt_rotatelast   (uint64_t *, struct timeval *);
+void  ptt_comminit     (int);
+int   ptt_commevent    (int, uint64_t, int, int, struct ptt_comm *);
+void  ptt_commfini     (void);
+void  ptt_commexpire   (void);
+void  ptt_stateinit    (int);
+int   ptt_stateevent   (int, uint64_t, int, int, struct ptt_state *);
+int   ptt_stateclose   (int, uint64_t, struct ptt_state *);
+int   ptt_statesplit   (int, uint64_t, struct ptt_state *);
+void  ptt_statefini    (void);
+void  ptt_reorderinit  (const struct ptt_backend *, FILE *, int, uint64_t);
+void  ptt_reorderevent (int, uint64_t, int, int);
+void  ptt_reorderstate (struct ptt_state *);
+void  ptt_reordercomm  (struct ptt_comm *);
+int   ptt_reorderdue   (void);
+int   ptt_reorderwrite (uint64_t);
+void  ptt_cpustart     (struct ptt_threadbuf *);
+void  ptt_cpusample    (struct ptt_threadbuf *, uint64_t);
+void  ptt_cpuinit      (int);
+int   ptt_cpuevent     (int, uint64_t, int, int);
+void  ptt_cpufini      (void);
+void  ptt_sampleinit   (void);
+void  ptt_samplestart  (struct ptt_threadbuf *);
+void  ptt_samplestop   (struct ptt_threadbuf *);
+void  ptt_symbolinit   (int);
+int   ptt_symbolevent  (int, int, int);
+void  ptt_symbolwrite  (FILE *);
+void  ptt_symbolfini   (void);
+void  ptt_functioninit (void);
+void  ptt_functionend  (struct ptt_threadbuf *);
+#ifdef PTT_IOWRAP
+void  ptt_ioinit       (void);
+void  ptt_iocalls      (struct ptt_threadbuf *, uint64_t);
+#endif
+#ifdef PTT_MALLOCWRAP
+void  ptt_mallocinit   (void);
+void  ptt_mallocfork   (struct ptt_threadbuf *);
+void  ptt_mallocwrite  (const char *);
+#endif
+
+struct ptt_fold          *ptt_foldopen      (void);
+int                       ptt_mergefanin    (void);
+struct ptt_merge         *ptt_mergeopen     (int, int);
+int                       ptt_mergenext     (struct ptt_merge *,
+                                             struct ptt_record *);
+void                      ptt_mergeclose    (struct ptt_merge *);
+uint64_t                  ptt_nstoticks     (uint64_t);
+uint64_t                  ptt_compensate    (const char *, int, double);
+uint64_t                  ptt_commhold      (void);
+uint64_t                  ptt_statehold     (void);
+uint64_t                  ptt_reorderfini   (void);
+uint64_t                  ptt_symbolfind    (const char *);
+const char               *ptt_symbolstring  (int);
+const struct ptt_backend *ptt_backendselect (void);
 #ifdef DEBUG
-void  ptt_debugprint  (const char *, int, const char *, ...);
+void  ptt_debugprint   (const char *, int, const char *, ...);
 #endif
 
+
+/* The real thread creation function, for threads that must not be traced */
+extern int __real_pthread_create (pthread_t *, const pthread_attr_t *,
+                                  void *(*)(void *), void *);
+extern int __real_pthread_join   (pthread_t, void **);
+extern int __real_pthread_barrier_wait (pthread_barrier_t *);
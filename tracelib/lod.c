@@ -0,0 +1,241 @@
+/*
+ * lod.c - Level of detail pyramid for trace overviews
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * Drawing the whole run of a huge trace means reading all of it.  So, while
+ * merging, the post processor also summarizes each thread in buckets of time
+ * at several resolutions: how many events there are in each bucket and which
+ * value of the state type was held the longest.  The pyramid is stored in a
+ * ".lod" file (see "formats.h" for the layout), small enough to be read whole
+ * for an overview, from which the interesting part can be found and then read
+ * from the trace with the help of the time index.
+ *
+ * The finest buckets are the smallest power of two nanoseconds that splits the
+ * trace in less than PTT_LOD_BUCKETS parts, but never below one microsecond.
+ * Event counts of the coarser levels are just the sum of the finer ones, while
+ * the state time is accumulated for every level as the states are closed.  Only
+ * PTT_LOD_SLOTS different states are considered within a bucket, which is more
+ * than any overview can show anyway.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PTT_LOD_BUCKETS  4096
+#define PTT_LOD_SLOTS    8
+
+
+/*
+ * State time accumulated for the current bucket of a level.
+ */
+struct ptt_lodlevel
+{
+        uint64_t current;  /* Bucket index, or UINT64_MAX if none */
+        int used;
+        int value[PTT_LOD_SLOTS];
+        uint64_t time[PTT_LOD_SLOTS];
+};
+
+struct ptt_lodthread
+{
+        int open;       /* Whether there is a current state */
+        int value;
+        uint64_t since;
+        struct ptt_lodlevel *levels;
+};
+
+
+static struct ptt_lodheader Lod;
+static struct ptt_lodcell *LodCells;
+static uint64_t *LodFirst;   /* First cell of each level */
+static uint64_t *LodCount;   /* Buckets per thread of each level */
+static struct ptt_lodthread *LodThreads;
+
+
+#define ptt_lodcell(l, t, i)  (&LodCells[LodFirst[l] + (uint64_t) (t) * \
+                                         LodCount[l] + (i)])
+
+
+void ptt_lodinit (int threads, uint64_t duration)
+{
+        uint64_t total = 0;
+        uint32_t l;
+        int t;
+
+        memcpy(Lod.magic, PTT_LOD_MAGIC, 8);
+        Lod.duration = duration;
+        Lod.threads = threads;
+        Lod.bucket = 1024;
+        while (duration / Lod.bucket >= PTT_LOD_BUCKETS)
+                Lod.bucket <<= 1;
+        for (Lod.levels = 1;  duration / (Lod.bucket << (Lod.levels - 1)) > 0;
+             Lod.levels++)
+                ;
+
+        LodFirst = malloc(Lod.levels * sizeof(uint64_t));
+        LodCount = malloc(Lod.levels * sizeof(uint64_t));
+        ptt_assert(LodFirst != NULL && LodCount != NULL);
+        for (l = 0;  l < Lod.levels;  l++)
+        {
+                LodFirst[l] = total;
+                LodCount[l] = duration / (Lod.bucket << l) + 1;
+                total += LodCount[l] * threads;
+        }
+        LodCells = calloc(total, sizeof(struct ptt_lodcell));
+        ptt_assert(LodCells != NULL);
+
+        LodThreads = calloc(threads, sizeof(struct ptt_lodthread));
+        ptt_assert(LodThreads != NULL);
+        for (t = 0;  t < threads;  t++)
+        {
+                LodThreads[t].levels = calloc(Lod.levels,
+                                              sizeof(struct ptt_lodlevel));
+                ptt_assert(LodThreads[t].levels != NULL);
+                for (l = 0;  l < Lod.levels;  l++)
+                        LodThreads[t].levels[l].current = UINT64_MAX;
+        }
+}
+
+
+/*
+ * Store the dominant state of the current bucket of a level in its cell.
+ */
+static void ptt_lodsettle (int thread, uint32_t l, struct ptt_lodlevel *lv)
+{
+        struct ptt_lodcell *cell;
+        int i, best = 0;
+
+        if (lv->current == UINT64_MAX)
+                return;
+        for (i = 1;  i < lv->used;  i++)
+                if (lv->time[i] > lv->time[best])
+                        best = i;
+        cell = ptt_lodcell(l, thread, lv->current);
+        cell->state = lv->value[best];
+        cell->share = lv->time[best] * 1000 / (Lod.bucket << l);
+        lv->current = UINT64_MAX;
+        lv->used = 0;
+}
+
+
+/*
+ * Account a state held by a thread from "begin" until "end".
+ */
+static void ptt_lodspan (int thread, int value, uint64_t begin, uint64_t end)
+{
+        struct ptt_lodlevel *lv;
+        uint64_t width, bucket, a, b;
+        uint32_t l;
+        int i;
+
+        if (end > Lod.duration)
+                end = Lod.duration;
+        for (l = 0;  l < Lod.levels;  l++)
+        {
+                lv = &LodThreads[thread].levels[l];
+                width = Lod.bucket << l;
+                for (a = begin;  a < end;  a = b)
+                {
+                        bucket = a / width;
+                        b = (bucket + 1) * width;
+                        if (b > end)
+                                b = end;
+                        if (bucket != lv->current)
+                        {
+                                ptt_lodsettle(thread, l, lv);
+                                lv->current = bucket;
+                        }
+                        for (i = 0;  i < lv->used && lv->value[i] != value;  i++)
+                                ;
+                        if (i == lv->used)
+                        {
+                                if (i == PTT_LOD_SLOTS)
+                                        continue;
+                                lv->value[i] = value;
+                                lv->time[i] = 0;
+                                lv->used++;
+                        }
+                        lv->time[i] += b - a;
+                }
+        }
+}
+
+
+/*
+ * Feed a merged event.
+ */
+void ptt_lodevent (int thread, uint64_t ns, int type, int value)
+{
+        struct ptt_lodthread *th = &LodThreads[thread];
+        uint64_t i;
+
+        i = ns / Lod.bucket;
+        if (i >= LodCount[0])
+                i = LodCount[0] - 1;
+        ptt_lodcell(0, thread, i)->events++;
+
+        if (PttStateType == 0 ||
+            (type != PttStateType && (type != PTT_PHASE_EVENT || value != 0)))
+                return;
+        if (th->open)
+                ptt_lodspan(thread, th->value, th->since, ns);
+        th->open = type == PttStateType;
+        th->value = value;
+        th->since = ns;
+}
+
+
+/*
+ * Close the states still open, complete the coarser levels, write the pyramid
+ * and release its memory.
+ */
+void ptt_lodwrite (const char *filename)
+{
+        struct ptt_lodcell *cell;
+        FILE *output;
+        uint64_t i, total;
+        uint32_t l;
+        uint32_t t;
+        size_t e;
+
+        for (t = 0;  t < Lod.threads;  t++)
+        {
+                if (LodThreads[t].open)
+                        ptt_lodspan(t, LodThreads[t].value, LodThreads[t].since,
+                                    Lod.duration);
+                for (l = 0;  l < Lod.levels;  l++)
+                        ptt_lodsettle(t, l, &LodThreads[t].levels[l]);
+                free(LodThreads[t].levels);
+        }
+        free(LodThreads);
+
+        for (l = 1;  l < Lod.levels;  l++)
+                for (t = 0;  t < Lod.threads;  t++)
+                        for (i = 0;  i < LodCount[l - 1];  i++)
+                        {
+                                cell = ptt_lodcell(l, t, i / 2);
+                                cell->events += ptt_lodcell(l - 1, t, i)->events;
+                        }
+
+        total = LodFirst[Lod.levels - 1] + LodCount[Lod.levels - 1] * Lod.threads;
+        output = fopen(filename, "w");
+        ptt_assert(output != NULL);
+        e = fwrite(&Lod, sizeof(Lod), 1, output);
+        ptt_assert(e == 1);
+        e = fwrite(LodCells, sizeof(struct ptt_lodcell), total, output);
+        ptt_assert(e == total);
+        e = fclose(output);
+        ptt_assert(e == 0);
+
+        free(LodCells);
+        free(LodFirst);
+        free(LodCount);
+}
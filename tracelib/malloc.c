@@ -0,0 +1,298 @@
+/*
+ * malloc.c - Memory allocation statistics and sampled events
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+#include "timestamp.h"
+
+/*
+ * When the library is compiled with PTT_MALLOCWRAP (see "rules.mk"), calls to
+ * malloc(), calloc(), realloc() and free() from the program are intercepted
+ * the same way as pthread_create() (see "wrappers.c").  Calls from other
+ * libraries, including the C library itself, are not.
+ *
+ * Every call is accounted in per thread statistics: calls, bytes requested, a
+ * latency histogram in decades from 100 nanoseconds to one millisecond, and a
+ * size histogram in powers of four from 16 bytes to 64 kilobytes.  Those are
+ * written by the post processor to a CSV file with one row per thread and
+ * operation.
+ *
+ * Besides, one of every PTT_MALLOC_SAMPLE calls of each thread (100 by
+ * default, zero for none) is written to the trace as well: an allocation
+ * event when it starts, another one with value zero when it finishes, and the
+ * requested size.
+ */
+
+#ifdef PTT_MALLOCWRAP
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define PTT_MALLOC_LATENCIES  6
+#define PTT_MALLOC_SIZES      8
+
+
+enum
+{
+        PTT_MALLOC_END = 0,
+        PTT_MALLOC_MALLOC,
+        PTT_MALLOC_CALLOC,
+        PTT_MALLOC_REALLOC,
+        PTT_MALLOC_FREE,
+        PTT_MALLOC_OPERATIONS
+};
+
+struct ptt_mallocop
+{
+        uint64_t calls;
+        uint64_t bytes;
+        uint64_t latency[PTT_MALLOC_LATENCIES];
+        uint64_t size[PTT_MALLOC_SIZES];
+};
+
+struct ptt_mallocstats
+{
+        int thread;
+        unsigned int countdown;  /* Calls until the next sampled one */
+        struct ptt_mallocop ops[PTT_MALLOC_OPERATIONS];
+        struct ptt_mallocstats *next;
+};
+
+
+extern void *__real_malloc  (size_t);
+extern void *__real_calloc  (size_t, size_t);
+extern void *__real_realloc (void *, size_t);
+extern void  __real_free    (void *);
+
+static struct ptt_mallocstats *Stats;  /* Every thread, latest first */
+static uint64_t Latency[PTT_MALLOC_LATENCIES - 1];
+static unsigned int Period;
+
+
+/*
+ * Read the sampling period and convert the latency limits to clock ticks.
+ */
+void ptt_mallocinit (void)
+{
+        uint64_t ns;
+        char *env;
+        int i;
+
+        env = getenv("PTT_MALLOC_SAMPLE");
+        Period = env != NULL ? strtoul(env, NULL, 10) : 100;
+        for (i = 0, ns = 100;  i < PTT_MALLOC_LATENCIES - 1;  i++, ns *= 10)
+                Latency[i] = ptt_nstoticks(ns);
+}
+
+
+/*
+ * Forget about the threads of the parent process.
+ */
+void ptt_mallocfork (struct ptt_threadbuf *tb)
+{
+        Stats = NULL;
+        tb->mallocstats = NULL;
+}
+
+
+/*
+ * Prepare the tracing of a call, as done for I/O calls.  Return NULL if the
+ * calling thread is not traced, or if the call comes from the library itself.
+ */
+static inline struct ptt_threadbuf *ptt_mallocbegin (uint64_t *ts)
+{
+        struct ptt_threadbuf *tb;
+        struct ptt_mallocstats *ms;
+        int e;
+
+        tb = pthread_getspecific(PttGlobal.tlskey);
+        if (tb == NULL || tb->busy)
+                return NULL;
+        ptt_enter(tb);
+
+        if (tb->mallocstats == NULL)
+        {
+                ms = __real_calloc(1, sizeof(struct ptt_mallocstats));
+                ptt_assert(ms != NULL);
+                ms->thread = tb->thread;
+                ms->countdown = Period;
+
+                e = pthread_mutex_lock(&PttGlobal.tlslock);
+                ptt_assert(e == 0);
+                /* Begin critical section */
+                ms->next = Stats;
+                Stats = ms;
+                /* End critical section */
+                e = pthread_mutex_unlock(&PttGlobal.tlslock);
+                ptt_assert(e == 0);
+                tb->mallocstats = ms;
+        }
+
+        ptt_reserve(tb, 3);
+        *ts = ptt_getticks();
+        return tb;
+}
+
+
+static void ptt_mallocend (struct ptt_threadbuf *tb, uint64_t ts, int operation,
+                           size_t size)
+{
+        struct ptt_mallocstats *ms = tb->mallocstats;
+        struct ptt_mallocop *op = &ms->ops[operation];
+        uint64_t te;
+        size_t limit;
+        int b, i;
+
+        te = ptt_getticks();
+        op->calls++;
+        op->bytes += size;
+        for (b = 0;  b < PTT_MALLOC_LATENCIES - 1 && te - ts >= Latency[b];  b++)
+                ;
+        op->latency[b]++;
+        for (b = 0, limit = 16;  b < PTT_MALLOC_SIZES - 1 && size > limit;  b++)
+                limit *= 4;
+        op->size[b]++;
+
+        if (Period > 0 && --ms->countdown == 0)
+        {
+                ms->countdown = Period;
+                i = tb->eventcount;
+                tb->eventcount += 3;
+                tb->events[i].timestamp = ts;
+                tb->events[i].type = PTT_MALLOC_EVENT;
+                tb->events[i].value = operation;
+                i++;
+                tb->events[i].timestamp = te;
+                tb->events[i].type = PTT_MALLOC_EVENT;
+                tb->events[i].value = PTT_MALLOC_END;
+                i++;
+                tb->events[i].timestamp = te;
+                tb->events[i].type = PTT_MSIZE_EVENT;
+                tb->events[i].value = size > INT_MAX ? INT_MAX : size;
+        }
+        ptt_leave(tb);
+}
+
+
+void *__wrap_malloc (size_t size)
+{
+        struct ptt_threadbuf *tb;
+        uint64_t ts;
+        void *p;
+
+        tb = ptt_mallocbegin(&ts);
+        p = __real_malloc(size);
+        if (tb != NULL)
+                ptt_mallocend(tb, ts, PTT_MALLOC_MALLOC, size);
+        return p;
+}
+
+
+void *__wrap_calloc (size_t count, size_t size)
+{
+        struct ptt_threadbuf *tb;
+        uint64_t ts;
+        void *p;
+
+        /* Overflowing sizes fail anyway, there is nothing to account */
+        if (size != 0 && count > SIZE_MAX / size)
+                return __real_calloc(count, size);
+
+        tb = ptt_mallocbegin(&ts);
+        p = __real_calloc(count, size);
+        if (tb != NULL)
+                ptt_mallocend(tb, ts, PTT_MALLOC_CALLOC, count * size);
+        return p;
+}
+
+
+void *__wrap_realloc (void *pointer, size_t size)
+{
+        struct ptt_threadbuf *tb;
+        uint64_t ts;
+        void *p;
+
+        tb = ptt_mallocbegin(&ts);
+        p = __real_realloc(pointer, size);
+        if (tb != NULL)
+                ptt_mallocend(tb, ts, PTT_MALLOC_REALLOC, size);
+        return p;
+}
+
+
+void __wrap_free (void *pointer)
+{
+        struct ptt_threadbuf *tb;
+        uint64_t ts;
+
+        tb = ptt_mallocbegin(&ts);
+        __real_free(pointer);
+        if (tb != NULL)
+                ptt_mallocend(tb, ts, PTT_MALLOC_FREE, 0);
+}
+
+
+/*
+ * Write the statistics of every thread, and release them.  Threads without
+ * any call have no rows.
+ */
+void ptt_mallocwrite (const char *filename)
+{
+        static const char *names[PTT_MALLOC_OPERATIONS] =
+                { NULL, "malloc", "calloc", "realloc", "free" };
+        struct ptt_mallocstats *ms;
+        struct ptt_mallocop *op;
+        FILE *output;
+        int e, i, b;
+
+        output = fopen(filename, "w");
+        ptt_assert(output != NULL);
+
+        e = fprintf(output, "thread,operation,calls,bytes,lt_100ns,lt_1us,"
+                            "lt_10us,lt_100us,lt_1ms,ge_1ms,le_16,le_64,le_256,"
+                            "le_1k,le_4k,le_16k,le_64k,gt_64k\n");
+        ptt_assert(e > 0);
+
+        for (ms = Stats;  ms != NULL;  ms = ms->next)
+        {
+                for (i = PTT_MALLOC_MALLOC;  i < PTT_MALLOC_OPERATIONS;  i++)
+                {
+                        op = &ms->ops[i];
+                        if (op->calls == 0)
+                                continue;
+                        e = fprintf(output, "%d,%s,%llu,%llu", ms->thread + 1,
+                                    names[i], op->calls, op->bytes);
+                        ptt_assert(e > 0);
+                        for (b = 0;  b < PTT_MALLOC_LATENCIES;  b++)
+                        {
+                                e = fprintf(output, ",%llu", op->latency[b]);
+                                ptt_assert(e > 0);
+                        }
+                        for (b = 0;  b < PTT_MALLOC_SIZES;  b++)
+                        {
+                                e = fprintf(output, ",%llu", op->size[b]);
+                                ptt_assert(e > 0);
+                        }
+                        e = fputc('\n', output);
+                        ptt_assert(e != EOF);
+                }
+        }
+
+        e = fclose(output);
+        ptt_assert(e != EOF);
+
+        while (Stats != NULL)
+        {
+                ms = Stats;
+                Stats = ms->next;
+                __real_free(ms);
+        }
+}
+
+#endif  /* PTT_MALLOCWRAP */
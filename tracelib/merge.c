@@ -0,0 +1,312 @@
+/*
+ * merge.c - Bounded memory merge of the per thread traces
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * Each thread trace is sorted in time, so producing the combined trace is a
+ * classic k-way merge.  Instead of mapping every thread trace at once, each
+ * input is read through a small window with pread(), and the input holding
+ * the next event is found with a binary heap.  Ties are broken by thread
+ * number, so the result does not depend on the way inputs are grouped.
+ *
+ * Both the amount of open files and the memory used are proportional to the
+ * amount of simultaneous inputs, which is limited by PTT_MERGE_FANIN (or the
+ * environment variable of the same name) and by the open files limit.  When
+ * there are more threads than that, the merge is hierarchical: groups of
+ * thread traces are merged into temporary run files, which are then merged
+ * again until few enough remain.
+ *
+ * Temporary run files contain "ptt_record" structures, i.e. events tagged
+ * with their thread number.  Every input file is removed once consumed.
+ */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PTT_MERGE_FANIN   256
+#define PTT_MERGE_WINDOW  4096  /* Records per input window */
+
+
+/*
+ * A source of sorted events: either a thread trace or a merged run.
+ */
+struct ptt_mergesource
+{
+        int thread;  /* Thread index for thread traces, -1 for runs */
+        char filename[48];
+};
+
+struct ptt_mergeinput
+{
+        int fd;
+        int thread;
+        off_t offset;          /* File offset of the next window */
+        unsigned int count;    /* Records in the current window */
+        unsigned int current;  /* Next record in the current window */
+        char *window;
+        struct ptt_record head;
+        struct ptt_mergesource *source;
+};
+
+struct ptt_merge
+{
+        int count;  /* Inputs still in the heap */
+        struct ptt_mergesource *sources;
+        struct ptt_mergeinput *inputs;
+        struct ptt_mergeinput **heap;
+};
+
+
+/*
+ * Maximum amount of inputs merged at once.
+ */
+int ptt_mergefanin (void)
+{
+        struct rlimit rl;
+        char *fanin;
+        int f;
+
+        fanin = getenv("PTT_MERGE_FANIN");
+        f = fanin != NULL ? atoi(fanin) : PTT_MERGE_FANIN;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+            (rlim_t) f > rl.rlim_cur / 2)
+                f = rl.rlim_cur / 2;
+        return f < 2 ? 2 : f;
+}
+
+
+/*
+ * Make the head record of an input available, reading the next window if
+ * necessary.  Return zero when the input is exhausted, in which case its file
+ * is closed and removed.
+ */
+static int ptt_mergeload (struct ptt_mergeinput *in)
+{
+        struct ptt_event *ev;
+        size_t size;
+        ssize_t n;
+        int e;
+
+        size = in->thread >= 0 ? sizeof(struct ptt_event)
+                               : sizeof(struct ptt_record);
+        if (in->current >= in->count)
+        {
+                n = ptt_pread(in->fd, in->window, PTT_MERGE_WINDOW * size,
+                              in->offset);
+                ptt_assert(n != -1);
+                ptt_assert(n % size == 0);
+                if (n <= 0)
+                {
+                        e = close(in->fd);
+                        ptt_assert(e != -1);
+                        unlink(in->source->filename);  /* Ignore errors */
+                        free(in->window);
+                        in->fd = -1;
+                        return 0;
+                }
+                in->offset += n;
+                in->count = n / size;
+                in->current = 0;
+        }
+
+        if (in->thread >= 0)
+        {
+                ev = (struct ptt_event *) in->window + in->current;
+                in->head.timestamp = ev->timestamp;
+                in->head.thread = in->thread;
+                in->head.type = ev->type;
+                in->head.value = ev->value;
+        }
+        else
+                in->head = ((struct ptt_record *) in->window)[in->current];
+        in->current++;
+        return 1;
+}
+
+
+static inline int ptt_mergeless (struct ptt_mergeinput *a,
+                                 struct ptt_mergeinput *b)
+{
+        if (a->head.timestamp != b->head.timestamp)
+                return a->head.timestamp < b->head.timestamp;
+        return a->head.thread < b->head.thread;
+}
+
+
+static void ptt_mergesift (struct ptt_merge *m, int i)
+{
+        struct ptt_mergeinput *in = m->heap[i];
+        int c;
+
+        while ((c = 2 * i + 1) < m->count)
+        {
+                if (c + 1 < m->count && ptt_mergeless(m->heap[c + 1], m->heap[c]))
+                        c++;
+                if (!ptt_mergeless(m->heap[c], in))
+                        break;
+                m->heap[i] = m->heap[c];
+                i = c;
+        }
+        m->heap[i] = in;
+}
+
+
+/*
+ * Open a set of sources and build the heap.
+ */
+static void ptt_mergestart (struct ptt_merge *m, struct ptt_mergesource *src,
+                            int count)
+{
+        struct ptt_mergeinput *in;
+        int i;
+
+        m->inputs = calloc(count, sizeof(struct ptt_mergeinput));
+        m->heap = malloc(count * sizeof(struct ptt_mergeinput *));
+        ptt_assert(m->inputs != NULL && m->heap != NULL);
+        m->count = 0;
+
+        for (i = 0;  i < count;  i++)
+        {
+                in = &m->inputs[i];
+                in->source = &src[i];
+                in->thread = src[i].thread;
+                in->fd = ptt_open(src[i].filename, O_RDONLY);
+                if (in->fd == -1)
+                        continue;  /* Threads without events */
+                posix_fadvise(in->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                in->window = malloc(PTT_MERGE_WINDOW * sizeof(struct ptt_record));
+                ptt_assert(in->window != NULL);
+                if (ptt_mergeload(in))
+                        m->heap[m->count++] = in;
+        }
+
+        for (i = m->count / 2 - 1;  i >= 0;  i--)
+                ptt_mergesift(m, i);
+}
+
+
+/*
+ * Get the next event in time order.  Return zero when all the inputs have been
+ * consumed.
+ */
+int ptt_mergenext (struct ptt_merge *m, struct ptt_record *rec)
+{
+        if (m->count == 0)
+                return 0;
+
+        *rec = m->heap[0]->head;
+        if (!ptt_mergeload(m->heap[0]))
+                m->heap[0] = m->heap[--m->count];
+        if (m->count > 0)
+                ptt_mergesift(m, 0);
+        return 1;
+}
+
+
+/*
+ * Merge a group of sources into a run file.
+ */
+static void ptt_mergerun (struct ptt_mergesource *src, int count,
+                          struct ptt_mergesource *run)
+{
+        struct ptt_merge m;
+        struct ptt_record rec;
+        FILE *output;
+        size_t e;
+
+        output = fopen(run->filename, "w");
+        ptt_assert(output != NULL);
+        setvbuf(output, NULL, _IOFBF, PTT_MERGE_WINDOW * sizeof(rec));
+
+        ptt_mergestart(&m, src, count);
+        while (ptt_mergenext(&m, &rec))
+        {
+                e = fwrite(&rec, sizeof(rec), 1, output);
+                ptt_assert(e == 1);
+        }
+        free(m.inputs);
+        free(m.heap);
+
+        e = fclose(output);
+        ptt_assert(e == 0);
+}
+
+
+/*
+ * Prepare the merge of all thread traces of a segment (see "rotate.c"),
+ * performing as many intermediate passes as necessary so that the final one
+ * stays within the fan-in.
+ */
+struct ptt_merge *ptt_mergeopen (int threads, int segment)
+{
+        struct ptt_mergesource *src, *runs;
+        struct ptt_merge *m;
+        int count, fanin, pass, i, r;
+
+        src = malloc(threads * sizeof(struct ptt_mergesource));
+        ptt_assert(src != NULL);
+        for (i = 0;  i < threads;  i++)
+        {
+                src[i].thread = i;
+                ptt_threadfile(src[i].filename, i + 1, segment);
+        }
+        count = threads;
+
+        fanin = ptt_mergefanin();
+        for (pass = 1;  count > fanin;  pass++)
+        {
+                r = (count + fanin - 1) / fanin;
+                runs = malloc(r * sizeof(struct ptt_mergesource));
+                ptt_assert(runs != NULL);
+                for (i = 0;  i < r;  i++)
+                {
+                        runs[i].thread = -1;
+                        snprintf(runs[i].filename, 47, "/tmp/ptt-%d-r%d-%04d.tr",
+                                 PttGlobal.processid, pass, i + 1);
+                        ptt_mergerun(src + i * fanin, i < r - 1 ? fanin :
+                                     count - i * fanin, &runs[i]);
+                }
+                ptt_debug("Merge pass %d reduced %d inputs to %d", pass, count, r);
+                free(src);
+                src = runs;
+                count = r;
+        }
+
+        m = malloc(sizeof(struct ptt_merge));
+        ptt_assert(m != NULL);
+        ptt_mergestart(m, src, count);
+        m->sources = src;
+        return m;
+}
+
+
+/*
+ * Release the merge.  Every input has been removed by now, unless the merge
+ * was interrupted.
+ */
+void ptt_mergeclose (struct ptt_merge *m)
+{
+        int i;
+
+        for (i = 0;  i < m->count;  i++)
+        {
+                close(m->heap[i]->fd);
+                unlink(m->heap[i]->source->filename);
+                free(m->heap[i]->window);
+        }
+        free(m->sources);
+        free(m->inputs);
+        free(m->heap);
+        free(m);
+}
@@ -0,0 +1,147 @@
+/*
+ * output.c - Output streams for the post processing stage
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * Paraver traces are plain text and, therefore, tend to be huge.  But they are
+ * also highly redundant, so they compress really well.  When compression is
+ * requested, through the PTT_COMPRESS environment variable, the post processor
+ * still writes text with the standard buffered I/O functions.  The difference
+ * is that the stream is the writing end of a pipe, which is drained by a
+ * separate compressor thread.  This way, merging and compression overlap and
+ * the merging code does not need to know anything about it.
+ *
+ * The value of PTT_COMPRESS is the zlib compression level (1 to 9).  Any other
+ * non empty value, except "0", selects the default level.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef PTT_ZLIB
+#  include <zlib.h>
+#endif
+
+#define PTT_OUTPUT_CHUNK  (64 * 1024)
+
+
+/*
+ * Find out the requested compression level.  Zero means no compression, either
+ * because it has not been requested or because it is not supported.
+ */
+int ptt_outputlevel (void)
+{
+        char *level;
+
+        level = getenv("PTT_COMPRESS");
+        if (level == NULL || level[0] == '\0' || strcmp(level, "0") == 0)
+                return 0;
+#ifdef PTT_ZLIB
+        if (level[0] >= '1' && level[0] <= '9' && level[1] == '\0')
+                return level[0] - '0';
+        return 6;
+#else
+        ptt_debug("Compression requested but not available");
+        return 0;
+#endif
+}
+
+
+#ifdef PTT_ZLIB
+/*
+ * Compressor thread.  Read whatever comes through the pipe and feed it to zlib
+ * until the writing end is closed.
+ */
+static void *ptt_compressor (void *output)
+{
+        struct ptt_output *out = output;
+        char *chunk;
+        ssize_t n;
+        int e;
+
+        chunk = malloc(PTT_OUTPUT_CHUNK);
+        ptt_assert(chunk != NULL);
+
+        while ((n = ptt_read(out->pipe, chunk, PTT_OUTPUT_CHUNK)) > 0)
+        {
+                e = gzwrite(out->gz, chunk, n);
+                ptt_assert(e == n);
+        }
+        ptt_assert(n == 0);
+
+        free(chunk);
+        return NULL;
+}
+#endif
+
+
+/*
+ * Open an output file.  With a zero compression level, this is just a plain
+ * fopen().  Otherwise, the compressor thread is started and the returned stream
+ * is connected to it.
+ */
+FILE *ptt_openoutput (struct ptt_output *out, const char *filename, int level)
+{
+#ifdef PTT_ZLIB
+        char mode[8];
+        int e, fd[2];
+
+        out->level = level;
+        if (level == 0)
+        {
+                out->file = fopen(filename, "w");
+                return out->file;
+        }
+
+        snprintf(mode, 7, "wb%d", level);
+        out->gz = gzopen(filename, mode);
+        ptt_assert(out->gz != NULL);
+        gzbuffer(out->gz, 4 * PTT_OUTPUT_CHUNK);
+
+        e = pipe(fd);
+        ptt_assert(e != -1);
+        out->pipe = fd[0];
+        out->file = fdopen(fd[1], "w");
+        ptt_assert(out->file != NULL);
+        setvbuf(out->file, NULL, _IOFBF, PTT_OUTPUT_CHUNK);
+
+        /* Not the wrapped pthread_create(), this thread must not be traced */
+        e = __real_pthread_create(&out->thread, NULL, ptt_compressor, out);
+        ptt_assert(e == 0);
+#else
+        out->level = 0;
+        out->file = fopen(filename, "w");
+#endif
+        return out->file;
+}
+
+
+/*
+ * Close an output file.  For compressed files, closing the stream lets the
+ * compressor thread know that there is nothing else to come.
+ */
+void ptt_closeoutput (struct ptt_output *out)
+{
+        int e;
+
+        e = fclose(out->file);
+        ptt_assert(e != EOF);
+#ifdef PTT_ZLIB
+        if (out->level == 0)
+                return;
+
+        e = __real_pthread_join(out->thread, NULL);
+        ptt_assert(e == 0);
+        e = close(out->pipe);
+        ptt_assert(e != -1);
+        e = gzclose(out->gz);
+        ptt_assert(e == Z_OK);
+#endif
+}
@@ -0,0 +1,368 @@
+/*
+ * overhead.c - Compensation of the tracing overhead
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+#include "timestamp.h"
+#include "ptt.h"
+
+/*
+ * Every event costs some time to the thread adding it, and every flush costs
+ * much more.  When PTT_COMPENSATE is set to non zero, that time is removed
+ * from the trace: each thread trace is rewritten before the merge, so that
+ * every event is moved back by the overhead accumulated by its thread so far.
+ *
+ * The cost of an event is measured when the library starts, as the best of
+ * several rounds of ptt_event() calls into a scratch buffer.  It is charged
+ * once per call, i.e. events sharing their time stamp with the previous one
+ * come from the same call.  Flushes need no estimation, as each one is
+ * already enclosed by the events marking its beginning and its end (see
+ * "event.c"), so the time in between is charged instead.
+ *
+ * Thread traces are rewritten together, event by event in time order, so that
+ * the shift of a thread can depend on others.  A created thread starts with
+ * the shift its parent had when creating it (see PTT_PARENT_EVENT).  A join is
+ * over no earlier than the compensated end of the thread joined, i.e. the time
+ * spent waiting shrinks or grows with the shift of that thread.  The thread
+ * joined is taken to be the last one finished before the join is over, among
+ * those not joined yet.  Other synchronizations and communications are not
+ * followed, so they may end up slightly out of order.  The end of the trace is
+ * moved back as much as the last compensated event.  The amount removed from
+ * each thread is written to a ".overhead.csv" file.
+ *
+ * Every thread trace is open at once, each with its rewritten copy, and the
+ * thread holding the next event is found with a binary heap, as in "merge.c".
+ * To keep those files within the merge fan-in (see PTT_MERGE_FANIN), traces
+ * with more than half as many threads are not compensated.
+ */
+
+#include <stdlib.h>
+
+#define PTT_OVERHEAD_ROUNDS  16
+#define PTT_OVERHEAD_CALLS   256
+
+
+/*
+ * Compensation state of a thread, and time removed from it.
+ */
+struct ptt_overhead
+{
+        FILE *input;
+        FILE *output;
+        char filename[48];
+        struct ptt_event next;  /* Next event to rewrite */
+        int more;               /* Whether there is a next event */
+        int done;               /* Whole trace rewritten */
+        int joined;             /* Already joined by another thread */
+        int joining;
+        int parent;             /* Counting from one, or zero */
+        uint64_t count;
+        uint64_t raw;           /* Time stamp of the last event rewritten */
+        uint64_t prev;          /* And once compensated */
+        uint64_t flush;         /* Start of the flush in progress */
+        uint64_t joinstart;     /* Compensated start of the join in progress */
+        uint64_t shift;         /* Ticks removed from the last event */
+        uint64_t created;       /* Shift at the last thread creation */
+        uint64_t calls;
+        uint64_t flushes;
+        uint64_t callticks;
+        uint64_t flushticks;
+        uint64_t parentticks;
+        int64_t jointicks;      /* Negative when waiting for slower threads */
+};
+
+
+static struct ptt_threadbuf Scratch;
+
+
+/*
+ * Measure the cost of an event, in clock ticks, with the calling thread not
+ * being traced yet.
+ */
+void ptt_overheadinit (void)
+{
+        uint64_t t0, t1, best = UINT64_MAX;
+        char *env;
+        int e, r, c;
+
+        PttGlobal.eventcost = 0;
+        env = getenv("PTT_COMPENSATE");
+        if (env == NULL || atoi(env) == 0)
+                return;
+
+        e = pthread_setspecific(PttGlobal.tlskey, &Scratch);
+        ptt_assert(e == 0);
+        for (r = 0;  r < PTT_OVERHEAD_ROUNDS;  r++)
+        {
+                t0 = ptt_getticks();
+                for (c = 0;  c < PTT_OVERHEAD_CALLS;  c++)
+                {
+                        Scratch.eventcount = 0;  /* Never flushed */
+                        ptt_event(PttStateType + 1, c);
+                }
+                t1 = ptt_getticks();
+                if (t1 - t0 < best)
+                        best = t1 - t0;
+        }
+        e = pthread_setspecific(PttGlobal.tlskey, NULL);
+        ptt_assert(e == 0);
+
+        PttGlobal.eventcost = best / PTT_OVERHEAD_CALLS;
+        if (PttGlobal.eventcost == 0)
+                PttGlobal.eventcost = 1;
+        ptt_debug("Event cost of %llu ticks",
+                  (unsigned long long) PttGlobal.eventcost);
+}
+
+
+static void ptt_compensateclose (struct ptt_overhead *oh)
+{
+        char filename[52];
+        int e;
+
+        fclose(oh->input);
+        e = fclose(oh->output);
+        ptt_assert(e == 0);
+        snprintf(filename, 51, "%s.tc", oh->filename);
+        e = rename(filename, oh->filename);
+        ptt_assert(e == 0);
+        oh->done = 1;
+}
+
+
+/*
+ * Open the trace of a thread, counting from one, and find its parent.
+ */
+static void ptt_compensateopen (struct ptt_overhead *oh, int thread,
+                                int segment)
+{
+        struct ptt_event second;
+        char filename[52];
+        int e;
+
+        ptt_threadfile(oh->filename, thread, segment);
+        oh->input = fopen(oh->filename, "r");
+        if (oh->input == NULL)
+                return;  /* Threads without events */
+        snprintf(filename, 51, "%s.tc", oh->filename);
+        oh->output = fopen(filename, "w");
+        ptt_assert(oh->output != NULL);
+
+        oh->more = fread(&oh->next, sizeof(struct ptt_event), 1, oh->input);
+        if (oh->more && fread(&second, sizeof(second), 1, oh->input) == 1 &&
+            second.type == PTT_PARENT_EVENT && second.value > 0 &&
+            second.value < thread)
+                oh->parent = second.value;
+        e = fseek(oh->input, sizeof(struct ptt_event), SEEK_SET);
+        ptt_assert(e == 0);
+        if (!oh->more)
+                ptt_compensateclose(oh);
+}
+
+
+/*
+ * The thread most likely joined by "self" at "stamp": the last one finished
+ * by then, which has not been joined yet.
+ */
+static struct ptt_overhead *ptt_compensatejoined (struct ptt_overhead *ohs,
+                                                  int self, uint64_t stamp)
+{
+        struct ptt_overhead *joined = NULL;
+        int i;
+
+        for (i = 0;  i < PttGlobal.postcount;  i++)
+                if (i != self && ohs[i].done && ohs[i].count > 0 &&
+                    !ohs[i].joined && ohs[i].raw <= stamp &&
+                    (joined == NULL || ohs[i].raw > joined->raw))
+                        joined = &ohs[i];
+        if (joined != NULL)
+                joined->joined = 1;
+        return joined;
+}
+
+
+/*
+ * Rewrite the next event of a thread.  Every event before it, from any thread,
+ * is already rewritten.
+ */
+static void ptt_compensateevent (struct ptt_overhead *ohs, int self)
+{
+        struct ptt_overhead *oh = &ohs[self];
+        struct ptt_overhead *joined;
+        struct ptt_event ev = oh->next;
+        uint64_t target, ts;
+        size_t e;
+
+        if (ev.type == PTT_PHASE_EVENT && ev.value == 2)
+        {
+                oh->flush = ev.timestamp;
+        }
+        else if (ev.type == PTT_PHASE_EVENT && ev.value == 1 && oh->flush > 0)
+        {
+                oh->flushticks += ev.timestamp - oh->flush;
+                oh->flushes++;
+                oh->shift += ev.timestamp - oh->flush;
+                oh->flush = 0;
+        }
+        else if (oh->count > 0 && ev.timestamp != oh->raw)
+        {
+                oh->callticks += PttGlobal.eventcost;
+                oh->calls++;
+                oh->shift += PttGlobal.eventcost;
+        }
+        else if (oh->count == 0 && oh->parent > 0)
+        {
+                oh->parentticks = ohs[oh->parent - 1].created;
+                oh->shift += oh->parentticks;
+        }
+        oh->raw = ev.timestamp;
+        oh->count++;
+
+        if (ev.type == PTT_SYNC_EVENT && ev.value == PTT_SYNC_CREATE)
+        {
+                oh->created = oh->shift;
+        }
+        else if (ev.type == PTT_SYNC_EVENT && ev.value == PTT_SYNC_JOIN)
+        {
+                oh->joining = 1;
+        }
+        else if (ev.type == PTT_SYNC_EVENT && oh->joining)
+        {
+                /* Over when both the joiner and the joined are there */
+                target = oh->joinstart;
+                joined = ptt_compensatejoined(ohs, self, oh->raw);
+                if (joined != NULL && joined->prev > target)
+                        target = joined->prev;
+                if (target <= oh->raw)
+                {
+                        oh->jointicks += (int64_t) (oh->raw - target) -
+                                         (int64_t) oh->shift;
+                        oh->shift = oh->raw - target;
+                }
+                oh->joining = 0;
+        }
+
+        ts = oh->raw - oh->shift;
+        if (ts > oh->raw || ts < oh->prev)
+                ts = oh->prev;  /* Never before the previous event */
+        oh->prev = ts;
+        if (oh->joining)
+                oh->joinstart = ts;
+        ev.timestamp = ts;
+        e = fwrite(&ev, sizeof(ev), 1, oh->output);
+        ptt_assert(e == 1);
+
+        oh->more = fread(&oh->next, sizeof(struct ptt_event), 1, oh->input);
+        if (!oh->more)
+                ptt_compensateclose(oh);
+}
+
+
+/*
+ * Order of the pending events, ties broken by thread number.
+ */
+static inline int ptt_compensateless (struct ptt_overhead *a,
+                                      struct ptt_overhead *b)
+{
+        if (a->next.timestamp != b->next.timestamp)
+                return a->next.timestamp < b->next.timestamp;
+        return a < b;
+}
+
+
+static void ptt_compensatesift (struct ptt_overhead **heap, int count, int i)
+{
+        struct ptt_overhead *oh = heap[i];
+        int c;
+
+        while ((c = 2 * i + 1) < count)
+        {
+                if (c + 1 < count && ptt_compensateless(heap[c + 1], heap[c]))
+                        c++;
+                if (!ptt_compensateless(heap[c], oh))
+                        break;
+                heap[i] = heap[c];
+                i = c;
+        }
+        heap[i] = oh;
+}
+
+
+/*
+ * Compensate all the thread traces of a segment and write the report.  Return
+ * how much the end of the segment moves back, in ticks.
+ */
+uint64_t ptt_compensate (const char *trace, int segment, double nsratio)
+{
+        struct ptt_overhead *ohs, *oh, **heap;
+        uint64_t latest = 0, compensated = 0;
+        char filename[256];
+        FILE *output;
+        int i, e, n;
+
+        /* Two files per thread */
+        if (PttGlobal.postcount > ptt_mergefanin() / 2)
+        {
+                ptt_debug("Too many threads to compensate the overhead");
+                return 0;
+        }
+
+        ohs = calloc(PttGlobal.postcount, sizeof(struct ptt_overhead));
+        heap = malloc(PttGlobal.postcount * sizeof(struct ptt_overhead *));
+        ptt_assert(ohs != NULL && heap != NULL);
+        for (i = 0, n = 0;  i < PttGlobal.postcount;  i++)
+        {
+                ptt_compensateopen(&ohs[i], i + 1, segment);
+                if (ohs[i].more)
+                        heap[n++] = &ohs[i];
+        }
+        for (i = n / 2 - 1;  i >= 0;  i--)
+                ptt_compensatesift(heap, n, i);
+
+        /* Earliest pending event first */
+        while (n > 0)
+        {
+                oh = heap[0];
+                ptt_compensateevent(ohs, oh - ohs);
+                if (!oh->more)
+                        heap[0] = heap[--n];
+                if (n > 0)
+                        ptt_compensatesift(heap, n, 0);
+        }
+        free(heap);
+
+        snprintf(filename, 255, "%s.overhead.csv", trace);
+        output = fopen(filename, "w");
+        ptt_assert(output != NULL);
+        e = fprintf(output, "thread,calls,flushes,call_ns,flush_ns,parent_ns,"
+                            "join_ns,total_ns\n");
+        ptt_assert(e > 0);
+        for (i = 0;  i < PttGlobal.postcount;  i++)
+        {
+                oh = &ohs[i];
+                if (oh->raw > latest)
+                        latest = oh->raw;
+                if (oh->prev > compensated)
+                        compensated = oh->prev;
+                e = fprintf(output, "%d,%llu,%llu,%llu,%llu,%llu,%lld,%llu\n",
+                            i + 1,
+                            (unsigned long long) oh->calls,
+                            (unsigned long long) oh->flushes,
+                            (unsigned long long) (oh->callticks * nsratio),
+                            (unsigned long long) (oh->flushticks * nsratio),
+                            (unsigned long long) (oh->parentticks * nsratio),
+                            (long long) (oh->jointicks * nsratio),
+                            (unsigned long long) (oh->shift * nsratio));
+                ptt_assert(e > 0);
+        }
+        e = fclose(output);
+        ptt_assert(e != EOF);
+
+        free(ohs);
+        return latest - compensated;
+}
@@ -0,0 +1,416 @@
+/*
+ * pool.c - Persistent thread pool with a traced parallel loop
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+#include "timestamp.h"
+#include "ptt.h"
+
+/*
+ * ptt_parallel_for() runs "fn" over the iterations from "begin" up to "end",
+ * in chunks of "grain" iterations, using a pool of threads created the first
+ * time it is called and kept until the process finishes.  The pool threads are
+ * created through the wrapper, so they are traced as any other thread, and
+ * PTT_POOL_THREADS sets how many threads run iterations, the caller included
+ * (as many as processors by default).
+ *
+ * Each thread starts with an even share of the iterations, as a private range.
+ * Threads running out of work steal from others, picked at random: a thief
+ * posts a request to the victim, which splits its range in two at the next
+ * chunk boundary and hands the upper half over.  Since ranges are private,
+ * running a chunk needs no atomic operation other than counting the
+ * iterations done, which tells when the loop is finished.
+ *
+ * Every chunk leaves a region of the pool task type in the trace, with the
+ * amount of iterations, as well as the time spent looking for work.  Steals
+ * are recorded as communications from the victim to the thief, with the
+ * iterations handed over as size and tags from PTT_POOL_TAG on, a range
+ * reserved in "ptt.h".
+ *
+ * Calls made while the pool is busy, either nested or from another thread, run
+ * their iterations in the calling thread.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+
+enum
+{
+        PTT_POOL_WAITING = 0,
+        PTT_POOL_GIVEN,
+        PTT_POOL_REFUSED
+};
+
+enum
+{
+        PTT_TASK_END = 0,
+        PTT_TASK_RUNNING,
+        PTT_TASK_STEALING
+};
+
+
+struct ptt_poolworker
+{
+        long next;             /* Private range, only touched by its owner */
+        long end;
+        volatile int request;  /* Thief plus one, or zero */
+        volatile int answer;   /* To the last request of this thread */
+        long from;             /* Range handed over by the victim */
+        long to;
+        int tag;
+        unsigned int seed;     /* To pick victims */
+        pthread_t thread;
+} __attribute__((aligned(PTT_CACHE_LINE)));
+
+
+static struct
+{
+        pthread_mutex_t busy;  /* Held while a loop is running */
+        pthread_mutex_t lock;
+        pthread_cond_t wake;
+        pthread_cond_t idle;
+        int started;
+        int count;             /* Threads running iterations */
+        int generation;        /* Loops started so far */
+        int done;              /* Pool threads done with the current loop */
+        int stop;
+        volatile long left;    /* Iterations not run yet */
+        long grain;
+        void (*fn) (long, long, void *);
+        void *arg;
+        struct ptt_poolworker *workers;
+} Pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+           PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static volatile int PoolTags;
+
+
+/*
+ * Task events of the calling thread, if traced.  Chunks also carry their
+ * amount of iterations.
+ */
+static void ptt_poolevent (int value, long size)
+{
+        struct ptt_threadbuf *tb;
+        int i;
+
+        tb = pthread_getspecific(PttGlobal.tlskey);
+        if (tb == NULL)
+                return;
+        ptt_enter(tb);
+        i = ptt_reserve(tb, 2);
+        tb->events[i].timestamp = ptt_getticks();
+        tb->events[i].type = PTT_TASK_EVENT;
+        tb->events[i].value = value;
+        tb->eventcount++;
+        if (value == PTT_TASK_RUNNING)
+        {
+                tb->events[i + 1].timestamp = tb->events[i].timestamp;
+                tb->events[i + 1].type = PTT_TSIZE_EVENT;
+                tb->events[i + 1].value = size;
+                tb->eventcount++;
+        }
+        ptt_leave(tb);
+}
+
+
+static void ptt_poolchunk (void (*fn) (long, long, void *), void *arg,
+                           long from, long to)
+{
+        ptt_poolevent(PTT_TASK_RUNNING, to - from);
+        fn(from, to, arg);
+        ptt_poolevent(PTT_TASK_END, 0);
+}
+
+
+/*
+ * Answer the pending steal request of a thread, if any, giving away half of
+ * its range when there is more than a chunk left.
+ */
+static void ptt_poolanswer (struct ptt_poolworker *w)
+{
+        struct ptt_poolworker *thief;
+        long half;
+
+        if (w->request == 0)
+                return;
+
+        thief = &Pool.workers[w->request - 1];
+        half = (w->end - w->next) / 2;
+        if (half >= Pool.grain)
+        {
+                thief->from = w->end - half;
+                thief->to = w->end;
+                thief->tag = PTT_POOL_TAG |
+                             (__sync_fetch_and_add(&PoolTags, 1) & 0x0fffffff);
+                w->end -= half;
+                if (pthread_getspecific(PttGlobal.tlskey) != NULL)
+                        ptt_send(thief->tag, half);
+                __sync_synchronize();
+                thief->answer = PTT_POOL_GIVEN;
+        }
+        else
+        {
+                thief->answer = PTT_POOL_REFUSED;
+        }
+        __sync_synchronize();
+        w->request = 0;
+}
+
+
+/*
+ * Look for work in other threads until some is found, or until the loop is
+ * finished.  Return zero in the latter case.
+ */
+static int ptt_poolsteal (int self)
+{
+        struct ptt_poolworker *w = &Pool.workers[self];
+        struct ptt_poolworker *victim;
+        int v;
+
+        if (Pool.count == 1)
+                return 0;
+
+        ptt_poolevent(PTT_TASK_STEALING, 0);
+        while (Pool.left > 0)
+        {
+                ptt_poolanswer(w);  /* Nothing to give */
+                v = rand_r(&w->seed) % (Pool.count - 1);
+                victim = &Pool.workers[v < self ? v : v + 1];
+                if (victim->request != 0)
+                {
+                        sched_yield();
+                        continue;
+                }
+
+                w->answer = PTT_POOL_WAITING;
+                __sync_synchronize();
+                if (!__sync_bool_compare_and_swap(&victim->request, 0,
+                                                  self + 1))
+                        continue;
+                while (w->answer == PTT_POOL_WAITING && Pool.left > 0)
+                {
+                        ptt_poolanswer(w);
+                        sched_yield();
+                }
+                if (w->answer == PTT_POOL_GIVEN)
+                {
+                        __sync_synchronize();
+                        w->next = w->from;
+                        w->end = w->to;
+                        if (pthread_getspecific(PttGlobal.tlskey) != NULL)
+                                ptt_recv(w->tag, w->to - w->from);
+                        ptt_poolevent(PTT_TASK_END, 0);
+                        return 1;
+                }
+        }
+        ptt_poolevent(PTT_TASK_END, 0);
+        return 0;
+}
+
+
+/*
+ * Run chunks of the own range, then stolen ones, until the loop is finished.
+ */
+static void ptt_poolwork (int self)
+{
+        struct ptt_poolworker *w = &Pool.workers[self];
+        long from;
+
+        do
+        {
+                while (w->next < w->end)
+                {
+                        ptt_poolanswer(w);
+                        from = w->next;
+                        w->next = from + Pool.grain < w->end ? from + Pool.grain
+                                                             : w->end;
+                        ptt_poolchunk(Pool.fn, Pool.arg, from, w->next);
+                        __sync_fetch_and_sub(&Pool.left, w->next - from);
+                }
+        }
+        while (ptt_poolsteal(self));
+}
+
+
+/*
+ * Pool threads wait for loops to run, until the process finishes.
+ */
+static void *ptt_poolthread (void *self)
+{
+        int generation = 0, stop, e;
+
+        for (;;)
+        {
+                e = pthread_mutex_lock(&Pool.lock);
+                ptt_assert(e == 0);
+                /* Begin critical section */
+                while (Pool.generation == generation && !Pool.stop)
+                        pthread_cond_wait(&Pool.wake, &Pool.lock);
+                generation = Pool.generation;
+                stop = Pool.stop;
+                /* End critical section */
+                e = pthread_mutex_unlock(&Pool.lock);
+                ptt_assert(e == 0);
+                if (stop)
+                        break;
+
+                ptt_poolwork((long) self);
+
+                e = pthread_mutex_lock(&Pool.lock);
+                ptt_assert(e == 0);
+                /* Begin critical section */
+                Pool.done++;
+                if (Pool.done == Pool.count - 1)
+                        pthread_cond_signal(&Pool.idle);
+                /* End critical section */
+                e = pthread_mutex_unlock(&Pool.lock);
+                ptt_assert(e == 0);
+        }
+        return NULL;
+}
+
+
+static void ptt_poolstart (void)
+{
+        char *env;
+        long i;
+        int e;
+
+        env = getenv("PTT_POOL_THREADS");
+        Pool.count = env != NULL ? atoi(env) : sysconf(_SC_NPROCESSORS_ONLN);
+        if (Pool.count < 1)
+                Pool.count = 1;
+        e = posix_memalign((void **) &Pool.workers, PTT_CACHE_LINE,
+                           Pool.count * sizeof(struct ptt_poolworker));
+        ptt_assert(e == 0);
+        for (i = 0;  i < Pool.count;  i++)
+        {
+                Pool.workers[i].seed = i + 1;
+                if (i == 0)
+                        continue;  /* The caller */
+                e = pthread_create(&Pool.workers[i].thread, NULL,
+                                   ptt_poolthread, (void *) i);
+                ptt_assert(e == 0);
+        }
+        Pool.started = 1;
+        ptt_debug("Pool of %d threads started", Pool.count);
+}
+
+
+/*
+ * First iteration of the even share of a thread, the remainder going to the
+ * first threads.  Computed so that it can not overflow.
+ */
+static inline long ptt_poolshare (long begin, long n, int i)
+{
+        long r = n % Pool.count;
+
+        return begin + (n / Pool.count) * i + (i < r ? i : r);
+}
+
+
+void ptt_parallel_for (long begin, long end, long grain,
+                       void (*fn) (long, long, void *), void *arg)
+{
+        long n = end - begin, from;
+        int e, i;
+
+        if (n <= 0)
+                return;
+
+        /* Busy, run the iterations here */
+        if (pthread_mutex_trylock(&Pool.busy) != 0)
+        {
+                if (grain <= 0)
+                        grain = n;
+                for (from = begin;  from < end;  from += grain)
+                        ptt_poolchunk(fn, arg, from,
+                                      from + grain < end ? from + grain : end);
+                return;
+        }
+
+        if (!Pool.started)
+                ptt_poolstart();
+        if (grain <= 0)
+                grain = n / (8 * Pool.count) > 0 ? n / (8 * Pool.count) : 1;
+
+        e = pthread_mutex_lock(&Pool.lock);
+        ptt_assert(e == 0);
+        /* Begin critical section */
+        Pool.fn = fn;
+        Pool.arg = arg;
+        Pool.grain = grain;
+        Pool.left = n;
+        Pool.done = 0;
+        for (i = 0;  i < Pool.count;  i++)
+        {
+                Pool.workers[i].next = ptt_poolshare(begin, n, i);
+                Pool.workers[i].end = ptt_poolshare(begin, n, i + 1);
+                Pool.workers[i].request = 0;
+        }
+        Pool.generation++;
+        pthread_cond_broadcast(&Pool.wake);
+        /* End critical section */
+        e = pthread_mutex_unlock(&Pool.lock);
+        ptt_assert(e == 0);
+
+        ptt_poolwork(0);
+
+        e = pthread_mutex_lock(&Pool.lock);
+        ptt_assert(e == 0);
+        /* Begin critical section */
+        while (Pool.done < Pool.count - 1)
+                pthread_cond_wait(&Pool.idle, &Pool.lock);
+        /* End critical section */
+        e = pthread_mutex_unlock(&Pool.lock);
+        ptt_assert(e == 0);
+
+        pthread_mutex_unlock(&Pool.busy);
+}
+
+
+/*
+ * Finish the pool threads, so that their traces are complete before the post
+ * processing.
+ */
+void ptt_poolstop (void)
+{
+        int e, i;
+
+        if (!Pool.started)
+                return;
+
+        e = pthread_mutex_lock(&Pool.lock);
+        ptt_assert(e == 0);
+        Pool.stop = 1;
+        pthread_cond_broadcast(&Pool.wake);
+        e = pthread_mutex_unlock(&Pool.lock);
+        ptt_assert(e == 0);
+
+        for (i = 1;  i < Pool.count;  i++)
+                pthread_join(Pool.workers[i].thread, NULL);
+        free(Pool.workers);
+        Pool.started = 0;
+}
+
+
+/*
+ * The pool threads are not inherited by a forked child, which starts its own
+ * pool if needed.
+ */
+void ptt_poolfork (void)
+{
+        pthread_mutex_init(&Pool.busy, NULL);
+        pthread_mutex_init(&Pool.lock, NULL);
+        pthread_cond_init(&Pool.wake, NULL);
+        pthread_cond_init(&Pool.idle, NULL);
+        Pool.started = 0;
+        Pool.stop = 0;
+}
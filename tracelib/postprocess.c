@@ -20,14 +20,10 @@
  * representation.
  */
 
-#include <sys/mman.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
 
 /*
  * This string is generated automatically, for each binary, by the build system.
@@ -37,19 +33,123 @@ extern const char *PttPCF;
 
 
 /*
- * Most of the information contained in each single thread trace resides
- * implicitly within the file meta data.  This way the file contents remains
- * extremely simple and compact.  But for post-processing such information needs
- * to be extracted.
+ * Generate the PCF auxiliary file.  A file which will help identifying the
+ * event types and, optionally, values; among other things.  Fortunately, its
+ * contents have been already generated by the build system.
  */
-struct ptt_threadtrace
+static void ptt_writepcf (const char *trace, int sampled)
 {
-        int fd;
-        unsigned int count;
-        unsigned int current;
-        struct ptt_event *event;
-        char filename[32];
-};
+        char filename[256];
+        FILE *output;
+        int e;
+
+        snprintf(filename, 255, "%s.pcf", trace);
+        output = fopen(filename, "w");
+        ptt_assert(output != NULL);
+
+        e = fprintf(output, PttPCF);
+        ptt_assert(e > 0);
+        if (sampled)
+        {
+                ptt_symbolwrite(output);
+                ptt_symbolfini();
+        }
+
+        e = fclose(output);
+        ptt_assert(e != EOF);
+}
+
+
+/*
+ * Finally, go with the ROW auxiliary file.  This is useful to have nice Y-axis
+ * labels in the Paraver windows.
+ */
+static void ptt_writerow (const char *trace)
+{
+        char filename[256];
+        FILE *output;
+        int e, i;
+
+        snprintf(filename, 255, "%s.row", trace);
+        output = fopen(filename, "w");
+        ptt_assert(output != NULL);
+
+        if (PttGlobal.parentid != 0)
+                e = fprintf(output, "LEVEL TASK            SIZE 1\n"
+                                    "Process %d\n", PttGlobal.processid);
+        else
+                e = fprintf(output, "LEVEL TASK            SIZE 1\n"
+                                    "Main process\n");
+        ptt_assert(e > 0);
+        e = fprintf(output, "LEVEL THREAD            SIZE %d\n",
+                    PttGlobal.postcount);
+        ptt_assert(e > 0);
+        for (i = 1;  i <= PttGlobal.postcount;  i++)
+        {
+                e = fprintf(output, "Thread %d\n", i);
+                ptt_assert(e > 0);
+        }
+
+        e = fclose(output);
+        ptt_assert(e != EOF);
+}
+
+
+/*
+ * Name of the trace, without extension, or of one of its parts.  Only looked
+ * for once per process, so that all the parts of a rotated trace share it (see
+ * "rotate.c").  Use a negative segment for the name of the whole trace.
+ */
+static void ptt_tracename (char *trace, int segment)
+{
+        static char name[256];
+        static pid_t owner;
+        char filename[256];
+        char childprefix[256];
+        char *prefix;             /* Output filenames common prefix */
+        int trnum;                /* TRace NUMber used to generate filenames */
+        int e;
+
+        /*
+         * Look for available trace names.  In order to recycle names as much as
+         * possible, the check is done with the ".row" file because is the last
+         * one we write; meaning that the trace generation has succeeded.
+         * Rotated traces write it right away, to claim the name for all their
+         * parts, and again at the end.
+         *
+         * Forked children add their process identifier to the name, so they
+         * never compete with their parent or siblings for the same names.
+         */
+        if (owner != PttGlobal.processid)
+        {
+                prefix = getenv("PTT_TRACE_NAME");
+                if (prefix == NULL)
+                        prefix = "ptt-trace";
+                if (PttGlobal.parentid != 0)
+                {
+                        snprintf(childprefix, 255, "%s-%d", prefix,
+                                 PttGlobal.processid);
+                        prefix = childprefix;
+                }
+                for (trnum = 1;  trnum < 1000;  trnum++)
+                {
+                        snprintf(filename, 255, "%s-%03d.row", prefix, trnum);
+                        e = access(filename, F_OK);
+                        if (e == -1)
+                                break;
+                }
+                ptt_assert(trnum < 1000);
+                snprintf(name, 255, "%s-%03d", prefix, trnum);
+                owner = PttGlobal.processid;
+                if (PttGlobal.rotate)
+                        ptt_writerow(name);
+        }
+
+        if (PttGlobal.rotate && segment >= 0)
+                snprintf(trace, 255, "%s.part%d", name, segment);
+        else
+                snprintf(trace, 255, "%s", name);
+}
 
 
 /*
@@ -59,39 +159,78 @@ struct ptt_threadtrace
  */
 void ptt_postprocess (void)
 {
-        struct ptt_threadtrace *thtrace;
-        char *prefix;             /* Output filenames common prefix */
+        struct timeval starttime = PttGlobal.starttime;
+        uint64_t startstamp = PttGlobal.startstamp;
+        int segment = 0;
+        char trace[256];
+#ifdef PTT_MALLOCWRAP
+        char filename[256];
+#endif
+
+        /* Only the last part is left when the trace is rotated */
+        if (PttGlobal.rotate)
+                segment = ptt_rotatelast(&startstamp, &starttime);
+
+#ifdef PTT_MALLOCWRAP
+        ptt_tracename(trace, segment);
+        snprintf(filename, 255, "%s.malloc.csv", trace);
+        ptt_mallocwrite(filename);
+#endif
+        ptt_postsegment(segment, startstamp, PttGlobal.endstamp, &starttime,
+                        &PttGlobal.endtime);
+        if (PttGlobal.rotate)
+        {
+                ptt_tracename(trace, -1);
+                ptt_writerow(trace);
+        }
+}
+
+
+/*
+ * Post process the events of a segment of the trace, given the time stamps
+ * and times of day of its beginning and end.  Unless the trace is rotated,
+ * the only segment is the whole trace.
+ */
+void ptt_postsegment (int segment, uint64_t startstamp, uint64_t endstamp,
+                      const struct timeval *starttime,
+                      const struct timeval *endtime)
+{
+        struct ptt_merge *merge;  /* Merged stream of all thread traces */
+        struct ptt_record rec;
+        struct ptt_comm comm;
+        struct ptt_state state;
+        struct ptt_output prv;    /* Trace file, possibly compressed */
+        const struct ptt_backend *be;  /* Trace format */
         FILE *output;
-        time_t date;
-        int trnum;                /* TRace NUMber used to generate filenames */
-        int b, e, fd;
-        int i, si;                /* thread Index, Selected thread Index */
+        int level;                /* Compression level for the .prv file */
+        int profile;              /* Whether to compute the state profile */
+        int index;                /* Whether to write the time index */
+        int lod;                  /* Whether to write the overview pyramid */
+        int states;               /* Whether to write state records */
+        int columns;              /* Whether to write the columnar dataset */
+        int fraction;             /* On CPU fraction, in thousandths */
+        int sampled;              /* Whether there are addresses to resolve */
+        uint64_t offset;          /* Current size of the trace contents */
+        int i, e;
         uint64_t duration;        /* Duration of the trace, in nanoseconds */
-        uint64_t ts, sts, ns;     /* Time Stamp, Selected Time Stamp, NanoSecs */
-        unsigned int ec, totale;  /* Event Counter, Total Events */
-        int type, value;          /* Event type, Event value */
+        uint64_t ns = 0;          /* Event time stamp, in nanoseconds */
+        uint64_t hold;            /* Earliest incomplete record */
         double nsratio;           /* Nanosecond to tick ratio */
-        struct stat meta;         /* File meta data */
-        struct tm localdate;
-        char strdate[32];
         char filename[256];
+        char trace[256];          /* Prefix plus trace number */
 
         /*
-         * Look for available trace names.  In order to recycle names as much as
-         * possible, the check is done with the ".row" file because is the last
-         * one we write; meaning that the trace generation has succeeded.
+         * Threads may still be created while the parts of a rotated trace are
+         * post processed, so their amount is taken once and for all.  Those
+         * created afterwards have no events in this part (see "rotate.c").
          */
-        prefix = getenv("PTT_TRACE_NAME");
-        if (prefix == NULL)
-                prefix = "ptt-trace";
-        for (trnum = 1;  trnum < 1000;  trnum++)
-        {
-                snprintf(filename, 255, "%s-%03d.row", prefix, trnum);
-                e = access(filename, F_OK);
-                if (e == -1)
-                        break;
-        }
-        ptt_assert(i < 1000);
+        e = pthread_mutex_lock(&PttGlobal.countlock);
+        ptt_assert(e == 0);
+        PttGlobal.postcount = PttGlobal.threadcount;
+        e = pthread_mutex_unlock(&PttGlobal.countlock);
+        ptt_assert(e == 0);
+
+        ptt_tracename(trace, segment);
 
         /*
          * Calculate the ratio between nanoseconds and clock ticks in order to
@@ -99,155 +238,228 @@ void ptt_postprocess (void)
          * prior to that, we need to know the duration of the trace in
          * nanoseconds.
          */
-        duration = (uint64_t) ((int64_t) (PttGlobal.endtime.tv_sec -
-                                          PttGlobal.starttime.tv_sec) * 1000000LL +
-                               (int64_t) (PttGlobal.endtime.tv_usec -
-                                          PttGlobal.starttime.tv_usec)) * 1000LL;
-        nsratio = (double) duration / (double) (PttGlobal.endstamp -
-                                                PttGlobal.startstamp);
+        duration = (uint64_t) ((int64_t) (endtime->tv_sec -
+                                          starttime->tv_sec) * 1000000LL +
+                               (int64_t) (endtime->tv_usec -
+                                          starttime->tv_usec)) * 1000LL;
+        nsratio = (double) duration / (double) (endstamp - startstamp);
 
         /*
-         * Make some room to hold each trace representing a single thread.
+         * Folded thread traces are turned back into plain events first, so
+         * nothing else needs to know about them (see "fold.c").
          */
-        thtrace = malloc(PttGlobal.threadcount * sizeof(struct ptt_threadtrace));
-        ptt_assert(thtrace != NULL);
+        if (PttGlobal.fold)
+                for (i = 1;  i <= PttGlobal.postcount;  i++)
+                        ptt_foldexpand(i, segment);
 
         /*
-         * Ok then, the way traces are going to be traversed is by memory
-         * mapping, which provides the easiest access method for this scenario.
-         *
-         * Having the traces as binary files provides three main advantages:
+         * The tracing overhead is removed before anything else looks at the
+         * time stamps, and so is it from the end of the trace (see
+         * "overhead.c").
+         */
+        if (PttGlobal.eventcost > 0)
+                duration -= (uint64_t) ((double) ptt_compensate(trace, segment,
+                                                                nsratio) *
+                                        nsratio);
+
+        /*
+         * Raw traces are kept as they are, without merging (see "raw.c").
+         */
+        if (getenv("PTT_RAW") != NULL && atoi(getenv("PTT_RAW")) != 0)
+        {
+                ptt_rawwrite(trace, segment, startstamp, duration, nsratio);
+                ptt_writepcf(trace, 0);
+                ptt_writerow(trace);
+                return;
+        }
+
+        /*
+         * Prepare the merge of the thread traces.  Having the traces as binary
+         * files provides three main advantages:
          *
          *      1) No need to parse text.
-         *      2) Files are smaller and, thus, can be mapped altogether
-         *         consuming less virtual memory.
+         *      2) Files are smaller and, thus, cheaper to read back.
          *      3) Records have fixed length so the structure is predictable.
+         *
+         * The merge reads each file through a small window, so the memory and
+         * the amount of open files needed do not depend on the trace size (see
+         * "merge.c" for details).
          */
-        totale = 0;
-        for (i = 0;  i < PttGlobal.threadcount;  i++)
-        {
-                snprintf(thtrace[i].filename, 31, "/tmp/ptt-%d-%04d.tt",
-                         PttGlobal.processid, i + 1);
-                fd = open(thtrace[i].filename, O_RDONLY);
-                ptt_assert(fd != -1);
-
-                e = fstat(fd, &meta);
-                ptt_assert(e != -1);
-                ptt_assert(meta.st_size % sizeof(struct ptt_event) == 0);
-
-                thtrace[i].fd = fd;
-                thtrace[i].current = 0;
-                thtrace[i].count = meta.st_size / sizeof(struct ptt_event);
-                thtrace[i].event = mmap(NULL, meta.st_size, PROT_READ,
-                                        MAP_PRIVATE, fd, 0);
-                ptt_assert(thtrace[i].event != MAP_FAILED);
-
-                totale += thtrace[i].count;
-        }
+        merge = ptt_mergeopen(PttGlobal.postcount, segment);
 
         /*
-         * Now we have all information available in the "thtrace" array.  It's
-         * time to start generating Paraver information, so create a .prv file
-         * on which the results can be streamed.  This time we use buffered I/O
-         * to reduce the amount of system calls and improve performance.
+         * It's time to start generating trace information, so create a .prv
+         * file (or whatever the chosen format uses) on which the results can
+         * be streamed.  This time we use buffered I/O to reduce the amount of
+         * system calls and improve performance.  If compression is enabled,
+         * the stream is compressed by another thread.
          */
-        snprintf(filename, 255, "%s-%03d.prv", prefix, trnum);
-        output = fopen(filename, "w");
+        be = ptt_backendselect();
+        level = ptt_outputlevel();
+        snprintf(filename, 255, "%s%s%s", trace, be->suffix,
+                 level > 0 ? ".gz" : "");
+        output = ptt_openoutput(&prv, filename, level);
         ptt_assert(output != NULL);
 
-        date = time(NULL);
-        localtime_r(&date, &localdate);
-        strftime(strdate, 31, "%d/%m/%y at %H:%M", &localdate);
-        e = fprintf(output, "#Paraver (%s):%llu_ns:0:1:1(%d:0)\n", strdate,
-                    duration, PttGlobal.threadcount);
-        ptt_assert(e > 0);
+        /*
+         * The state time profile is computed along the merge, unless it has
+         * been explicitly disabled.
+         */
+        profile = getenv("PTT_PROFILE") == NULL || atoi(getenv("PTT_PROFILE")) != 0;
+        if (profile)
+                ptt_profileinit(PttGlobal.postcount);
+
+        /*
+         * Same for the time index, which needs to know where each record has
+         * been written.  Fortunately fprintf() tells how much it wrote.  Only
+         * Paraver traces are indexed.
+         */
+        index = be == &PttParaver && (getenv("PTT_INDEX") == NULL ||
+                                      atoi(getenv("PTT_INDEX")) != 0);
+        if (index)
+                ptt_indexinit(duration);
+
+        /*
+         * The level of detail pyramid does not depend on the trace format.
+         */
+        lod = getenv("PTT_LOD") == NULL || atoi(getenv("PTT_LOD")) != 0;
+        if (lod)
+                ptt_lodinit(PttGlobal.postcount, duration);
+
+        /*
+         * State records are written unless disabled or there is no event type
+         * to derive them from.
+         */
+        states = PttStateType != 0 && (getenv("PTT_STATES") == NULL ||
+                                       atoi(getenv("PTT_STATES")) != 0);
+        if (states)
+                ptt_stateinit(PttGlobal.postcount);
+
+        /*
+         * The columnar dataset has to be asked for explicitly.
+         */
+        columns = getenv("PTT_COLUMNS") != NULL &&
+                  atoi(getenv("PTT_COLUMNS")) != 0;
+        if (columns)
+                ptt_columninit(trace);
 
         /*
          * Time to merge.  Each individual trace (per thread) is sorted in time,
          * so we follow the same criterion in order to produce the combined
          * trace.
+         *
+         * Communication events are not written as such.  Once both ends of a
+         * communication are known, a communication record is produced
+         * instead.  Like state records, it is complete after its time, so
+         * records go through a reordering buffer, which writes them sorted by
+         * time once nothing earlier can show up (see "reorder.c").
          */
-        for (ec = 1;  ec <= totale;  ec++)
+        ptt_comminit(PttGlobal.postcount);
+        if (PttGlobal.cputime)
+                ptt_cpuinit(PttGlobal.postcount);
+        sampled = PttGlobal.sampleperiod > 0 || PttGlobal.functions;
+        if (sampled)
+                ptt_symbolinit(PttGlobal.postcount);
+        offset = be->begin(output, duration);
+        ptt_reorderinit(be, output, index, offset);
+        while (ptt_mergenext(merge, &rec))
         {
-                /* Find the first thread with remaining events */
-                for (i = 0;  thtrace[i].current >= thtrace[i].count;  i++);
-                si = i;
-                sts = thtrace[i].event[thtrace[i].current].timestamp;
-                /* From there, search the next event (lowest time stamp) */
-                for (;  i < PttGlobal.threadcount;  i++)
+                /* Write what can be written, make room if full */
+                if (ptt_reorderdue())
                 {
-                        if (thtrace[i].current >= thtrace[i].count)
-                                continue;
-                        ts = thtrace[i].event[thtrace[i].current].timestamp;
-                        if (ts < sts)
+                        hold = ptt_commhold();
+                        if (states && ptt_statehold() < hold)
+                                hold = ptt_statehold();
+                        if (ptt_reorderwrite(hold))
                         {
-                                si = i;
-                                sts = ts;
+                                ptt_commexpire();
+                                for (i = 0;  states && i < PttGlobal.postcount;
+                                     i++)
+                                        if (ptt_statesplit(i, ns, &state))
+                                                ptt_reorderstate(&state);
                         }
                 }
-                /* Print the event */
-                ns = (uint64_t) ((double) (sts - PttGlobal.startstamp) * nsratio);
-                e = fprintf(output, "2:0:1:1:%d:%llu:%d:%d\n", si + 1, ns,
-                            thtrace[si].event[thtrace[si].current].type,
-                            thtrace[si].event[thtrace[si].current].value);
-                ptt_assert(e > 0);
-                /* Done with this event */
-                thtrace[si].current++;
+
+                /* Late events from a previous part go at the beginning */
+                if (rec.timestamp < startstamp)
+                        rec.timestamp = startstamp;
+                ns = (uint64_t) ((double) (rec.timestamp - startstamp) * nsratio);
+                if (sampled && rec.type >= PTT_HIGH_EVENT &&
+                    rec.type <= PTT_FUNC_EVENT)
+                {
+                        rec.value = ptt_symbolevent(rec.thread, rec.type,
+                                                    rec.value);
+                        if (rec.value < 0)
+                                continue;
+                }
+                if (columns)
+                        ptt_columnevent(rec.thread, ns, rec.type, rec.value);
+                if (lod)
+                        ptt_lodevent(rec.thread, ns, rec.type, rec.value);
+                if (rec.type >= PTT_SEND_EVENT && rec.type <= PTT_SIZE_EVENT)
+                {
+                        if (ptt_commevent(rec.thread, ns, rec.type, rec.value,
+                                          &comm))
+                                ptt_reordercomm(&comm);
+                        continue;
+                }
+                if (states && (rec.type == PttStateType ||
+                               (rec.type == PTT_PHASE_EVENT && rec.value == 0)) &&
+                    ptt_stateevent(rec.thread, ns, rec.type, rec.value, &state))
+                        ptt_reorderstate(&state);
+                ptt_reorderevent(rec.thread, ns, rec.type, rec.value);
+                if (profile)
+                        ptt_profileevent(rec.thread, ns, rec.type, rec.value);
+
+                /* CPU time samples come with the derived on CPU fraction */
+                if (PttGlobal.cputime &&
+                    (fraction = ptt_cpuevent(rec.thread, ns, rec.type,
+                                             rec.value)) >= 0)
+                {
+                        ptt_reorderevent(rec.thread, ns, PTT_ONCPU_EVENT,
+                                         fraction);
+                        if (columns)
+                                ptt_columnevent(rec.thread, ns, PTT_ONCPU_EVENT,
+                                                fraction);
+                }
         }
 
         /*
-         * Done merging.  Release the mapped regions and remove the temporary
-         * files.  Also free the allocated memory region.
+         * Done merging.  The temporary files have been removed as they were
+         * consumed.  States still open last until the end of the trace.
          */
-        e = fclose(output);
-        ptt_assert(e != EOF);
-        for (i = 0;  i < PttGlobal.threadcount;  i++)
+        if (states)
         {
-                e = munmap(thtrace[i].event, thtrace[i].count *
-                                             sizeof(struct ptt_event));
-                ptt_assert(e != -1);
-                e = close(thtrace[i].fd);
-                ptt_assert(e != -1);
-                unlink(thtrace[i].filename);  /* Ignore errors */
+                for (i = 0;  i < PttGlobal.postcount;  i++)
+                        if (ptt_stateclose(i, duration, &state))
+                                ptt_reorderstate(&state);
+                ptt_statefini();
         }
-        free(thtrace);
-
-        /*
-         * Generate the PCF auxiliary file.  A file which will help identifying
-         * the event types and, optionally, values; among other things.
-         * Fortunately, its contents have been already generated by the build
-         * system.
-         */
-        snprintf(filename, 255, "%s-%03d.pcf", prefix, trnum);
-        output = fopen(filename, "w");
-        ptt_assert(output != NULL);
-
-        e = fprintf(output, PttPCF);
-        ptt_assert(e > 0);
-
-        e = fclose(output);
-        ptt_assert(e != EOF);
+        offset = ptt_reorderfini();
+        be->end(output);
+        ptt_closeoutput(&prv);
+        ptt_mergeclose(merge);
+        ptt_commfini();
+        if (PttGlobal.cputime)
+                ptt_cpufini();
 
-        /*
-         * Finally, go with the ROW auxiliary file.  This is useful to have nice
-         * Y-axis labels in the Paraver windows.
-         */
-        snprintf(filename, 255, "%s-%03d.row", prefix, trnum);
-        output = fopen(filename, "w");
-        ptt_assert(output != NULL);
-
-        e = fprintf(output, "LEVEL TASK            SIZE 1\n"
-                            "Main process\n"
-                            "LEVEL THREAD            SIZE %d\n",
-                            PttGlobal.threadcount);
-        ptt_assert(e > 0);
-        for (i = 1;  i <= PttGlobal.threadcount;  i++)
+        if (profile)
         {
-                e = fprintf(output, "Thread %d\n", i);
-                ptt_assert(e > 0);
+                snprintf(filename, 255, "%s.profile.csv", trace);
+                ptt_profilewrite(filename, duration);
         }
-
-        e = fclose(output);
-        ptt_assert(e != EOF);
+        if (index)
+        {
+                snprintf(filename, 255, "%s.idx", trace);
+                ptt_indexwrite(filename, offset);
+        }
+        if (lod)
+        {
+                snprintf(filename, 255, "%s.lod", trace);
+                ptt_lodwrite(filename);
+        }
+        ptt_writepcf(trace, sampled);
+        if (columns)
+                ptt_columnwrite(trace, duration);
+        ptt_writerow(trace);
 }
-
@@ -0,0 +1,298 @@
+/*
+ * profile.c - Per thread state time profile computed while merging
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * Every event type is treated as a tiny state machine per thread: an event
+ * sets the type's current value, which lasts until the next event of the same
+ * type in the same thread, or until the thread finishes.  The post processor
+ * feeds every merged event here, so the time spent in each value is
+ * accumulated without a second pass over the data.
+ *
+ * The result is a CSV file with one row per thread, type and value.  Besides
+ * the total time and its share of the thread lifetime, each row includes a
+ * histogram of the interval lengths in decades, from one microsecond to one
+ * second.
+ *
+ * Types used as counters (iteration numbers and the like) would produce a row
+ * per distinct value, so once a type exceeds PTT_PROFILE_VALUES distinct
+ * values, the rest are accumulated in a single "other" row.
+ *
+ * Types are looked up in an open addressing hash per thread, doubled when half
+ * full, and values in a fixed one per type, twice as large as the values it
+ * can hold.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PTT_PROFILE_VALUES   256
+#define PTT_PROFILE_BUCKETS  8
+#define PTT_PROFILE_OTHER    PTT_PROFILE_VALUES
+#define PTT_PROFILE_SLOTS    (2 * PTT_PROFILE_VALUES)
+
+
+struct ptt_profilevalue
+{
+        int value;
+        uint64_t count;
+        uint64_t total;
+        uint64_t min;
+        uint64_t max;
+        uint64_t histogram[PTT_PROFILE_BUCKETS];
+};
+
+struct ptt_profiletype
+{
+        int type;
+        int current;     /* Index of the current value, -1 if none */
+        uint64_t since;  /* Time stamp when the current value was set */
+        int valuecount;
+        short slots[PTT_PROFILE_SLOTS];  /* Value index plus one, or zero */
+        struct ptt_profilevalue values[PTT_PROFILE_VALUES + 1];
+};
+
+struct ptt_profilethread
+{
+        uint64_t first;
+        uint64_t last;
+        int finished;
+        int typecount;
+        int typeslots;                      /* Hash size, a power of two */
+        struct ptt_profiletype **types;     /* In order of appearance */
+        struct ptt_profiletype **typehash;
+};
+
+
+static struct ptt_profilethread *Profile;
+static int ProfileThreads;
+
+
+/*
+ * Prepare the profile for the given amount of threads.
+ */
+void ptt_profileinit (int threads)
+{
+        Profile = calloc(threads, sizeof(struct ptt_profilethread));
+        ptt_assert(Profile != NULL);
+        ProfileThreads = threads;
+}
+
+
+/*
+ * Account the time elapsed since the current value of a type was set.
+ */
+static void ptt_profileclose (struct ptt_profiletype *pt, uint64_t ns)
+{
+        struct ptt_profilevalue *pv;
+        uint64_t length, limit;
+        int b;
+
+        if (pt->current < 0)
+                return;
+
+        pv = &pt->values[pt->current];
+        length = ns - pt->since;
+        if (pv->count == 0 || length < pv->min)
+                pv->min = length;
+        if (length > pv->max)
+                pv->max = length;
+        pv->count++;
+        pv->total += length;
+
+        limit = 1000;
+        for (b = 0;  b < PTT_PROFILE_BUCKETS - 1 && length >= limit;  b++)
+                limit *= 10;
+        pv->histogram[b]++;
+
+        pt->current = -1;
+}
+
+
+static inline unsigned int ptt_profilehash (int key)
+{
+        unsigned int h = (unsigned int) key * 2654435761u;
+
+        return h ^ (h >> 16);
+}
+
+
+/*
+ * Slot of a type in the hash of a thread, either holding it or empty.
+ */
+static unsigned int ptt_profileslot (struct ptt_profilethread *th, int type)
+{
+        unsigned int h = ptt_profilehash(type) & (th->typeslots - 1);
+
+        while (th->typehash[h] != NULL && th->typehash[h]->type != type)
+                h = (h + 1) & (th->typeslots - 1);
+        return h;
+}
+
+
+/*
+ * Find the profile of a type in a thread, creating it if needed.
+ */
+static struct ptt_profiletype *ptt_profiletype (struct ptt_profilethread *th,
+                                                int type)
+{
+        struct ptt_profiletype *pt;
+        unsigned int h;
+        int i;
+
+        if (2 * (th->typecount + 1) > th->typeslots)
+        {
+                free(th->typehash);
+                th->typeslots = th->typeslots > 0 ? 2 * th->typeslots : 16;
+                th->typehash = calloc(th->typeslots,
+                                      sizeof(struct ptt_profiletype *));
+                ptt_assert(th->typehash != NULL);
+                for (i = 0;  i < th->typecount;  i++)
+                        th->typehash[ptt_profileslot(th, th->types[i]->type)] =
+                                th->types[i];
+        }
+
+        h = ptt_profileslot(th, type);
+        if (th->typehash[h] != NULL)
+                return th->typehash[h];
+
+        th->types = realloc(th->types, (th->typecount + 1) *
+                                       sizeof(struct ptt_profiletype *));
+        ptt_assert(th->types != NULL);
+        pt = calloc(1, sizeof(struct ptt_profiletype));
+        ptt_assert(pt != NULL);
+        pt->type = type;
+        pt->current = -1;
+        th->types[th->typecount] = pt;
+        th->typecount++;
+        th->typehash[h] = pt;
+        return pt;
+}
+
+
+/*
+ * Feed a merged event, already converted to nanoseconds, into the profile.
+ */
+void ptt_profileevent (int thread, uint64_t ns, int type, int value)
+{
+        struct ptt_profilethread *th = &Profile[thread];
+        struct ptt_profiletype *pt;
+        unsigned int h;
+        int i;
+
+        if (th->typecount == 0)
+                th->first = ns;
+        th->last = ns;
+
+        pt = ptt_profiletype(th, type);
+        ptt_profileclose(pt, ns);
+
+        /* The thread is gone, so are its states */
+        if (type == PTT_PHASE_EVENT && value == 0)
+        {
+                for (i = 0;  i < th->typecount;  i++)
+                        ptt_profileclose(th->types[i], ns);
+                th->finished = 1;
+                return;
+        }
+
+        h = ptt_profilehash(value) & (PTT_PROFILE_SLOTS - 1);
+        while ((i = pt->slots[h]) != 0 && pt->values[i - 1].value != value)
+                h = (h + 1) & (PTT_PROFILE_SLOTS - 1);
+        if (i > 0)
+        {
+                i--;
+        }
+        else if (pt->valuecount < PTT_PROFILE_VALUES)
+        {
+                i = pt->valuecount++;
+                pt->values[i].value = value;
+                pt->slots[h] = i + 1;
+        }
+        else
+                i = PTT_PROFILE_OTHER;
+        pt->current = i;
+        pt->since = ns;
+}
+
+
+/*
+ * Write one CSV row.
+ */
+static void ptt_profilerow (FILE *output, int thread, int type, const char *value,
+                            struct ptt_profilevalue *pv, uint64_t lifetime)
+{
+        int b, e;
+
+        e = fprintf(output, "%d,%d,%s,%llu,%llu,%.3f,%llu,%llu", thread + 1, type,
+                    value, pv->count, pv->total, lifetime > 0 ?
+                    100.0 * (double) pv->total / (double) lifetime : 0.0,
+                    pv->min, pv->max);
+        ptt_assert(e > 0);
+        for (b = 0;  b < PTT_PROFILE_BUCKETS;  b++)
+        {
+                e = fprintf(output, ",%llu", pv->histogram[b]);
+                ptt_assert(e > 0);
+        }
+        e = fputc('\n', output);
+        ptt_assert(e != EOF);
+}
+
+
+/*
+ * Close whatever is still open at the end of the trace, write the CSV file and
+ * release the profile memory.
+ */
+void ptt_profilewrite (const char *filename, uint64_t duration)
+{
+        struct ptt_profilethread *th;
+        struct ptt_profiletype *pt;
+        FILE *output;
+        char value[16];
+        int e, i, t, v;
+
+        output = fopen(filename, "w");
+        ptt_assert(output != NULL);
+
+        e = fprintf(output, "thread,type,value,intervals,total_ns,percent,min_ns,"
+                            "max_ns,lt_1us,lt_10us,lt_100us,lt_1ms,lt_10ms,"
+                            "lt_100ms,lt_1s,ge_1s\n");
+        ptt_assert(e > 0);
+
+        for (i = 0;  i < ProfileThreads;  i++)
+        {
+                th = &Profile[i];
+                if (!th->finished)
+                        th->last = duration;
+                for (t = 0;  t < th->typecount;  t++)
+                {
+                        pt = th->types[t];
+                        ptt_profileclose(pt, th->last);
+                        for (v = 0;  v < pt->valuecount;  v++)
+                        {
+                                snprintf(value, 15, "%d", pt->values[v].value);
+                                ptt_profilerow(output, i, pt->type, value,
+                                               &pt->values[v],
+                                               th->last - th->first);
+                        }
+                        if (pt->values[PTT_PROFILE_OTHER].count > 0)
+                                ptt_profilerow(output, i, pt->type, "other",
+                                               &pt->values[PTT_PROFILE_OTHER],
+                                               th->last - th->first);
+                        free(pt);
+                }
+                free(th->types);
+                free(th->typehash);
+        }
+        free(Profile);
+
+        e = fclose(output);
+        ptt_assert(e != EOF);
+}
@@ -1,2 +1,17 @@
+/* Communication tags from here on are used by ptt_parallel_for() */
+#define PTT_POOL_TAG  0x70000000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern void ptt_event  (int, int);
 extern void ptt_events (int, ...);
+extern void ptt_send   (int, int);
+extern void ptt_recv   (int, int);
+extern void ptt_parallel_for (long, long, long, void (*) (long, long, void *),
+                              void *);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,155 @@
+/*
+ * ptt.hpp - Typed event generation for C++ programs
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#ifndef __ptt_typed
+#define __ptt_typed
+
+/*
+ * The constants generated for C programs all live in the same enumeration,
+ * where value names of different event types easily clash (see "event.c").
+ * For C++ sources, the build system generates a "pcf_program.hpp" header
+ * instead, where every event type is a class and its values are classes nested
+ * in it.  From the PCF definitions
+ *
+ *      EVENT_TYPE
+ *      0    3000    Phase
+ *      VALUES
+ *      1      Main loop
+ *      2      Finishing
+ *
+ * the following is generated:
+ *
+ *      struct Phase : ptt::type<3000>
+ *      {
+ *              struct MainLoop : ptt::value<Phase, 1> {};
+ *              struct Finishing : ptt::value<Phase, 2> {};
+ *      };
+ *
+ * These classes are only used as template arguments, so that type and value
+ * are compile time constants:
+ *
+ *      ptt::event<Phase::Finishing>();        // ptt_event(3000, 2)
+ *      ptt::event<Phase>(i);                  // ptt_event(3000, i)
+ *      {
+ *              ptt::scope<Phase::MainLoop> s;  // ptt_event(3000, 1)
+ *              ...
+ *      }                                      // ptt_event(3000, 0)
+ *
+ * They all end up in the same ptt_event() calls as C programs do.  Event types
+ * can be disabled at compile time by specializing ptt::enabled, in which case
+ * their events produce no code at all:
+ *
+ *      namespace ptt
+ *      {
+ *              template <> struct enabled<Phase> : disabled {};
+ *      }
+ *
+ * In untraced builds (see "stub.h") every type is disabled.
+ */
+
+#ifdef ptt_event
+#  define PTT_ENABLED  false  /* Untraced */
+#else
+#  include "ptt.h"
+#  define PTT_ENABLED  true
+#endif
+
+
+namespace ptt
+{
+
+template <int Id> struct type
+{
+        static constexpr int id = Id;
+};
+
+template <typename Type, int Value> struct value
+{
+        typedef Type type;
+        static constexpr int id = Value;
+};
+
+
+struct disabled
+{
+        static constexpr bool value = false;
+};
+
+template <typename Type> struct enabled
+{
+        static constexpr bool value = PTT_ENABLED;
+};
+
+
+namespace detail
+{
+
+template <bool Enabled> struct emit
+{
+        static inline void event (int type, int value)
+        {
+                ptt_event(type, value);
+        }
+};
+
+template <> struct emit<false>
+{
+        static inline void event (int, int)
+        {
+        }
+};
+
+}  /* namespace detail */
+
+
+/*
+ * An event of the given type with a run time value.
+ */
+template <typename Type> inline void event (int value)
+{
+        detail::emit<enabled<Type>::value>::event(Type::id, value);
+}
+
+
+/*
+ * An event of one of the values of a type.
+ */
+template <typename Value> inline void event ()
+{
+        typedef typename Value::type Type;
+
+        detail::emit<enabled<Type>::value>::event(Type::id, Value::id);
+}
+
+
+/*
+ * Set a value of a type for the lifetime of the object, the region ending
+ * with a zero value as usual in Paraver traces.
+ */
+template <typename Value> class scope
+{
+public:
+        scope ()
+        {
+                event<Value>();
+        }
+
+        ~scope ()
+        {
+                event<typename Value::type>(0);
+        }
+
+        scope (const scope &) = delete;
+        scope &operator= (const scope &) = delete;
+};
+
+}  /* namespace ptt */
+
+#undef PTT_ENABLED
+
+#endif /* __ptt_typed */
@@ -0,0 +1,112 @@
+/*
+ * raw.c - Raw traces, kept without merging
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * Merging and writing text is what makes the post processing of large traces
+ * slow, and it is not needed for tools which only aggregate per thread (such
+ * as "ptt-query").  When PTT_RAW is set to non zero, the post processor skips
+ * the merge and keeps the thread traces next to the other trace files instead,
+ * together with what is needed to interpret their time stamps (see
+ * "formats.h").  The PCF and ROW files are still written.
+ *
+ * Raw traces are kept as recorded, so sampled addresses are not resolved and
+ * no derived events (communications, states, on CPU fractions) are produced.
+ */
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PTT_RAW_CHUNK  (256 * 1024)
+
+
+/*
+ * Copy a file, for when it cannot be moved because the trace is being written
+ * to a different file system.
+ */
+static void ptt_rawcopy (const char *from, const char *to)
+{
+        char *chunk;
+        ssize_t n, e;
+        int in, out;
+
+        in = ptt_open(from, O_RDONLY);
+        ptt_assert(in != -1);
+        out = ptt_open(to, O_CREAT | O_TRUNC | O_WRONLY, 00644);
+        ptt_assert(out != -1);
+        chunk = malloc(PTT_RAW_CHUNK);
+        ptt_assert(chunk != NULL);
+
+        while ((n = ptt_read(in, chunk, PTT_RAW_CHUNK)) > 0)
+        {
+                e = ptt_write(out, chunk, n);
+                ptt_assert(e == n);
+        }
+        ptt_assert(n == 0);
+
+        free(chunk);
+        close(in);
+        e = close(out);
+        ptt_assert(e != -1);
+        unlink(from);
+}
+
+
+/*
+ * Keep the thread traces and write the ".raw" file.
+ */
+void ptt_rawwrite (const char *trace, int segment, uint64_t startstamp,
+                   uint64_t duration, double nsratio)
+{
+        struct ptt_rawheader header;
+        char from[48], to[256];
+        FILE *output;
+        size_t e;
+        int fd, i;
+
+        for (i = 1;  i <= PttGlobal.postcount;  i++)
+        {
+                ptt_threadfile(from, i, segment);
+                snprintf(to, 255, "%s.%04d.tt", trace, i);
+                if (rename(from, to) == -1)
+                {
+                        /* Threads gone before a cut have no later parts */
+                        if (errno == ENOENT)
+                        {
+                                fd = ptt_open(to, O_CREAT | O_TRUNC | O_WRONLY,
+                                              00644);
+                                ptt_assert(fd != -1);
+                                close(fd);
+                                continue;
+                        }
+                        ptt_assert(errno == EXDEV);
+                        ptt_rawcopy(from, to);
+                }
+        }
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, PTT_RAW_MAGIC, 8);
+        header.duration = duration;
+        header.startstamp = startstamp;
+        header.nsratio = nsratio;
+        header.threads = PttGlobal.postcount;
+
+        snprintf(to, 255, "%s.raw", trace);
+        output = fopen(to, "w");
+        ptt_assert(output != NULL);
+        e = fwrite(&header, sizeof(header), 1, output);
+        ptt_assert(e == 1);
+        e = fclose(output);
+        ptt_assert(e == 0);
+}
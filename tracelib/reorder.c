@@ -0,0 +1,235 @@
+/*
+ * reorder.c - Time ordering of the records written by the post processor
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * Events reach the post processor in time order, but some records derived from
+ * them are only complete later, e.g. a communication once both of its ends
+ * have been merged.  Paraver, as well as the time index and the tools, expect
+ * every record sorted by the time it begins, which is the send time for
+ * communications.  So records are not written as they are produced, but kept
+ * in a binary heap ordered by time.  The post processor tells how far records
+ * can be written, i.e. the earliest time an incomplete record may still have,
+ * every PTT_REORDER_BATCH records.  Records with the same time are written in
+ * the order they were produced.
+ *
+ * The amount of records held is bounded by PTT_REORDER_WINDOW (or the
+ * environment variable of the same name).  Once exceeded, the post processor
+ * is told to give up on the incomplete records holding the rest back.
+ */
+
+#include <stdlib.h>
+
+#define PTT_REORDER_BATCH   1024
+#define PTT_REORDER_WINDOW  262144
+
+
+enum
+{
+        PTT_REORDER_EVENT = 0,
+        PTT_REORDER_STATE,
+        PTT_REORDER_COMM
+};
+
+
+struct ptt_reorderitem
+{
+        uint64_t ns;
+        uint64_t seq;  /* Production order, to break ties */
+        int kind;
+        union
+        {
+                struct
+                {
+                        int thread;
+                        int type;
+                        int value;
+                } event;
+                struct ptt_state state;
+                struct ptt_comm comm;
+        } u;
+};
+
+
+static struct
+{
+        const struct ptt_backend *be;
+        FILE *output;
+        int index;      /* Whether to tell the index about every record */
+        uint64_t offset;
+        uint64_t seq;
+        int count;
+        int size;       /* Allocated items */
+        int due;        /* Count at which to write again */
+        int window;
+        struct ptt_reorderitem *heap;
+} Reorder;
+
+
+static inline int ptt_reorderless (struct ptt_reorderitem *a,
+                                   struct ptt_reorderitem *b)
+{
+        return a->ns < b->ns || (a->ns == b->ns && a->seq < b->seq);
+}
+
+
+void ptt_reorderinit (const struct ptt_backend *be, FILE *output, int index,
+                      uint64_t offset)
+{
+        char *window;
+
+        Reorder.be = be;
+        Reorder.output = output;
+        Reorder.index = index;
+        Reorder.offset = offset;
+        Reorder.seq = 0;
+        Reorder.count = 0;
+        Reorder.due = PTT_REORDER_BATCH;
+        window = getenv("PTT_REORDER_WINDOW");
+        Reorder.window = window != NULL ? atoi(window) : PTT_REORDER_WINDOW;
+        if (Reorder.window < PTT_REORDER_BATCH)
+                Reorder.window = PTT_REORDER_BATCH;
+        Reorder.size = PTT_REORDER_BATCH;
+        Reorder.heap = malloc(Reorder.size * sizeof(struct ptt_reorderitem));
+        ptt_assert(Reorder.heap != NULL);
+}
+
+
+static struct ptt_reorderitem *ptt_reorderpush (uint64_t ns, int kind)
+{
+        struct ptt_reorderitem item, *heap;
+        int i;
+
+        if (Reorder.count == Reorder.size)
+        {
+                Reorder.size *= 2;
+                Reorder.heap = realloc(Reorder.heap, Reorder.size *
+                                       sizeof(struct ptt_reorderitem));
+                ptt_assert(Reorder.heap != NULL);
+        }
+
+        heap = Reorder.heap;
+        item.ns = ns;
+        item.seq = Reorder.seq++;
+        item.kind = kind;
+        for (i = Reorder.count++;  i > 0 && ptt_reorderless(&item,
+                                                           &heap[(i - 1) / 2]);
+             i = (i - 1) / 2)
+                heap[i] = heap[(i - 1) / 2];
+        heap[i] = item;
+        return &heap[i];
+}
+
+
+static void ptt_reorderpop (void)
+{
+        struct ptt_reorderitem *heap = Reorder.heap;
+        struct ptt_reorderitem last;
+        int i = 0, c;
+
+        last = heap[--Reorder.count];
+        for (;;)
+        {
+                c = 2 * i + 1;
+                if (c >= Reorder.count)
+                        break;
+                if (c + 1 < Reorder.count &&
+                    ptt_reorderless(&heap[c + 1], &heap[c]))
+                        c++;
+                if (!ptt_reorderless(&heap[c], &last))
+                        break;
+                heap[i] = heap[c];
+                i = c;
+        }
+        heap[i] = last;
+}
+
+
+void ptt_reorderevent (int thread, uint64_t ns, int type, int value)
+{
+        struct ptt_reorderitem *item;
+
+        item = ptt_reorderpush(ns, PTT_REORDER_EVENT);
+        item->u.event.thread = thread;
+        item->u.event.type = type;
+        item->u.event.value = value;
+}
+
+
+void ptt_reorderstate (struct ptt_state *state)
+{
+        ptt_reorderpush(state->begin, PTT_REORDER_STATE)->u.state = *state;
+}
+
+
+void ptt_reordercomm (struct ptt_comm *comm)
+{
+        ptt_reorderpush(comm->sendns, PTT_REORDER_COMM)->u.comm = *comm;
+}
+
+
+/*
+ * Whether the post processor should tell how far records can be written.
+ */
+int ptt_reorderdue (void)
+{
+        return Reorder.count >= Reorder.due;
+}
+
+
+/*
+ * Write the records before "hold".  Return non zero when the records held
+ * still exceed the window.
+ */
+int ptt_reorderwrite (uint64_t hold)
+{
+        struct ptt_reorderitem *item = Reorder.heap;
+        const struct ptt_backend *be = Reorder.be;
+
+        while (Reorder.count > 0 && item->ns < hold)
+        {
+                if (Reorder.index)
+                        ptt_indexrecord(item->ns, Reorder.offset);
+                switch (item->kind)
+                {
+                case PTT_REORDER_EVENT:
+                        Reorder.offset += be->event(Reorder.output,
+                                                    item->u.event.thread,
+                                                    item->ns,
+                                                    item->u.event.type,
+                                                    item->u.event.value);
+                        break;
+                case PTT_REORDER_STATE:
+                        Reorder.offset += be->state(Reorder.output,
+                                                    &item->u.state);
+                        break;
+                default:
+                        Reorder.offset += be->comm(Reorder.output,
+                                                   &item->u.comm);
+                        break;
+                }
+                ptt_reorderpop();
+        }
+        Reorder.due = Reorder.count + PTT_REORDER_BATCH;
+        return Reorder.count >= Reorder.window;
+}
+
+
+/*
+ * Write every record left and release the heap.  Return the final size of the
+ * trace contents.
+ */
+uint64_t ptt_reorderfini (void)
+{
+        ptt_reorderwrite(UINT64_MAX);
+        free(Reorder.heap);
+        Reorder.heap = NULL;
+        return Reorder.offset;
+}
@@ -0,0 +1,374 @@
+/*
+ * rotate.c - Split the trace of long running processes in parts
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+#include "timestamp.h"
+
+/*
+ * A daemon never reaches the post processing stage, or reaches it after days
+ * of tracing to /tmp.  When PTT_ROTATE (seconds) or PTT_ROTATE_MB (megabytes
+ * of events) are set, the trace is cut periodically: a time stamp is taken
+ * and a new segment starts, whose thread traces have the segment number in
+ * their names (see ptt_threadfile()).  Cuts are made by the first thread that
+ * flushes once one is due, or by a background thread if none does.
+ *
+ * Threads notice the new segment the next time they flush.  Events stamped
+ * before the cut still go to the previous segment, the rest to the new one,
+ * so every segment holds exactly the events between two cuts.  Once every
+ * thread has moved past a cut, or finished, the background thread runs the
+ * post processor over the segment, writing a complete trace named after the
+ * trace plus the part number (e.g. "ptt-trace-001.part3.prv").  The remaining
+ * segment becomes the last part at the end of the execution.  Old parts can
+ * be removed any time, which keeps the disk usage bounded.
+ *
+ * A thread which does not flush for PTT_ROTATE_GRACE cuts is not waited for.
+ * Its buffered events before the cut of a part already written go to the next
+ * part, where they appear at its beginning (those being folded are lost).
+ * Each part is a trace of its own, so states and communications do not carry
+ * from one part to the next.
+ */
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#define PTT_ROTATE_RING   64     /* Cuts remembered, i.e. pending parts */
+#define PTT_ROTATE_GRACE  2
+#define PTT_ROTATE_POLL   100    /* Milliseconds between checks */
+
+
+struct ptt_rotatecut
+{
+        uint64_t stamp;
+        struct timeval time;
+};
+
+static struct ptt_rotatecut Cuts[PTT_ROTATE_RING];  /* Segment starts */
+static pthread_t Rotator;
+static pthread_mutex_t RotateLock;
+static pthread_cond_t RotateWake;
+static int RotateStop;
+static uint64_t RotateTicks;    /* Segment length, or zero */
+static uint64_t RotateSize;     /* Bytes, or zero */
+static uint64_t RotateWritten;  /* Bytes since the last cut */
+static int Sealed;              /* Segments before this one are written */
+static int *Acks;               /* Segment of each thread, INT_MAX if gone */
+static int AckCount;
+
+
+#define ptt_rotatecut(s)  (&Cuts[(s) % PTT_ROTATE_RING])
+
+
+/*
+ * Record the segment a thread is writing.  Called with the lock held.
+ */
+static void ptt_rotateack (int thread, int segment)
+{
+        int i;
+
+        if (thread >= AckCount)
+        {
+                Acks = realloc(Acks, (thread + 16) * sizeof(int));
+                ptt_assert(Acks != NULL);
+                for (i = AckCount;  i < thread + 16;  i++)
+                        Acks[i] = INT_MAX;
+                AckCount = thread + 16;
+        }
+        Acks[thread] = segment;
+}
+
+
+/*
+ * Whether the oldest pending segment can be written.  Called with the lock
+ * held.
+ */
+static int ptt_rotatesealable (void)
+{
+        int i;
+
+        if (Sealed >= PttGlobal.segment)
+                return 0;
+        if (RotateStop || PttGlobal.segment - Sealed > PTT_ROTATE_GRACE)
+                return 1;
+        for (i = 0;  i < AckCount;  i++)
+                if (Acks[i] <= Sealed)
+                        return 0;
+        return 1;
+}
+
+
+static inline int ptt_rotatedue (uint64_t now)
+{
+        return (RotateTicks > 0 &&
+                now - ptt_rotatecut(PttGlobal.segment)->stamp >= RotateTicks) ||
+               (RotateSize > 0 && RotateWritten >= RotateSize);
+}
+
+
+/*
+ * Start a new segment if it is due, and if there is room to remember it.
+ * Called with the lock held.
+ */
+static void ptt_rotatenext (void)
+{
+        struct ptt_rotatecut *cut;
+        int segment = PttGlobal.segment;
+
+        if (RotateStop || segment - Sealed >= PTT_ROTATE_RING - 1 ||
+            !ptt_rotatedue(ptt_getticks()))
+                return;
+
+        cut = ptt_rotatecut(segment + 1);
+        cut->stamp = ptt_getticks();
+        gettimeofday(&cut->time, NULL);
+        RotateWritten = 0;
+        __sync_synchronize();
+        PttGlobal.segment = segment + 1;
+        ptt_debug("Segment %d started", segment + 1);
+}
+
+
+/*
+ * Background thread, not traced.  Cut the trace when it is due and post
+ * process the segments as they are complete.
+ */
+static void *ptt_rotator (void *unused)
+{
+        struct ptt_rotatecut begin, end;
+        struct timeval now;
+        struct timespec wake;
+        int segment, e;
+
+        e = pthread_mutex_lock(&RotateLock);
+        ptt_assert(e == 0);
+        for (;;)
+        {
+                ptt_rotatenext();
+                if (ptt_rotatesealable())
+                {
+                        segment = Sealed++;
+                        begin = *ptt_rotatecut(segment);
+                        end = *ptt_rotatecut(segment + 1);
+                        e = pthread_mutex_unlock(&RotateLock);
+                        ptt_assert(e == 0);
+                        ptt_postsegment(segment, begin.stamp, end.stamp,
+                                        &begin.time, &end.time);
+                        e = pthread_mutex_lock(&RotateLock);
+                        ptt_assert(e == 0);
+                        continue;
+                }
+                if (RotateStop)
+                        break;
+
+                gettimeofday(&now, NULL);
+                wake.tv_sec = now.tv_sec;
+                wake.tv_nsec = now.tv_usec * 1000 + PTT_ROTATE_POLL * 1000000L;
+                wake.tv_sec += wake.tv_nsec / 1000000000L;
+                wake.tv_nsec %= 1000000000L;
+                pthread_cond_timedwait(&RotateWake, &RotateLock, &wake);
+        }
+        e = pthread_mutex_unlock(&RotateLock);
+        ptt_assert(e == 0);
+        return NULL;
+}
+
+
+static void ptt_rotatebegin (void)
+{
+        int e;
+
+        pthread_mutex_init(&RotateLock, NULL);
+        pthread_cond_init(&RotateWake, NULL);
+        Cuts[0].stamp = PttGlobal.startstamp;
+        Cuts[0].time = PttGlobal.starttime;
+        PttGlobal.segment = 0;
+        RotateStop = 0;
+        RotateWritten = 0;
+        Sealed = 0;
+        free(Acks);
+        Acks = NULL;
+        AckCount = 0;
+
+        /* Not the wrapped pthread_create(), this thread must not be traced */
+        e = __real_pthread_create(&Rotator, NULL, ptt_rotator, NULL);
+        ptt_assert(e == 0);
+}
+
+
+/*
+ * Read the configuration and start the background thread, if requested.  The
+ * start of the trace must be known by now.
+ */
+void ptt_rotateinit (void)
+{
+        char *period, *size;
+
+        period = getenv("PTT_ROTATE");
+        RotateTicks = period != NULL ? ptt_nstoticks(atof(period) * 1e9) : 0;
+        size = getenv("PTT_ROTATE_MB");
+        RotateSize = size != NULL ? (uint64_t) (atof(size) * 1048576.0) : 0;
+        PttGlobal.rotate = RotateTicks > 0 || RotateSize > 0;
+        if (PttGlobal.rotate)
+                ptt_rotatebegin();
+}
+
+
+/*
+ * Start over in a forked child, whose first segment is its whole trace so far.
+ * Threads are not inherited, the background one neither.
+ */
+void ptt_rotatefork (void)
+{
+        if (PttGlobal.rotate)
+                ptt_rotatebegin();
+}
+
+
+/*
+ * Register a new thread in the current segment, before its trace is opened.
+ */
+void ptt_rotatestart (struct ptt_threadbuf *tb)
+{
+        int e;
+
+        e = pthread_mutex_lock(&RotateLock);
+        ptt_assert(e == 0);
+        /* Begin critical section */
+        tb->segment = PttGlobal.segment;
+        ptt_rotateack(tb->thread, tb->segment);
+        /* End critical section */
+        e = pthread_mutex_unlock(&RotateLock);
+        ptt_assert(e == 0);
+}
+
+
+/*
+ * The thread trace is closed, do not wait for it anymore.
+ */
+void ptt_rotateend (struct ptt_threadbuf *tb)
+{
+        int e;
+
+        e = pthread_mutex_lock(&RotateLock);
+        ptt_assert(e == 0);
+        /* Begin critical section */
+        ptt_rotateack(tb->thread, INT_MAX);
+        /* End critical section */
+        e = pthread_mutex_unlock(&RotateLock);
+        ptt_assert(e == 0);
+        pthread_cond_signal(&RotateWake);
+}
+
+
+/*
+ * Write some events to the current trace file of a thread.
+ */
+static void ptt_rotatewrite (struct ptt_threadbuf *tb, struct ptt_event *events,
+                             int count)
+{
+        int e;
+
+        if (tb->fold != NULL)
+        {
+                ptt_fold(tb->fold, tb->tracefile, events, count);
+                return;
+        }
+        e = ptt_write(tb->tracefile, events, count * sizeof(struct ptt_event));
+        ptt_assert(e == count * sizeof(struct ptt_event));
+}
+
+
+/*
+ * Called when the buffer of a thread is about to be stored, cutting the trace
+ * if it is due.  If there have been cuts since its last flush, write the
+ * events before each cut to the segment they belong to, and move the thread to
+ * the current one.  Return the amount of events at the beginning of the buffer
+ * already written.  Never reached from the sampling signal handler, which does
+ * not flush (see "sampling.c"), so taking the lock is safe.
+ */
+int ptt_rotatestore (struct ptt_threadbuf *tb)
+{
+        char filename[48];
+        uint64_t cut;
+        int n = 0, m, e;
+
+        __sync_fetch_and_add(&RotateWritten,
+                             tb->eventcount * sizeof(struct ptt_event));
+        if (tb->segment == PttGlobal.segment && !ptt_rotatedue(ptt_getticks()))
+                return 0;
+
+        e = pthread_mutex_lock(&RotateLock);
+        ptt_assert(e == 0);
+        /* Begin critical section */
+        ptt_rotatenext();
+        while (tb->segment < PttGlobal.segment)
+        {
+                cut = ptt_rotatecut(tb->segment + 1)->stamp;
+                for (m = n;  m < tb->eventcount && tb->events[m].timestamp < cut;
+                     m++)
+                        ;
+                if (tb->segment >= Sealed)
+                {
+                        ptt_rotatewrite(tb, tb->events + n, m - n);
+                        n = m;
+                        if (tb->fold != NULL)
+                                ptt_foldflush(tb->fold, tb->tracefile);
+                }
+                else if (tb->fold != NULL)
+                {
+                        ptt_foldreset(tb->fold);  /* Part already written */
+                }
+                e = close(tb->tracefile);
+                ptt_assert(e != -1);
+
+                /* Segments already written get nothing else */
+                tb->segment = tb->segment < Sealed ? Sealed : tb->segment + 1;
+                ptt_rotateack(tb->thread, tb->segment);
+                ptt_threadfile(filename, tb->thread + 1, tb->segment);
+                tb->tracefile = ptt_open(filename, O_CREAT | O_WRONLY, 00600);
+                ptt_assert(tb->tracefile != -1);
+        }
+        /* End critical section */
+        e = pthread_mutex_unlock(&RotateLock);
+        ptt_assert(e == 0);
+        pthread_cond_signal(&RotateWake);
+        return n;
+}
+
+
+/*
+ * Stop the background thread, once the pending parts have been written.
+ */
+void ptt_rotatestop (void)
+{
+        int e;
+
+        e = pthread_mutex_lock(&RotateLock);
+        ptt_assert(e == 0);
+        RotateStop = 1;
+        e = pthread_mutex_unlock(&RotateLock);
+        ptt_assert(e == 0);
+        pthread_cond_signal(&RotateWake);
+
+        e = __real_pthread_join(Rotator, NULL);
+        ptt_assert(e == 0);
+}
+
+
+/*
+ * Return the last segment and its start, for the final post processing.
+ */
+int ptt_rotatelast (uint64_t *stamp, struct timeval *time)
+{
+        *stamp = ptt_rotatecut(PttGlobal.segment)->stamp;
+        *time = ptt_rotatecut(PttGlobal.segment)->time;
+        return PttGlobal.segment;
+}
@@ -5,13 +5,42 @@
 MAKEFLAGS += -r
 
 GCC           := gcc -pipe
+GXX           := g++ -pipe
 CFLAGS        ?= -O3 -fomit-frame-pointer
 CFLAGS_DBG    ?= -O0 -g
+CXXFLAGS      ?= $(CFLAGS)
+CXXFLAGS_DBG  ?= $(CFLAGS_DBG)
 LINKFLAGS     ?= -Wl,-O1,-s
 LINKFLAGS_DBG ?= -g
+LINKFLAGS_FUN ?= -Wl,-O1
 
 DEFS   := -D_REENTRANT -D_XOPEN_SOURCE=700
-LDWRAP := -Wl,--wrap,pthread_create
+LDWRAP := -Wl,--wrap,pthread_create,--wrap,pthread_join \
+          -Wl,--wrap,pthread_barrier_wait
+
+# Compressed trace output support, set to empty to drop the zlib dependency
+ZLIB ?= yes
+ifneq ($(ZLIB),)
+DEFS     += -DPTT_ZLIB
+PTT_LIBS += z
+endif
+
+# Interception of I/O system calls, set to non empty to trace them.  The
+# library must be rebuilt ("make clean") after changing it.
+IOWRAP ?=
+ifneq ($(IOWRAP),)
+DEFS   += -DPTT_IOWRAP
+LDWRAP += -Wl,--wrap,read,--wrap,write,--wrap,pread,--wrap,pwrite \
+          -Wl,--wrap,open,--wrap,fsync
+endif
+
+# Interception of memory allocation calls, set to non empty to account them.
+# The library must be rebuilt ("make clean") after changing it.
+MALLOCWRAP ?=
+ifneq ($(MALLOCWRAP),)
+DEFS   += -DPTT_MALLOCWRAP
+LDWRAP += -Wl,--wrap,malloc,--wrap,calloc,--wrap,realloc,--wrap,free
+endif
 
 
 # Default and shortcut rules
@@ -20,20 +49,28 @@ traced  : $(PROGRAMS)
 untraced: $(PROGRAMS:=.untraced)
 debug   : $(PROGRAMS:=.debug)
 
+# Function entry and exit events, symbols are kept to name the functions
+functraced: $(PROGRAMS:=.functraced)
+
 
 ###########################  TRACING LIBRARY RULES  ###########################
 
 # File listings
-ptt_headers := ptt.h intestine.h timestamp.h
-ptt_sources := core.c event.c wrappers.c postprocess.c
+ptt_headers := ptt.h intestine.h timestamp.h formats.h chrome.h
+ptt_sources := core.c event.c wrappers.c postprocess.c output.c backend.c \
+               profile.c index.c lod.c columns.c raw.c fold.c rotate.c \
+               merge.c comm.c states.c cputime.c sampling.c symbols.c \
+               functions.c malloc.c chrome.c pool.c overhead.c \
+               reorder.c
 ptt_userapi := ptt.h
+ptt_cxxapi  := ptt.hpp
 ptt_stub    := stub.h
 ptt_object  := ptt.o
 ptt_debug   := ptt.go
 ptt_pcf     := basic.pcf
 
 # Prepend proper path to all files
-vars := headers sources userapi stub object debug pcf strizer
+vars := headers sources userapi cxxapi stub object debug pcf strizer
 $(foreach v,$(vars),$(eval ptt_$(v) := $(addprefix $(PTT_PATH)/,$(ptt_$(v)))))
 
 # Build rules
@@ -52,26 +89,41 @@ $(ptt_sources:.c=.go): %.go: %.c $(ptt_headers)
 
 ############################  USER PROGRAMS RULES  ############################
 
-# Build rule generator
+# Build rule generator.  C++ sources (".cc") get the typed API of "ptt.hpp"
+# and the event types as classes, and the program is then linked as C++.  The
+# C++ library is linked statically, so that the threads it creates (e.g.
+# std::thread) also go through the wrappers.
 define gen_build_rules
 $(1)_OBJ := $(patsubst %.c,%.o,$(filter %.c,$($(1)_SOURCES)) pcf_$(1).c)
 $(1)_UNT := $(patsubst %.c,%.uo,$(filter %.c,$($(1)_SOURCES)))
 $(1)_DBG := $(patsubst %.c,%.go,$(filter %.c,$($(1)_SOURCES)) pcf_$(1).c)
+$(1)_FUN := $(patsubst %.c,%.fo,$(filter %.c,$($(1)_SOURCES)) pcf_$(1).c)
+$(1)_XOBJ := $(patsubst %.cc,%.o,$(filter %.cc,$($(1)_SOURCES)))
+$(1)_XUNT := $(patsubst %.cc,%.uo,$(filter %.cc,$($(1)_SOURCES)))
+$(1)_XDBG := $(patsubst %.cc,%.go,$(filter %.cc,$($(1)_SOURCES)))
+$(1)_XFUN := $(patsubst %.cc,%.fo,$(filter %.cc,$($(1)_SOURCES)))
+$(1)_LD  := $(if $(filter %.cc,$($(1)_SOURCES)),$(GXX) -static-libstdc++,$(GCC))
 $(1)_PCF := $(PCF_FILES) $($(1)_PCF)
 $(1)_PCH := $$(if $$($(1)_PCF),pcf_$(1).h)
 $(1)_PCI := $$(if $$($(1)_PCF),-include pcf_$(1).h)
+$(1)_PXH := $$(if $$($(1)_PCF),pcf_$(1).hpp)
+$(1)_PXI := $$(if $$($(1)_PCF),-include pcf_$(1).hpp)
+
+objects += $$($(1)_OBJ) $$($(1)_UNT) $$($(1)_DBG) $$($(1)_FUN)
+objects += $$($(1)_XOBJ) $$($(1)_XUNT) $$($(1)_XDBG) $$($(1)_XFUN)
+autopcf += pcf_$(1).c pcf_$(1).h pcf_$(1).hpp
 
-objects += $$($(1)_OBJ) $$($(1)_UNT) $$($(1)_DBG)
-autopcf += pcf_$(1).c pcf_$(1).h
+$(1): $$($(1)_OBJ) $$($(1)_XOBJ) $(ptt_object)
+	$$($(1)_LD) $(LDWRAP) $(LINKFLAGS) -o $$@ $$^ -pthread $(addprefix -l,$($(1)_LIBS) $(PTT_LIBS))
 
-$(1): $$($(1)_OBJ) $(ptt_object)
-	$(GCC) $(LDWRAP) $(LINKFLAGS) -o $$@ $$^ -pthread $(addprefix -l,$($(1)_LIBS))
+$(1).untraced: $$($(1)_UNT) $$($(1)_XUNT)
+	$$($(1)_LD) $(LINKFLAGS) -o $$@ $$^ -pthread $(addprefix -l,$($(1)_LIBS))
 
-$(1).untraced: $$($(1)_UNT)
-	$(GCC) $(LINKFLAGS) -o $$@ $$^ -pthread $(addprefix -l,$($(1)_LIBS))
+$(1).debug: $$($(1)_DBG) $$($(1)_XDBG) $(ptt_debug)
+	$$($(1)_LD) $(LDWRAP) $(LINKFLAGS_DBG) -o $$@ $$^ -pthread $(addprefix -l,$($(1)_LIBS) $(PTT_LIBS))
 
-$(1).debug: $$($(1)_DBG) $(ptt_debug)
-	$(GCC) $(LDWRAP) $(LINKFLAGS_DBG) -o $$@ $$^ -pthread $(addprefix -l,$($(1)_LIBS))
+$(1).functraced: $$($(1)_FUN) $$($(1)_XFUN) $(ptt_object)
+	$$($(1)_LD) $(LDWRAP) $(LINKFLAGS_FUN) -o $$@ $$^ -pthread $(addprefix -l,$($(1)_LIBS) $(PTT_LIBS))
 
 $$($(1)_OBJ): %.o: %.c $(filter %.h,$($(1)_SOURCES)) $$($(1)_PCH)
 	$(GCC) $(DEFS) -include $(ptt_userapi) $$($(1)_PCI) $(CFLAGS) -c -o $$@ $$<
@@ -82,11 +134,29 @@ $$($(1)_UNT): %.uo: %.c $(filter %.h,$($(1)_SOURCES)) $$($(1)_PCH)
 $$($(1)_DBG): %.go: %.c $(filter %.h,$($(1)_SOURCES)) $$($(1)_PCH)
 	$(GCC) $(DEFS) -include $(ptt_userapi) $$($(1)_PCI) $(CFLAGS_DBG) -c -o $$@ $$<
 
+$$($(1)_FUN): %.fo: %.c $(filter %.h,$($(1)_SOURCES)) $$($(1)_PCH)
+	$(GCC) $(DEFS) -include $(ptt_userapi) $$($(1)_PCI) $(CFLAGS) -finstrument-functions -c -o $$@ $$<
+
+$$($(1)_XOBJ): %.o: %.cc $(filter %.h %.hpp,$($(1)_SOURCES)) $$($(1)_PXH) $(ptt_cxxapi)
+	$(GXX) $(DEFS) -include $(ptt_cxxapi) $$($(1)_PXI) $(CXXFLAGS) -c -o $$@ $$<
+
+$$($(1)_XUNT): %.uo: %.cc $(filter %.h %.hpp,$($(1)_SOURCES)) $$($(1)_PXH) $(ptt_cxxapi)
+	$(GXX) $(DEFS) -include $(ptt_stub) -include $(ptt_cxxapi) $$($(1)_PXI) $(CXXFLAGS) -c -o $$@ $$<
+
+$$($(1)_XDBG): %.go: %.cc $(filter %.h %.hpp,$($(1)_SOURCES)) $$($(1)_PXH) $(ptt_cxxapi)
+	$(GXX) $(DEFS) -include $(ptt_cxxapi) $$($(1)_PXI) $(CXXFLAGS_DBG) -c -o $$@ $$<
+
+$$($(1)_XFUN): %.fo: %.cc $(filter %.h %.hpp,$($(1)_SOURCES)) $$($(1)_PXH) $(ptt_cxxapi)
+	$(GXX) $(DEFS) -include $(ptt_cxxapi) $$($(1)_PXI) $(CXXFLAGS) -finstrument-functions -c -o $$@ $$<
+
 pcf_$(1).h: $$($(1)_PCF)
 	awk -f $(PTT_PATH)/enumize.awk $$^ >$$@
 
-pcf_$(1).c: $(ptt_pcf) $$($(1)_PCF)
-	awk -f $(PTT_PATH)/stringize.awk $$^ >$$@
+pcf_$(1).hpp: $$($(1)_PCF) $(PTT_PATH)/tagize.awk
+	awk -f $(PTT_PATH)/tagize.awk $$(filter-out %.awk,$$^) >$$@
+
+pcf_$(1).c: $(ptt_pcf) $$($(1)_PCF) $(PTT_PATH)/stringize.awk
+	awk -f $(PTT_PATH)/stringize.awk $$(filter-out %.awk,$$^) >$$@
 endef
 
 # Perform rule generation
@@ -99,7 +169,8 @@ $(foreach p,$(PROGRAMS),$(eval $(call gen_build_rules,$(p))))
 .PHONY: clean distclean
 
 clean:
-	-rm -f $(objects) $(PROGRAMS) $(PROGRAMS:=.untraced) $(PROGRAMS:=.debug)
+	-rm -f $(objects) $(PROGRAMS) $(PROGRAMS:=.untraced) $(PROGRAMS:=.debug) \
+	       $(PROGRAMS:=.functraced)
 
 distclean: clean
 	-rm -f $(autopcf) $(ptt_sources:.c=.o) $(ptt_sources:.c=.go) $(ptt_object) $(ptt_debug)
@@ -0,0 +1,197 @@
+/*
+ * sampling.c - Statistical sampling of the program counter
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define _GNU_SOURCE  /* SIGEV_THREAD_ID, REG_RIP, pthread_getattr_np() */
+#define __ptt_digestive
+#include "intestine.h"
+#include "timestamp.h"
+
+/*
+ * Manual events only cover the code somebody thought about.  When PTT_SAMPLE
+ * is set to a period in microseconds, every thread gets a timer on its own CPU
+ * clock, which sends it a SIGPROF signal each time the period is consumed.
+ * The signal handler stores the interrupted program counter, and the return
+ * addresses of up to PTT_SAMPLE_FRAMES callers (three by default), as events
+ * in the thread buffer.
+ *
+ * Addresses do not fit in event values, so each one takes two events: the
+ * upper half (PTT_HIGH_EVENT) and the lower half (PTT_SAMPLE_EVENT plus the
+ * frame depth).  The post processor joins them back and replaces them by
+ * function identifiers (see "symbols.c").
+ *
+ * Samples arriving while the thread is adding events are dropped, otherwise
+ * the buffer could be corrupted.  The handler never flushes the buffer either,
+ * as writing it out is not async signal safe (neither is the rotation of the
+ * trace, see "rotate.c"), so callers not fitting in the buffer are left out,
+ * and so is the whole sample if not even the program counter fits.  Callers
+ * are found by following the frame pointers, so they are only meaningful for
+ * code compiled with them.  The walk never leaves the thread stack, though, so
+ * it is always safe.
+ */
+
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#ifndef sigev_notify_thread_id
+#  define sigev_notify_thread_id  _sigev_un._tid
+#endif
+
+#if defined(__x86_64__)
+#  define PTT_PC  REG_RIP
+#  define PTT_FP  REG_RBP
+#elif defined(__i386__)
+#  define PTT_PC  REG_EIP
+#  define PTT_FP  REG_EBP
+#endif
+
+
+#ifdef PTT_PC
+/* Buffer of the calling thread while sampled, pthread_getspecific() is not
+ * async signal safe */
+static __thread struct ptt_threadbuf *Sampled;
+
+
+/*
+ * Signal handler.  Only async signal safe stuff in here.
+ */
+static void ptt_samplehandler (int signum, siginfo_t *info, void *context)
+{
+        ucontext_t *uc = context;
+        struct ptt_threadbuf *tb;
+        uintptr_t frames[PTT_SAMPLE_DEPTH + 1];
+        uintptr_t *fp, *next;
+        uint64_t ts;
+        int n, d, i;
+
+        tb = Sampled;
+        if (tb == NULL || tb->busy)
+                return;
+
+        frames[0] = uc->uc_mcontext.gregs[PTT_PC];
+        fp = (uintptr_t *) uc->uc_mcontext.gregs[PTT_FP];
+        for (n = 1;  n <= PttGlobal.sampledepth;  n++)
+        {
+                if ((char *) fp < tb->stacklow ||
+                    (char *) (fp + 2) > tb->stackhigh ||
+                    ((uintptr_t) fp & (sizeof(uintptr_t) - 1)) != 0)
+                        break;
+                frames[n] = fp[1];
+                next = (uintptr_t *) fp[0];
+                if (next <= fp)
+                        break;
+                fp = next;
+        }
+
+        /* The buffer must not be full afterwards, see ptt_reserve() */
+        if (tb->eventcount + 2 * n >= PTT_BUFFER_SIZE)
+                n = (PTT_BUFFER_SIZE - 1 - tb->eventcount) / 2;
+        if (n <= 0)
+                return;
+        i = tb->eventcount;
+        tb->eventcount += 2 * n;
+        ts = ptt_getticks();
+        for (d = 0;  d < n;  d++)
+        {
+                tb->events[i].timestamp = ts;
+                tb->events[i].type = PTT_HIGH_EVENT;
+                tb->events[i].value = (uint64_t) frames[d] >> 32;
+                i++;
+                tb->events[i].timestamp = ts;
+                tb->events[i].type = PTT_SAMPLE_EVENT + d;
+                tb->events[i].value = frames[d] & 0xffffffff;
+                i++;
+        }
+}
+#endif
+
+
+/*
+ * Read the sampling settings and install the signal handler.
+ */
+void ptt_sampleinit (void)
+{
+        struct sigaction sa;
+        char *env;
+        int e;
+
+        PttGlobal.sampleperiod = 0;
+        env = getenv("PTT_SAMPLE");
+        if (env == NULL || atol(env) <= 0)
+                return;
+#ifdef PTT_PC
+        PttGlobal.sampleperiod = atol(env) * 1000;
+        env = getenv("PTT_SAMPLE_FRAMES");
+        PttGlobal.sampledepth = env != NULL ? atoi(env) : 3;
+        if (PttGlobal.sampledepth < 0)
+                PttGlobal.sampledepth = 0;
+        if (PttGlobal.sampledepth > PTT_SAMPLE_DEPTH)
+                PttGlobal.sampledepth = PTT_SAMPLE_DEPTH;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = ptt_samplehandler;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        e = sigaction(SIGPROF, &sa, NULL);
+        ptt_assert(e == 0);
+#else
+        ptt_debug("Sampling requested but not available");
+#endif
+}
+
+
+/*
+ * Start sampling the calling thread.
+ */
+void ptt_samplestart (struct ptt_threadbuf *tb)
+{
+        struct sigevent sev;
+        struct itimerspec its;
+        pthread_attr_t attr;
+        size_t size;
+        void *stack;
+        int e;
+
+        e = pthread_getattr_np(pthread_self(), &attr);
+        ptt_assert(e == 0);
+        e = pthread_attr_getstack(&attr, &stack, &size);
+        ptt_assert(e == 0);
+        pthread_attr_destroy(&attr);
+        tb->stacklow = stack;
+        tb->stackhigh = (char *) stack + size;
+
+        memset(&sev, 0, sizeof(sev));
+        sev.sigev_notify = SIGEV_THREAD_ID;
+        sev.sigev_signo = SIGPROF;
+        sev.sigev_notify_thread_id = syscall(SYS_gettid);
+        e = timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &tb->timer);
+        ptt_assert(e == 0);
+
+        its.it_interval.tv_sec = PttGlobal.sampleperiod / 1000000000L;
+        its.it_interval.tv_nsec = PttGlobal.sampleperiod % 1000000000L;
+        its.it_value = its.it_interval;
+        e = timer_settime(tb->timer, 0, &its, NULL);
+        ptt_assert(e == 0);
+#ifdef PTT_PC
+        Sampled = tb;
+#endif
+}
+
+
+void ptt_samplestop (struct ptt_threadbuf *tb)
+{
+        int e;
+
+        e = timer_delete(tb->timer);
+        ptt_assert(e == 0);
+#ifdef PTT_PC
+        Sampled = NULL;
+#endif
+}
@@ -0,0 +1,132 @@
+/*
+ * states.c - Paraver state records derived from an event type
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * One event type, chosen with a STATES_FROM_EVENT_TYPE annotation in the PCF
+ * files, is also written as Paraver states.  Each event of that type closes
+ * the current state of the thread and opens a new one with the event value,
+ * which lasts until the next event of the same type, until the thread finishes
+ * or until the end of the trace.  By default, the type is the tracing phase,
+ * so threads show as running or flushing.
+ *
+ * A state record is only known once the state is over, but it is written at
+ * the time it begins, so open states hold back the records after them (see
+ * "reorder.c").  States lasting longer than the reordering window are written
+ * in pieces, each one beginning where the previous one ends.
+ */
+
+#include <stdlib.h>
+
+
+struct ptt_statethread
+{
+        int open;       /* Whether there is a current state */
+        int value;
+        uint64_t since;
+};
+
+
+static struct ptt_statethread *States;
+static int Threads;
+
+
+void ptt_stateinit (int threads)
+{
+        States = calloc(threads, sizeof(struct ptt_statethread));
+        ptt_assert(States != NULL);
+        Threads = threads;
+}
+
+
+/*
+ * Earliest beginning of the open states.
+ */
+uint64_t ptt_statehold (void)
+{
+        uint64_t hold = UINT64_MAX;
+        int i;
+
+        for (i = 0;  i < Threads;  i++)
+                if (States[i].open && States[i].since < hold)
+                        hold = States[i].since;
+        return hold;
+}
+
+
+/*
+ * Close the current state of a thread, if any.  Return non zero when there is
+ * a state record to write, in which case it is stored in "state".
+ */
+int ptt_stateclose (int thread, uint64_t ns, struct ptt_state *state)
+{
+        struct ptt_statethread *th = &States[thread];
+
+        if (!th->open)
+                return 0;
+        th->open = 0;
+        if (ns == th->since)
+                return 0;  /* Nothing to see */
+
+        state->thread = thread;
+        state->value = th->value;
+        state->begin = th->since;
+        state->end = ns;
+        return 1;
+}
+
+
+/*
+ * Write the current state of a thread up to "ns", if it began earlier, and
+ * carry on with it from there.  Same return value as ptt_stateclose().
+ */
+int ptt_statesplit (int thread, uint64_t ns, struct ptt_state *state)
+{
+        struct ptt_statethread *th = &States[thread];
+
+        if (!th->open || th->since >= ns)
+                return 0;
+
+        state->thread = thread;
+        state->value = th->value;
+        state->begin = th->since;
+        state->end = ns;
+        th->since = ns;
+        return 1;
+}
+
+
+/*
+ * Feed an event of the state type, or the end of a thread.  Same return value
+ * as ptt_stateclose().
+ */
+int ptt_stateevent (int thread, uint64_t ns, int type, int value,
+                    struct ptt_state *state)
+{
+        struct ptt_statethread *th = &States[thread];
+        int e;
+
+        e = ptt_stateclose(thread, ns, state);
+
+        /* The thread is gone, so is its state */
+        if (type == PTT_PHASE_EVENT && value == 0)
+                return e;
+
+        th->open = 1;
+        th->value = value;
+        th->since = ns;
+        return e;
+}
+
+
+void ptt_statefini (void)
+{
+        free(States);
+}
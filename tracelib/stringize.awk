@@ -1,15 +1,56 @@
 BEGIN {
+    count = 0
+    parsing = 0
+    blocks = 0
+    annotation = 0
+    statetype = 0
     print "/* Automatically generated.  Do not edit. */"
     print "const char *PttPCF ="
 }
 
 
+# The event type whose values become Paraver states.  The annotation itself is
+# not part of the PCF, so it is not printed.
+/^STATES_FROM_EVENT_TYPE\s*$/ {
+    annotation = 1
+    next
+}
+
+
+annotation == 1 {
+    statetype = $1
+    annotation = 0
+    next
+}
+
+
 {
-    print "\"" $0 "\\n\""
+    if ($0 ~ /^\s*$/) {
+        parsing = 0
+    } else if ($0 ~ /^EVENT_TYPE\s*$/) {
+        parsing = 1
+        blocks++
+    } else if ($0 ~ /^VALUES\s*$/) {
+        parsing = 2
+    } else if (parsing == 1) {
+        block[$2] = blocks
+    } else if (parsing == 2) {
+        values[blocks] = values[blocks] "\"" $0 "\\n\"\n"
+    }
+    lines[count++] = "\"" $0 "\\n\""
 }
 
 
 END {
+    for (i = 0;  i < count;  i++)
+        print lines[i]
+    if (statetype in block) {
+        print "\"STATES\\n\""
+        printf "%s", values[block[statetype]]
+        print "\"\\n\\n\""
+    } else {
+        statetype = 0
+    }
     print ";"
+    print "const int PttStateType = " statetype ";"
 }
-
@@ -1,2 +1,13 @@
 #define ptt_event(type, value)
 #define ptt_events(...)
+#define ptt_send(tag, size)
+#define ptt_recv(tag, size)
+#define PTT_POOL_TAG  0x70000000
+
+/* Serial loop, without the pool (see "pool.c") */
+static inline void ptt_parallel_for (long begin, long end, long grain,
+                                     void (*fn) (long, long, void *), void *arg)
+{
+        if (begin < end)
+                fn(begin, end, arg);
+}
@@ -0,0 +1,400 @@
+/*
+ * symbols.c - Translation of sampled addresses into function names
+ *
+ * Copyright 2009 Isaac Jurado Peinado <isaac.jurado@est.fib.upc.edu>
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * Lesser General Public License version 2.1, incorporated herein by reference.
+ */
+#define __ptt_digestive
+#include "intestine.h"
+
+/*
+ * The post processor runs within the traced process, so sampled addresses can
+ * be looked up in the current memory map.  Executable mappings are taken from
+ * /proc/self/maps and, the first time an address falls in one of them, the
+ * function symbols of the corresponding ELF file are loaded.  The full symbol
+ * table is preferred, but stripped files still have the dynamic one.
+ *
+ * Each function found gets a small identifier, in order of appearance, which
+ * is what the trace shows.  Addresses outside any known function are
+ * attributed to the file they belong to, and the rest are unknown (zero).  The
+ * names are appended to the PCF file as the values of the sample event types.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <link.h>  /* ElfW() */
+
+
+struct ptt_function
+{
+        uint64_t start;
+        uint64_t end;
+        const char *name;
+        int id;
+};
+
+struct ptt_object
+{
+        uint64_t start;  /* Mapped range */
+        uint64_t end;
+        uint64_t offset;
+        char *path;
+        int loaded;
+        int id;          /* For addresses outside the known functions */
+        void *image;     /* Mapped ELF file */
+        size_t size;
+        int count;
+        struct ptt_function *functions;
+};
+
+
+static struct ptt_object *Objects;
+static int ObjectCount;
+static char **Names;
+static int NameCount;
+static uint64_t *High;  /* Upper address half, per thread */
+
+/* Set by the linker at the beginning of the executable */
+extern char __executable_start;
+
+
+static int ptt_symbolname (const char *name)
+{
+        if (NameCount % 256 == 0)
+        {
+                Names = realloc(Names, (NameCount + 256) * sizeof(char *));
+                ptt_assert(Names != NULL);
+        }
+        Names[NameCount] = strdup(name);
+        ptt_assert(Names[NameCount] != NULL);
+        return NameCount++;
+}
+
+
+static int ptt_functioncompare (const void *a, const void *b)
+{
+        const struct ptt_function *fa = a, *fb = b;
+
+        return fa->start < fb->start ? -1 : fa->start > fb->start;
+}
+
+
+/*
+ * Whether a range of bytes lies within the mapped file.
+ */
+static inline int ptt_symbolinside (struct ptt_object *obj, uint64_t offset,
+                                    uint64_t length)
+{
+        return offset <= obj->size && length <= obj->size - offset;
+}
+
+
+/*
+ * Load the function symbols of an object.  Symbol values are relative to the
+ * load address, which is found through the program header covering the
+ * mapped file offset.  Nothing in the file is trusted, every table and string
+ * must lie within it.
+ */
+static void ptt_symbolload (struct ptt_object *obj)
+{
+        ElfW(Ehdr) *eh;
+        ElfW(Phdr) *ph;
+        ElfW(Shdr) *sh, *symtab = NULL, *strtab;
+        ElfW(Sym) *sym;
+        struct stat st;
+        uint64_t bias = 0, base, page;
+        const char *strings;
+        int fd, i, n;
+
+        obj->loaded = 1;
+        fd = ptt_open(obj->path, O_RDONLY);
+        if (fd == -1)
+                return;
+        if (fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof(ElfW(Ehdr)))
+        {
+                close(fd);
+                return;
+        }
+        obj->image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (obj->image == MAP_FAILED)
+        {
+                obj->image = NULL;
+                return;
+        }
+        obj->size = st.st_size;
+
+        eh = obj->image;
+        if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+            eh->e_ident[EI_CLASS] != (sizeof(void *) == 8 ? ELFCLASS64 :
+                                                             ELFCLASS32) ||
+            !ptt_symbolinside(obj, eh->e_phoff,
+                              (uint64_t) eh->e_phnum * sizeof(ElfW(Phdr))) ||
+            !ptt_symbolinside(obj, eh->e_shoff,
+                              (uint64_t) eh->e_shnum * sizeof(ElfW(Shdr))))
+                return;
+
+        page = sysconf(_SC_PAGESIZE);
+        ph = (ElfW(Phdr) *) ((char *) obj->image + eh->e_phoff);
+        for (i = 0;  i < eh->e_phnum;  i++)
+        {
+                base = ph[i].p_offset & ~(page - 1);
+                if (ph[i].p_type == PT_LOAD && obj->offset >= base &&
+                    obj->offset < ph[i].p_offset + ph[i].p_filesz)
+                {
+                        bias = obj->start - ((ph[i].p_vaddr & ~(page - 1)) +
+                                             obj->offset - base);
+                        break;
+                }
+        }
+
+        sh = (ElfW(Shdr) *) ((char *) obj->image + eh->e_shoff);
+        for (i = 0;  i < eh->e_shnum;  i++)
+        {
+                if (sh[i].sh_type == SHT_SYMTAB)
+                        symtab = &sh[i];
+                else if (sh[i].sh_type == SHT_DYNSYM && symtab == NULL)
+                        symtab = &sh[i];
+        }
+        if (symtab == NULL || symtab->sh_link >= eh->e_shnum)
+                return;
+        strtab = &sh[symtab->sh_link];
+        if (!ptt_symbolinside(obj, symtab->sh_offset, symtab->sh_size) ||
+            !ptt_symbolinside(obj, strtab->sh_offset, strtab->sh_size) ||
+            strtab->sh_size == 0)
+                return;
+
+        sym = (ElfW(Sym) *) ((char *) obj->image + symtab->sh_offset);
+        strings = (char *) obj->image + strtab->sh_offset;
+        if (strings[strtab->sh_size - 1] != '\0')
+                return;  /* Names could run past the table */
+        n = symtab->sh_size / sizeof(ElfW(Sym));
+        obj->functions = malloc(n * sizeof(struct ptt_function));
+        ptt_assert(obj->functions != NULL);
+        for (i = 0;  i < n;  i++)
+        {
+                if (ELF64_ST_TYPE(sym[i].st_info) != STT_FUNC ||
+                    sym[i].st_shndx == SHN_UNDEF || sym[i].st_value == 0 ||
+                    sym[i].st_name >= strtab->sh_size)
+                        continue;
+                obj->functions[obj->count].start = sym[i].st_value + bias;
+                obj->functions[obj->count].end = sym[i].st_value + bias +
+                                                 sym[i].st_size;
+                obj->functions[obj->count].name = strings + sym[i].st_name;
+                obj->functions[obj->count].id = 0;
+                obj->count++;
+        }
+        qsort(obj->functions, obj->count, sizeof(struct ptt_function),
+              ptt_functioncompare);
+
+        /* Symbols without size extend up to the next one */
+        for (i = 0;  i < obj->count - 1;  i++)
+                if (obj->functions[i].end == obj->functions[i].start)
+                        obj->functions[i].end = obj->functions[i + 1].start;
+}
+
+
+/*
+ * Find the identifier of an address.
+ */
+static int ptt_symbollookup (uint64_t address)
+{
+        struct ptt_object *obj = NULL;
+        struct ptt_function *f;
+        const char *base;
+        int i, low, high, mid;
+
+        for (i = 0;  i < ObjectCount;  i++)
+        {
+                if (address >= Objects[i].start && address < Objects[i].end)
+                {
+                        obj = &Objects[i];
+                        break;
+                }
+        }
+        if (obj == NULL)
+                return 0;
+        if (!obj->loaded)
+                ptt_symbolload(obj);
+
+        low = 0;
+        high = obj->count - 1;
+        while (low <= high)
+        {
+                mid = (low + high) / 2;
+                f = &obj->functions[mid];
+                if (address < f->start)
+                        high = mid - 1;
+                else if (address >= f->end)
+                        low = mid + 1;
+                else
+                {
+                        if (f->id == 0)
+                                f->id = ptt_symbolname(f->name);
+                        return f->id;
+                }
+        }
+
+        if (obj->id == 0)
+        {
+                base = strrchr(obj->path, '/');
+                obj->id = ptt_symbolname(base != NULL ? base + 1 : obj->path);
+        }
+        return obj->id;
+}
+
+
+/*
+ * Read the executable mappings of the process.
+ */
+void ptt_symbolinit (int threads)
+{
+        unsigned long long start, end, offset;
+        char line[512], perms[8], path[512];
+        FILE *maps;
+        int n;
+
+        High = calloc(threads, sizeof(uint64_t));
+        ptt_assert(High != NULL);
+        ptt_symbolname("Unknown");
+
+        maps = fopen("/proc/self/maps", "r");
+        if (maps == NULL)
+                return;
+        while (fgets(line, sizeof(line), maps) != NULL)
+        {
+                n = sscanf(line, "%llx-%llx %7s %llx %*s %*s %511s", &start, &end,
+                           perms, &offset, path);
+                if (n < 5 || perms[2] != 'x' || path[0] != '/')
+                        continue;
+                if (ObjectCount % 16 == 0)
+                {
+                        Objects = realloc(Objects, (ObjectCount + 16) *
+                                                   sizeof(struct ptt_object));
+                        ptt_assert(Objects != NULL);
+                }
+                memset(&Objects[ObjectCount], 0, sizeof(struct ptt_object));
+                Objects[ObjectCount].start = start;
+                Objects[ObjectCount].end = end;
+                Objects[ObjectCount].offset = offset;
+                Objects[ObjectCount].path = strdup(path);
+                ObjectCount++;
+        }
+        fclose(maps);
+}
+
+
+/*
+ * Feed a sample or function event.  Upper halves of sampled addresses are
+ * kept until the lower one arrives, in which case -1 is returned so the event
+ * is skipped.  Otherwise, return the identifier of the complete address.
+ * Function events carry offsets within the executable instead.
+ */
+int ptt_symbolevent (int thread, int type, int value)
+{
+        if (type == PTT_HIGH_EVENT)
+        {
+                High[thread] = (uint64_t) (uint32_t) value << 32;
+                return -1;
+        }
+        if (type == PTT_FUNC_EVENT)
+                return value == 0 ? 0 : ptt_symbollookup((uintptr_t)
+                                                         &__executable_start +
+                                                         value);
+        return ptt_symbollookup(High[thread] | (uint32_t) value);
+}
+
+
+/*
+ * Find the address of a function by name, or zero if not found.
+ */
+uint64_t ptt_symbolfind (const char *name)
+{
+        int i, f;
+
+        for (i = 0;  i < ObjectCount;  i++)
+        {
+                if (!Objects[i].loaded)
+                        ptt_symbolload(&Objects[i]);
+                for (f = 0;  f < Objects[i].count;  f++)
+                        if (strcmp(Objects[i].functions[f].name, name) == 0)
+                                return Objects[i].functions[f].start;
+        }
+        return 0;
+}
+
+
+/*
+ * Name of a function identifier.
+ */
+const char *ptt_symbolstring (int id)
+{
+        return id >= 0 && id < NameCount ? Names[id] : NULL;
+}
+
+
+/*
+ * Append the sample and function event types, along with the function names,
+ * to the PCF file.
+ */
+void ptt_symbolwrite (FILE *output)
+{
+        int e, i;
+
+        e = fprintf(output, "\n\nEVENT_TYPE\n");
+        ptt_assert(e > 0);
+        if (PttGlobal.functions)
+        {
+                e = fprintf(output, "0    %d    Function\n", PTT_FUNC_EVENT);
+                ptt_assert(e > 0);
+        }
+        for (i = 0;  PttGlobal.sampleperiod > 0 && i <= PttGlobal.sampledepth;
+             i++)
+        {
+                if (i == 0)
+                        e = fprintf(output, "0    %d    Sampled function\n",
+                                    PTT_SAMPLE_EVENT);
+                else
+                        e = fprintf(output, "0    %d    Sampled caller %d\n",
+                                    PTT_SAMPLE_EVENT + i, i);
+                ptt_assert(e > 0);
+        }
+        e = fprintf(output, "VALUES\n");
+        ptt_assert(e > 0);
+        for (i = 0;  i < NameCount;  i++)
+        {
+                e = fprintf(output, "%d      %s\n", i, Names[i]);
+                ptt_assert(e > 0);
+        }
+}
+
+
+void ptt_symbolfini (void)
+{
+        int i;
+
+        for (i = 0;  i < ObjectCount;  i++)
+        {
+                if (Objects[i].image != NULL)
+                        munmap(Objects[i].image, Objects[i].size);
+                free(Objects[i].functions);
+                free(Objects[i].path);
+        }
+        for (i = 0;  i < NameCount;  i++)
+                free(Names[i]);
+        free(Objects);
+        free(Names);
+        free(High);
+        Objects = NULL;
+        Names = NULL;
+        High = NULL;
+        ObjectCount = 0;
+        NameCount = 0;
+}
@@ -0,0 +1,75 @@
+BEGIN {
+    parsing = 0
+    printed = 0
+    ntypes = 0
+    nvalues = 0
+    print "/* Automatically generated.  Do not edit. */"
+}
+
+
+# Turn a caption into a class name: "Cond waiting" becomes "CondWaiting"
+function classname(caption,    words, n, i, name) {
+    n = split(caption, words, /[^A-Za-z0-9]+/)
+    name = ""
+    for (i = 1;  i <= n;  i++)
+        name = name toupper(substr(words[i], 1, 1)) substr(words[i], 2)
+    if (name ~ /^[0-9]/)
+        name = "_" name
+    return name
+}
+
+
+# Print the types of the block just parsed, each with all the values
+function flush(    t, v, name) {
+    for (t = 0;  t < ntypes;  t++) {
+        if (printed++)
+            print ""
+        printf "struct %s : ptt::type<%d>\n{\n", types[t], typeids[t]
+        for (v = 0;  v < nvalues;  v++) {
+            name = values[v]
+            if (name == types[t])
+                name = name "_"
+            printf "        struct %s : ptt::value<%s, %d> {};\n", name,
+                   types[t], valueids[v]
+        }
+        print "};"
+    }
+    ntypes = 0
+    nvalues = 0
+}
+
+
+/^\s*$/ {
+    flush()
+    parsing = 0
+    next
+}
+
+
+/^EVENT_TYPE\s*$/ {
+    flush()
+    parsing = 1
+    next
+}
+
+
+/^VALUES\s*$/ {
+    parsing = 2
+    next
+}
+
+
+{
+    if (parsing == 1) {
+        typeids[ntypes] = $2
+        types[ntypes++] = classname(substr($0, index($0, $3)))
+    } else if (parsing == 2) {
+        valueids[nvalues] = $1
+        values[nvalues++] = classname(substr($0, index($0, $2)))
+    }
+}
+
+
+END {
+    flush()
+}
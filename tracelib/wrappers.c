@@ -31,11 +31,31 @@
  */
 
 #include <stdlib.h>
+#include "timestamp.h"
+#ifdef PTT_IOWRAP
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <stdarg.h>
+#  include <limits.h>
+#endif
 
 
-/* External references to be resolved against the real PThread library */
-extern int __real_pthread_create (pthread_t *, const pthread_attr_t *,
-                                  void *(*)(void *), void *);
+/*
+ * Add a synchronization event to the buffer of a traced thread.  The buffer is
+ * not kept claimed while the thread waits, so it can still be sampled.
+ */
+static void ptt_syncevent (struct ptt_threadbuf *tb, int value)
+{
+        int i;
+
+        ptt_enter(tb);
+        i = ptt_reserve(tb, 1);
+        tb->eventcount++;
+        tb->events[i].timestamp = ptt_getticks();
+        tb->events[i].type = PTT_SYNC_EVENT;
+        tb->events[i].value = value;
+        ptt_leave(tb);
+}
 
 
 /*
@@ -48,28 +68,311 @@ extern int __real_pthread_create (pthread_t *, const pthread_attr_t *,
  * user function.
  *
  * However, there is one problem to workaround: remembering the user function
- * and its argument.  Some memory needs to be allocated for that matter.  But,
- * as the new thread will need to allocate memory for its event buffer, joining
- * both allocations into one saves some work.  Because of this, the
- * "ptt_threadbuf" structure contains some extra fields.
+ * and its argument.  Some memory needs to be allocated for that matter.  The
+ * event buffer itself is not allocated here but by the new thread, so it lands
+ * in memory local to it (see ptt_startthread()).  The creating thread is
+ * remembered too, so the new thread can tell who its parent is.
  */
 int __wrap_pthread_create (pthread_t *tidp, const pthread_attr_t *attrp,
                            void *(*func)(void *), void *arg)
 {
+        struct ptt_threadstart *ts;
         struct ptt_threadbuf *tb;
         int e;
 
+        /* Not an allocation of the program, see "malloc.c" */
+        tb = pthread_getspecific(PttGlobal.tlskey);
+        if (tb != NULL)
+                ptt_enter(tb);
         e = pthread_mutex_lock(&PttGlobal.tlslock);
         ptt_assert(e == 0);
         /* Begin critical section */
-        tb = malloc(sizeof(struct ptt_threadbuf));
-        ptt_assert(tb != NULL);
+        ts = malloc(sizeof(struct ptt_threadstart));
+        ptt_assert(ts != NULL);
         /* End critical section */
         e = pthread_mutex_unlock(&PttGlobal.tlslock);
         ptt_assert(e == 0);
+        if (tb != NULL)
+                ptt_leave(tb);
+
+        ts->function = func;
+        ts->parameter = arg;
+        ts->parent = tb != NULL ? tb->thread + 1 : 0;
+        if (tb == NULL)
+                return __real_pthread_create(tidp, attrp, ptt_startthread, ts);
+
+        ptt_syncevent(tb, PTT_SYNC_CREATE);
+        e = __real_pthread_create(tidp, attrp, ptt_startthread, ts);
+        ptt_syncevent(tb, PTT_SYNC_END);
+        return e;
+}
+
+
+/*
+ * Waits for other threads, which reveal the fork and join structure of the
+ * program to the analysis tools (see "ptt-critpath").
+ */
+int __wrap_pthread_join (pthread_t thread, void **retval)
+{
+        struct ptt_threadbuf *tb;
+        int e;
+
+        tb = pthread_getspecific(PttGlobal.tlskey);
+        if (tb == NULL)
+                return __real_pthread_join(thread, retval);
+
+        ptt_syncevent(tb, PTT_SYNC_JOIN);
+        e = __real_pthread_join(thread, retval);
+        ptt_syncevent(tb, PTT_SYNC_END);
+        return e;
+}
+
+
+int __wrap_pthread_barrier_wait (pthread_barrier_t *barrier)
+{
+        struct ptt_threadbuf *tb;
+        int e;
+
+        tb = pthread_getspecific(PttGlobal.tlskey);
+        if (tb == NULL)
+                return __real_pthread_barrier_wait(barrier);
+
+        ptt_syncevent(tb, PTT_SYNC_BARRIER);
+        e = __real_pthread_barrier_wait(barrier);
+        ptt_syncevent(tb, PTT_SYNC_END);
+        return e;
+}
 
-        tb->function = func;
-        tb->parameter = arg;
-        return __real_pthread_create(tidp, attrp, ptt_startthread, tb);
+
+
+#ifdef PTT_IOWRAP
+/*
+ * I/O system call wrappers, only built when the library is compiled with
+ * PTT_IOWRAP (see "rules.mk").  Each call leaves an event with the operation
+ * when it starts, another one with value zero when it finishes and the amount
+ * of bytes transferred at that same time.  Calls made by threads not being
+ * traced, or by the library itself, are passed through untouched.
+ *
+ * Programs doing lots of tiny operations would produce huge traces, so calls
+ * transferring less than PTT_IO_BYTES bytes and lasting less than PTT_IO_NS
+ * nanoseconds are just counted.  When only one of them is set, it is the only
+ * one that matters.  The count and the bytes accumulated so far are written
+ * before the next traced call and when the thread finishes.
+ *
+ * Only the plain symbols are intercepted.  Calls resolved by the C library to
+ * other variants (the 64 bit offset or the fortified ones) are not traced.
+ */
+enum
+{
+        PTT_IO_END = 0,
+        PTT_IO_READ,
+        PTT_IO_WRITE,
+        PTT_IO_PREAD,
+        PTT_IO_PWRITE,
+        PTT_IO_OPEN,
+        PTT_IO_FSYNC
+};
+
+extern ssize_t __real_pwrite (int, const void *, size_t, off_t);
+extern int     __real_fsync  (int);
+
+
+/*
+ * Read the thresholds.  The latency one is converted to clock ticks.  An unset
+ * threshold does not limit anything, unless both are unset.
+ */
+void ptt_ioinit (void)
+{
+        char *bytes, *ns;
+
+        bytes = getenv("PTT_IO_BYTES");
+        ns = getenv("PTT_IO_NS");
+        PttGlobal.iominbytes = 0;
+        PttGlobal.iominticks = 0;
+        if (bytes == NULL && ns == NULL)
+                return;
+
+        PttGlobal.iominbytes = bytes != NULL ? strtoull(bytes, NULL, 10)
+                                             : UINT64_MAX;
+        PttGlobal.iominticks = ns != NULL ? ptt_nstoticks(strtoull(ns, NULL,
+                                                                   10))
+                                          : UINT64_MAX;
 }
 
+
+/*
+ * Write the count of small calls, if any, at the given time stamp.  Room for
+ * two events must have been reserved.
+ */
+void ptt_iocalls (struct ptt_threadbuf *tb, uint64_t ts)
+{
+        int i;
+
+        if (tb->iocalls == 0)
+                return;
+
+        i = tb->eventcount;
+        tb->eventcount += 2;
+        tb->events[i].timestamp = ts;
+        tb->events[i].type = PTT_IOCALL_EVENT;
+        tb->events[i].value = tb->iocalls;
+        i++;
+        tb->events[i].timestamp = ts;
+        tb->events[i].type = PTT_IOBYTE_EVENT;
+        tb->events[i].value = tb->iobytes > INT_MAX ? INT_MAX : tb->iobytes;
+
+        tb->iocalls = 0;
+        tb->iobytes = 0;
+}
+
+
+/*
+ * Prepare the tracing of a call.  Room for all the events it may produce is
+ * made in advance, so that a flush never happens between its time stamps.
+ * For the same reason, the buffer stays claimed until the call is over.
+ * Return NULL if the calling thread is not traced.
+ */
+static inline struct ptt_threadbuf *ptt_iobegin (uint64_t *ts)
+{
+        struct ptt_threadbuf *tb;
+
+        tb = pthread_getspecific(PttGlobal.tlskey);
+        if (tb == NULL)
+                return NULL;
+        ptt_enter(tb);
+        ptt_reserve(tb, 5);
+        *ts = ptt_getticks();
+        return tb;
+}
+
+
+static void ptt_ioend (struct ptt_threadbuf *tb, uint64_t ts, int operation,
+                       ssize_t bytes)
+{
+        uint64_t te;
+        size_t size;
+        int i;
+
+        te = ptt_getticks();
+        size = bytes > 0 ? bytes : 0;
+        if (size < PttGlobal.iominbytes && te - ts < PttGlobal.iominticks)
+        {
+                tb->iocalls++;
+                tb->iobytes += size;
+                ptt_leave(tb);
+                return;
+        }
+
+        ptt_iocalls(tb, ts);
+        i = tb->eventcount;
+        tb->eventcount += 3;
+        tb->events[i].timestamp = ts;
+        tb->events[i].type = PTT_IO_EVENT;
+        tb->events[i].value = operation;
+        i++;
+        tb->events[i].timestamp = te;
+        tb->events[i].type = PTT_IO_EVENT;
+        tb->events[i].value = PTT_IO_END;
+        i++;
+        tb->events[i].timestamp = te;
+        tb->events[i].type = PTT_IOSIZE_EVENT;
+        tb->events[i].value = size > INT_MAX ? INT_MAX : size;
+        ptt_leave(tb);
+}
+
+
+ssize_t __wrap_read (int fd, void *buf, size_t count)
+{
+        struct ptt_threadbuf *tb;
+        uint64_t ts;
+        ssize_t n;
+
+        tb = ptt_iobegin(&ts);
+        n = __real_read(fd, buf, count);
+        if (tb != NULL)
+                ptt_ioend(tb, ts, PTT_IO_READ, n);
+        return n;
+}
+
+
+ssize_t __wrap_write (int fd, const void *buf, size_t count)
+{
+        struct ptt_threadbuf *tb;
+        uint64_t ts;
+        ssize_t n;
+
+        tb = ptt_iobegin(&ts);
+        n = __real_write(fd, buf, count);
+        if (tb != NULL)
+                ptt_ioend(tb, ts, PTT_IO_WRITE, n);
+        return n;
+}
+
+
+ssize_t __wrap_pread (int fd, void *buf, size_t count, off_t offset)
+{
+        struct ptt_threadbuf *tb;
+        uint64_t ts;
+        ssize_t n;
+
+        tb = ptt_iobegin(&ts);
+        n = __real_pread(fd, buf, count, offset);
+        if (tb != NULL)
+                ptt_ioend(tb, ts, PTT_IO_PREAD, n);
+        return n;
+}
+
+
+ssize_t __wrap_pwrite (int fd, const void *buf, size_t count, off_t offset)
+{
+        struct ptt_threadbuf *tb;
+        uint64_t ts;
+        ssize_t n;
+
+        tb = ptt_iobegin(&ts);
+        n = __real_pwrite(fd, buf, count, offset);
+        if (tb != NULL)
+                ptt_ioend(tb, ts, PTT_IO_PWRITE, n);
+        return n;
+}
+
+
+/*
+ * The mode argument is only there when a file may be created.
+ */
+int __wrap_open (const char *pathname, int flags, ...)
+{
+        struct ptt_threadbuf *tb;
+        va_list args;
+        mode_t mode = 0;
+        uint64_t ts;
+        int fd;
+
+        if (flags & O_CREAT)
+        {
+                va_start(args, flags);
+                mode = va_arg(args, int);
+                va_end(args);
+        }
+
+        tb = ptt_iobegin(&ts);
+        fd = __real_open(pathname, flags, mode);
+        if (tb != NULL)
+                ptt_ioend(tb, ts, PTT_IO_OPEN, 0);
+        return fd;
+}
+
+
+int __wrap_fsync (int fd)
+{
+        struct ptt_threadbuf *tb;
+        uint64_t ts;
+        int e;
+
+        tb = ptt_iobegin(&ts);
+        e = __real_fsync(fd);
+        if (tb != NULL)
+                ptt_ioend(tb, ts, PTT_IO_FSYNC, 0);
+        return e;
+}
+#endif